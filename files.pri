@@ -12,6 +12,8 @@ SVGUI_HEADERS += \
            layer/HorizontalScaleProvider.h \
            layer/ImageLayer.h \
            layer/ImageRegionFinder.h \
+           layer/ImageTilePyramid.h \
+           layer/InstantCountIndex.h \
            layer/Layer.h \
            layer/LayerFactory.h \
            layer/LayerGeometryProvider.h \
@@ -20,12 +22,16 @@ SVGUI_HEADERS += \
            layer/LinearColourScale.h \
            layer/LogColourScale.h \
            layer/NoteLayer.h \
+           layer/OversampledWaveformCache.h \
            layer/PaintAssistant.h \
+           layer/PaintTelemetry.h \
            layer/PianoScale.h \
            layer/RegionLayer.h \
+           layer/RenderThreadPool.h \
            layer/RenderTimer.h \
            layer/ScrollableImageCache.h \
            layer/ScrollableMagRangeCache.h \
+           layer/ScrollableValueCache.h \
            layer/SingleColourLayer.h \
            layer/SliceableLayer.h \
            layer/SliceLayer.h \
@@ -34,17 +40,23 @@ SVGUI_HEADERS += \
            layer/TextLayer.h \
            layer/TimeInstantLayer.h \
            layer/BoxLayer.h \
+           layer/BoxSpatialIndex.h \
            layer/TimeRulerLayer.h \
            layer/TimeValueLayer.h \
+           layer/TimeValueSummaryPyramid.h \
            layer/VerticalScaleLayer.h \
            layer/WaveformLayer.h \
            view/AlignmentView.h \
+           view/ImageStripWriter.h \
            view/Overview.h \
            view/Pane.h \
            view/PaneStack.h \
+           view/RenderBenchmark.h \
            view/View.h \
+           view/ViewChunkProxy.h \
            view/ViewManager.h \
            view/ViewProxy.h \
+           view/ViewTileCache.h \
            widgets/ActivityLog.h \
            widgets/AudioDial.h \
            widgets/ClickableLabel.h \
@@ -108,6 +120,8 @@ SVGUI_SOURCES += \
            layer/HorizontalFrequencyScale.cpp \
            layer/ImageLayer.cpp \
            layer/ImageRegionFinder.cpp \
+           layer/ImageTilePyramid.cpp \
+           layer/InstantCountIndex.cpp \
            layer/Layer.cpp \
            layer/LayerFactory.cpp \
            layer/LinearNumericalScale.cpp \
@@ -115,11 +129,15 @@ SVGUI_SOURCES += \
            layer/LinearColourScale.cpp \
            layer/LogColourScale.cpp \
            layer/NoteLayer.cpp \
+           layer/OversampledWaveformCache.cpp \
            layer/PaintAssistant.cpp \
+           layer/PaintTelemetry.cpp \
            layer/PianoScale.cpp \
            layer/RegionLayer.cpp \
+           layer/RenderThreadPool.cpp \
            layer/ScrollableImageCache.cpp \
            layer/ScrollableMagRangeCache.cpp \
+           layer/ScrollableValueCache.cpp \
            layer/SingleColourLayer.cpp \
            layer/SliceLayer.cpp \
            layer/SpectrogramLayer.cpp \
@@ -127,15 +145,20 @@ SVGUI_SOURCES += \
            layer/TextLayer.cpp \
            layer/TimeInstantLayer.cpp \
            layer/BoxLayer.cpp \
+           layer/BoxSpatialIndex.cpp \
            layer/TimeRulerLayer.cpp \
            layer/TimeValueLayer.cpp \
+           layer/TimeValueSummaryPyramid.cpp \
            layer/WaveformLayer.cpp \
            view/AlignmentView.cpp \
+           view/ImageStripWriter.cpp \
            view/Overview.cpp \
            view/Pane.cpp \
            view/PaneStack.cpp \
+           view/RenderBenchmark.cpp \
            view/View.cpp \
            view/ViewManager.cpp \
+           view/ViewTileCache.cpp \
            widgets/ActivityLog.cpp \
            widgets/AudioDial.cpp \
            widgets/ColourComboBox.cpp \
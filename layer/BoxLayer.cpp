@@ -77,13 +77,36 @@ BoxLayer::setModel(ModelId modelId)
     if (m_model == modelId) return;
     m_model = modelId;
 
+    m_index.clear();
+
     if (newModel) {
         connectSignals(m_model);
+
+        connect(newModel.get(),
+                SIGNAL(modelChanged(ModelId)),
+                this, SLOT(indexInvalid(ModelId)));
+        connect(newModel.get(),
+                SIGNAL(modelChangedWithin(ModelId, sv_frame_t, sv_frame_t)),
+                this, SLOT(indexInvalid(ModelId, sv_frame_t, sv_frame_t)));
     }
     
     emit modelReplaced();
 }
 
+void
+BoxLayer::indexInvalid(ModelId modelId)
+{
+    if (modelId != m_model) return;
+    m_index.clear();
+}
+
+void
+BoxLayer::indexInvalid(ModelId modelId, sv_frame_t from, sv_frame_t to)
+{
+    if (modelId != m_model) return;
+    m_index.invalidateFrameRange(from, to);
+}
+
 Layer::PropertyList
 BoxLayer::getProperties() const
 {
@@ -248,17 +271,20 @@ BoxLayer::getLocalPoint(LayerGeometryProvider *v, int x, int y,
 
     sv_frame_t frame = v->getFrameForX(x);
 
-    EventVector onPoints = model->getEventsCovering(frame);
-    if (onPoints.empty()) return false;
+    // Look first for boxes containing the point, querying a pixel
+    // either side of it in value so as to be sure of catching those
+    // whose edges are at y, then applying the exact test by pixel
+
+    EventVector onPoints = m_index.getBoxesOverlapping
+        (*model, frame, frame,
+         getValueForY(v, y + 1), getValueForY(v, y - 1));
 
     Event bestContaining;
     for (const auto &p: onPoints) {
         auto r = getRange(p);
         if (y > getYForValue(v, r.first) || y < getYForValue(v, r.second)) {
-            SVCERR << "inPoints: rejecting " << p.toXmlString() << endl;
             continue;
         }
-        SVCERR << "inPoints: looking at " << p.toXmlString() << endl;
         if (bestContaining == Event()) {
             bestContaining = p;
             continue;
@@ -279,6 +305,27 @@ BoxLayer::getLocalPoint(LayerGeometryProvider *v, int x, int y,
         }
     }
 
+    if (bestContaining == Event()) {
+
+        // No box contains the point, so we want the box spanning this
+        // frame whose top or bottom edge is nearest to y. Any box
+        // with an edge within d pixels of y overlaps the range y - d
+        // to y + d, so widen the range until something turns up.
+
+        int h = v->getPaintHeight();
+        onPoints.clear();
+        for (int d = 4; onPoints.empty(); d *= 2) {
+            if (d >= h) {
+                onPoints = model->getEventsCovering(frame);
+                break;
+            }
+            onPoints = m_index.getBoxesOverlapping
+                (*model, frame, frame,
+                 getValueForY(v, y + d), getValueForY(v, y - d));
+        }
+        if (onPoints.empty()) return false;
+    }
+
     if (bestContaining != Event()) {
         point = bestContaining;
     } else {
@@ -546,8 +593,15 @@ BoxLayer::paint(LayerGeometryProvider *v, QPainter &paint,
     sv_frame_t wholeFrame0 = v->getFrameForX(0);
     sv_frame_t wholeFrame1 = v->getFrameForX(v->getPaintWidth());
 
-    EventVector points(model->getEventsSpanning(wholeFrame0,
-                                                wholeFrame1 - wholeFrame0));
+    // Boxes entirely above or below the view can't be seen, and nor
+    // can their labels, which are drawn level with their edges. Allow
+    // a few pixels for the pen width.
+
+    int ymargin = v->scalePixelSize(4);
+    EventVector points(m_index.getBoxesOverlapping
+                       (*model, wholeFrame0, wholeFrame1,
+                        getValueForY(v, v->getPaintHeight() + ymargin),
+                        getValueForY(v, -ymargin)));
     if (points.empty()) return;
 
     paint.setPen(getBaseQColor());
@@ -583,18 +637,8 @@ BoxLayer::paint(LayerGeometryProvider *v, QPainter &paint,
         int w = v->getXForFrame(p.getFrame() + p.getDuration()) - x;
         int y = getYForValue(v, r.first);
         int h = getYForValue(v, r.second) - y;
-        int ex = x + w;
         int gap = v->scalePixelSize(2);
 
-        EventVector::const_iterator j = i;
-        ++j;
-
-        if (j != points.end()) {
-            const Event &q(*j);
-            int nx = v->getXForFrame(q.getFrame());
-            if (nx < ex) ex = nx;
-        }
-
         if (w < 1) w = 1;
 
         paint.setPen(getBaseQColor());
@@ -17,6 +17,7 @@
 
 #include "SingleColourLayer.h"
 #include "VerticalScaleLayer.h"
+#include "BoxSpatialIndex.h"
 
 #include "data/model/BoxModel.h"
 
@@ -115,6 +116,10 @@ public:
     double getValueForY(LayerGeometryProvider *v, int y) const override;
     QString getScaleUnits() const override;
 
+protected slots:
+    void indexInvalid(ModelId);
+    void indexInvalid(ModelId, sv_frame_t startFrame, sv_frame_t endFrame);
+
 protected:
     void getScaleExtents(LayerGeometryProvider *, double &min, double &max, bool &log) const;
 
@@ -136,6 +141,8 @@ protected:
     ChangeEventsCommand *m_editingCommand;
     VerticalScale m_verticalScale;
 
+    mutable BoxSpatialIndex m_index;
+
     std::pair<float, float> getRange(const Event &e) const {
         return { e.getValue(), e.getValue() + fabsf(e.getLevel()) };
     }
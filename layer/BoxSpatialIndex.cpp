@@ -0,0 +1,270 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "BoxSpatialIndex.h"
+
+#include "data/model/BoxModel.h"
+
+#include "base/Debug.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+//#define DEBUG_BOX_SPATIAL_INDEX 1
+
+void
+BoxSpatialIndex::Bounds::extend(const Bounds &b)
+{
+    start = min(start, b.start);
+    end = max(end, b.end);
+    low = min(low, b.low);
+    high = max(high, b.high);
+}
+
+BoxSpatialIndex::BoxSpatialIndex() :
+    m_built(false),
+    m_rootFirst(0),
+    m_rootCount(0),
+    m_removedCount(0)
+{
+}
+
+void
+BoxSpatialIndex::clear()
+{
+    m_built = false;
+    m_items.clear();
+    m_nodes.clear();
+    m_rootFirst = 0;
+    m_rootCount = 0;
+    m_itemsByStart.clear();
+    m_removedCount = 0;
+    m_added.clear();
+    m_pending.clear();
+}
+
+void
+BoxSpatialIndex::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+    if (!m_built) return;
+    m_pending.push_back({ from, to });
+}
+
+BoxSpatialIndex::Bounds
+BoxSpatialIndex::getBounds(const Event &e)
+{
+    // as BoxLayer::getRange
+    double low = e.getValue();
+    double high = low + fabsf(e.getLevel());
+    return { e.getFrame(), e.getFrame() + e.getDuration(), low, high };
+}
+
+template <typename T>
+static void
+sortTileRecursive(typename vector<T>::iterator begin,
+                  typename vector<T>::iterator end,
+                  int capacity)
+{
+    // Sort into vertical slices by time, then each slice by value,
+    // so that consecutive runs of capacity elements are compact in
+    // both dimensions
+
+    int n = int(end - begin);
+    if (n <= capacity) return;
+
+    int groups = (n + capacity - 1) / capacity;
+    int slices = int(ceil(sqrt(double(groups))));
+    int perSlice = slices * capacity;
+
+    sort(begin, end, [](const T &a, const T &b) {
+                         return a.bounds.start + a.bounds.end <
+                             b.bounds.start + b.bounds.end;
+                     });
+
+    for (int s = 0; s < n; s += perSlice) {
+        auto sliceEnd = (n - s > perSlice ? begin + s + perSlice : end);
+        sort(begin + s, sliceEnd, [](const T &a, const T &b) {
+                                      return a.bounds.low + a.bounds.high <
+                                          b.bounds.low + b.bounds.high;
+                                  });
+    }
+}
+
+void
+BoxSpatialIndex::build(const BoxModel &model)
+{
+    clear();
+
+    EventVector events = model.getAllEvents();
+
+    m_items.reserve(events.size());
+    for (const auto &e: events) {
+        m_items.push_back({ getBounds(e), e, false });
+    }
+
+    sortTileRecursive<Item>(m_items.begin(), m_items.end(), nodeCapacity);
+
+    for (int i = 0; i < int(m_items.size()); ++i) {
+        m_itemsByStart.insert({ m_items[i].bounds.start, i });
+    }
+
+    // Leaves take consecutive runs of items, and each level above
+    // takes consecutive runs of the level below, after ordering that
+    // level in the same way
+
+    vector<Node> level;
+    for (int i = 0; i < int(m_items.size()); i += nodeCapacity) {
+        Node node;
+        node.first = i;
+        node.count = min(nodeCapacity, int(m_items.size()) - i);
+        node.leaf = true;
+        node.bounds = m_items[i].bounds;
+        for (int j = 1; j < node.count; ++j) {
+            node.bounds.extend(m_items[i + j].bounds);
+        }
+        level.push_back(node);
+    }
+
+    while (int(level.size()) > nodeCapacity) {
+
+        sortTileRecursive<Node>(level.begin(), level.end(), nodeCapacity);
+
+        int base = int(m_nodes.size());
+        m_nodes.insert(m_nodes.end(), level.begin(), level.end());
+
+        vector<Node> above;
+        for (int i = 0; i < int(level.size()); i += nodeCapacity) {
+            Node node;
+            node.first = base + i;
+            node.count = min(nodeCapacity, int(level.size()) - i);
+            node.leaf = false;
+            node.bounds = level[i].bounds;
+            for (int j = 1; j < node.count; ++j) {
+                node.bounds.extend(level[i + j].bounds);
+            }
+            above.push_back(node);
+        }
+
+        level = above;
+    }
+
+    m_rootFirst = int(m_nodes.size());
+    m_rootCount = int(level.size());
+    m_nodes.insert(m_nodes.end(), level.begin(), level.end());
+
+    m_built = true;
+
+#ifdef DEBUG_BOX_SPATIAL_INDEX
+    SVDEBUG << "BoxSpatialIndex::build: " << m_items.size() << " boxes in "
+            << m_nodes.size() << " nodes" << endl;
+#endif
+}
+
+void
+BoxSpatialIndex::update(const BoxModel &model, sv_frame_t from, sv_frame_t to)
+{
+    if (to < from) return;
+
+    auto i0 = m_itemsByStart.lower_bound(from);
+    auto i1 = m_itemsByStart.upper_bound(to);
+    for (auto i = i0; i != i1; ++i) {
+        m_items[i->second].removed = true;
+        ++m_removedCount;
+    }
+    m_itemsByStart.erase(i0, i1);
+
+    m_added.erase(remove_if(m_added.begin(), m_added.end(),
+                            [&](const Item &item) {
+                                return item.bounds.start >= from &&
+                                    item.bounds.start <= to;
+                            }),
+                  m_added.end());
+
+    EventVector events = model.getEventsStartingWithin(from, to - from + 1);
+    for (const auto &e: events) {
+        m_added.push_back({ getBounds(e), e, false });
+    }
+
+#ifdef DEBUG_BOX_SPATIAL_INDEX
+    SVDEBUG << "BoxSpatialIndex::update: " << from << " to " << to
+            << ": now have " << m_removedCount << " removed and "
+            << m_added.size() << " added" << endl;
+#endif
+}
+
+void
+BoxSpatialIndex::prepare(const BoxModel &model)
+{
+    if (!m_built) {
+        build(model);
+        return;
+    }
+
+    for (auto r: m_pending) {
+        update(model, r.first, r.second);
+    }
+    m_pending.clear();
+
+    // The added boxes are searched linearly, so don't let them (or
+    // the dead weight of removed ones) grow too far
+
+    int threshold = max(256, int(m_items.size()) / 8);
+    if (m_removedCount + int(m_added.size()) > threshold) {
+        build(model);
+    }
+}
+
+EventVector
+BoxSpatialIndex::getBoxesOverlapping(const BoxModel &model,
+                                     sv_frame_t frame0, sv_frame_t frame1,
+                                     double value0, double value1)
+{
+    prepare(model);
+
+    Bounds query { frame0, frame1, min(value0, value1), max(value0, value1) };
+
+    EventVector result;
+
+    vector<int> stack;
+    for (int i = 0; i < m_rootCount; ++i) {
+        stack.push_back(m_rootFirst + i);
+    }
+
+    while (!stack.empty()) {
+        const Node &node = m_nodes[stack.back()];
+        stack.pop_back();
+        if (!node.bounds.overlaps(query)) continue;
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            if (node.leaf) {
+                const Item &item = m_items[i];
+                if (!item.removed && item.bounds.overlaps(query)) {
+                    result.push_back(item.event);
+                }
+            } else {
+                stack.push_back(i);
+            }
+        }
+    }
+
+    for (const auto &item: m_added) {
+        if (item.bounds.overlaps(query)) {
+            result.push_back(item.event);
+        }
+    }
+
+    sort(result.begin(), result.end());
+    return result;
+}
@@ -0,0 +1,112 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef BOX_SPATIAL_INDEX_H
+#define BOX_SPATIAL_INDEX_H
+
+#include "base/BaseTypes.h"
+#include "base/Event.h"
+
+#include <vector>
+#include <map>
+#include <utility>
+
+class BoxModel;
+
+/**
+ * A two-dimensional index of the events in a BoxModel, by time and
+ * by value range, for finding the boxes that overlap a given area of
+ * a view without examining every box in its time range.
+ *
+ * The index is an R-tree, bulk-loaded from the whole model by
+ * sort-tile-recursive packing when first used. Changes reported by
+ * the model are applied without rebuilding: boxes starting within a
+ * changed frame range are marked as removed from the tree, and the
+ * boxes the model then has starting there are kept in a short list
+ * that is searched linearly. When the removed and added boxes
+ * together amount to a significant fraction of the tree, it is
+ * rebuilt from the model on the next query.
+ *
+ * Not thread-safe.
+ */
+class BoxSpatialIndex
+{
+public:
+    static const int nodeCapacity = 16;
+
+    BoxSpatialIndex();
+
+    void clear();
+
+    /**
+     * Note that the boxes starting from frame from to frame to
+     * inclusive may have changed. They are re-read from the model on
+     * the next query.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
+
+    /**
+     * Return the boxes whose extents, from frame to frame + duration
+     * in time and from value to value + |level| in value, overlap the
+     * given time and value ranges (inclusive at both ends). The
+     * result is in Event order.
+     */
+    EventVector getBoxesOverlapping(const BoxModel &model,
+                                    sv_frame_t frame0, sv_frame_t frame1,
+                                    double value0, double value1);
+
+private:
+    struct Bounds {
+        sv_frame_t start;
+        sv_frame_t end;
+        double low;
+        double high;
+
+        bool overlaps(const Bounds &b) const {
+            return start <= b.end && b.start <= end &&
+                low <= b.high && b.low <= high;
+        }
+        void extend(const Bounds &b);
+    };
+
+    struct Item {
+        Bounds bounds;
+        Event event;
+        bool removed;
+    };
+
+    struct Node {
+        Bounds bounds;
+        int first;  // index of first child node, or item if a leaf
+        int count;
+        bool leaf;
+    };
+
+    bool m_built;
+    std::vector<Item> m_items;
+    std::vector<Node> m_nodes;
+    int m_rootFirst;
+    int m_rootCount;
+    std::multimap<sv_frame_t, int> m_itemsByStart;
+    int m_removedCount;
+    std::vector<Item> m_added;
+    std::vector<std::pair<sv_frame_t, sv_frame_t>> m_pending;
+
+    static Bounds getBounds(const Event &e);
+    void prepare(const BoxModel &model);
+    void build(const BoxModel &model);
+    void update(const BoxModel &model, sv_frame_t from, sv_frame_t to);
+};
+
+#endif
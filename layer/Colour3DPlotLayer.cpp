@@ -33,6 +33,7 @@
 #include <QRect>
 #include <QTextStream>
 #include <QSettings>
+#include <QThread>
 
 #include <iostream>
 
@@ -287,6 +288,11 @@ Colour3DPlotLayer::handleModelChangedWithin(ModelId modelId,
             }
         }
     }
+    for (ViewRendererMap::iterator i = m_renderers.begin();
+         i != m_renderers.end(); ++i) {
+        i->second->invalidateFrameRange(startFrame, endFrame);
+    }
+    invalidateMagnitudes();
     emit modelChangedWithin(modelId, startFrame, endFrame);
 }
 
@@ -1155,6 +1161,7 @@ Colour3DPlotLayer::getRenderer(const LayerGeometryProvider *v) const
         params.alwaysOpaque = m_opaque;
         params.invertVertical = m_invertVertical;
         params.interpolate = m_smooth;
+        params.threadCount = QThread::idealThreadCount();
 
         m_renderers[viewId] = new Colour3DPlotRenderer(sources, params);
     }
@@ -15,6 +15,7 @@
 
 #include "Colour3DPlotRenderer.h"
 #include "RenderTimer.h"
+#include "RenderThreadPool.h"
 
 #include "base/Profiler.h"
 #include "base/HitCount.h"
@@ -30,7 +31,11 @@
 
 #include "view/ViewManager.h" // for main model sample rate. Pity
 
+#include <QMutexLocker>
+#include <QRegion>
+
 #include <vector>
+#include <functional>
 
 #include <utility>
 using namespace std::rel_ops;
@@ -40,6 +45,11 @@ using namespace std::rel_ops;
 
 using namespace std;
 
+Colour3DPlotRenderer::~Colour3DPlotRenderer()
+{
+    cancelBackgroundTile();
+}
+
 Colour3DPlotRenderer::RenderResult
 Colour3DPlotRenderer::render(const LayerGeometryProvider *v, QPainter &paint, QRect rect)
 {
@@ -93,6 +103,273 @@ Colour3DPlotRenderer::geometryChanged(const LayerGeometryProvider *v)
     }
 }
 
+void
+Colour3DPlotRenderer::setColourScale(ColourScale colourScale,
+                                     int colourRotation)
+{
+    Profiler profiler("Colour3DPlotRenderer::setColourScale");
+
+    // The background render thread uses the colour scale
+    cancelBackgroundTile();
+
+    bool sameMapping = m_params.colourScale.hasSameMapping(colourScale);
+
+    // Phase is rendered from different source data altogether
+    bool sameSource =
+        ((m_params.colourScale.getScale() == ColourScaleType::Phase) ==
+         (colourScale.getScale() == ColourScaleType::Phase));
+
+    m_params.colourScale = colourScale;
+    m_params.colourRotation = colourRotation;
+
+    // The draw buffer's colour table is now out of date, as is
+    // everything kept from other zoom levels
+    m_drawBuffer = QImage();
+    m_magRanges.clear();
+    m_zoomCache.clear();
+
+    if (!sameSource) {
+        m_cache.invalidate();
+        m_magCache.invalidate();
+        m_valueCache.invalidate();
+        return;
+    }
+
+    if (!m_cache.isValid()) {
+        return;
+    }
+
+    int left = m_cache.getValidLeft();
+    int width = m_cache.getValidWidth();
+
+    using namespace std::rel_ops;
+
+    if (m_valueCache.getSize() != m_cache.getSize() ||
+        m_valueCache.getZoomLevel() != m_cache.getZoomLevel() ||
+        m_valueCache.getStartFrame() != m_cache.getStartFrame() ||
+        !m_valueCache.areColumnsSet(left, width)) {
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+        SVDEBUG << "render " << m_sources.source
+                << ": setColourScale: no values for whole of cache, "
+                << "invalidating it" << endl;
+#endif
+        m_cache.invalidate();
+        return;
+    }
+
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+    SVDEBUG << "render " << m_sources.source
+            << ": setColourScale: recolouring cache from " << left
+            << " to " << left + width << ", sameMapping = " << sameMapping
+            << endl;
+#endif
+
+    if (!sameMapping) {
+        m_valueCache.remap(m_params.colourScale, m_params.invertVertical);
+    }
+
+    QImage indices = m_valueCache.getIndexImage();
+    indices.setColorTable(getColourTable());
+    m_cache.drawImage(left, width, indices, left, width);
+}
+
+void
+Colour3DPlotRenderer::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+    SVDEBUG << "render " << m_sources.source
+            << ": invalidateFrameRange(" << from << ", " << to << ")" << endl;
+#endif
+
+    if (m_tile) {
+        // A tile in progress may already have read the old data
+        ZoomLevel zoom = m_tile->zoomLevel;
+        sv_frame_t tileStart = m_tile->startFrame +
+            sv_frame_t(zoom.pixelsToFrames(m_tile->left));
+        sv_frame_t tileEnd = m_tile->startFrame +
+            sv_frame_t(ceil(zoom.pixelsToFrames(m_tile->left + m_tile->width)));
+        if (tileStart <= to && tileEnd >= from) {
+            cancelBackgroundTile();
+        }
+    }
+    
+    m_cache.invalidateFrameRange(from, to);
+    m_magCache.invalidateFrameRange(from, to);
+    m_valueCache.invalidateFrameRange(from, to);
+    m_zoomCache.invalidateFrameRange(from, to);
+}
+
+void
+Colour3DPlotRenderer::updateCacheGeometry(const LayerGeometryProvider *v)
+{
+    using namespace std::rel_ops;
+
+    bool changing = (m_cache.getSize() != v->getPaintSize() ||
+                     m_cache.getZoomLevel() != v->getZoomLevel());
+
+    if (changing) {
+        storeInZoomCache();
+    }
+    
+    m_cache.resize(v->getPaintSize());
+    m_cache.setZoomLevel(v->getZoomLevel());
+
+    m_magCache.resize(v->getPaintSize().width());
+    m_magCache.setZoomLevel(v->getZoomLevel());
+
+    m_valueCache.resize(v->getPaintSize());
+    m_valueCache.setZoomLevel(v->getZoomLevel());
+
+    if (changing) {
+        restoreFromZoomCache(v);
+    }
+}
+
+void
+Colour3DPlotRenderer::storeInZoomCache()
+{
+    if (!m_cache.isValid() || m_zoomCache.getMemoryBudget() == 0) {
+        return;
+    }
+
+    ZoomLevel zoom = m_cache.getZoomLevel();
+    if (zoom.zone != ZoomLevel::FramesPerPixel ||
+        m_cache.getStartFrame() % zoom.level != 0) {
+        // Can't be placed on the tile grid without moving columns,
+        // which would then be restored as if they were exact
+        return;
+    }
+
+    int left = m_cache.getValidLeft();
+    int right = m_cache.getValidRight();
+    
+    vector<MagnitudeRange> ranges(m_cache.getSize().width());
+    for (int x = left; x < right; ++x) {
+        if (m_magCache.isColumnSet(x)) {
+            ranges[x] = m_magCache.getRange(x);
+        }
+    }
+
+    m_zoomCache.store(zoom, m_cache.getStartFrame(), m_cache.getImage(),
+                      left, right - left, ranges);
+}
+
+void
+Colour3DPlotRenderer::restoreFromZoomCache(const LayerGeometryProvider *v)
+{
+    QSize size = m_cache.getSize();
+    int w = size.width();
+    if (w == 0 || size.height() == 0) {
+        return;
+    }
+
+    ZoomLevel zoom = v->getZoomLevel();
+    sv_frame_t startFrame = v->getStartFrame();
+    if (zoom.zone != ZoomLevel::FramesPerPixel ||
+        startFrame % zoom.level != 0) {
+        // The tiles would not line up exactly with the view's
+        // columns. Leave the cache invalid so that they are properly
+        // rendered, with paintFromZoomCache standing in meanwhile
+        return;
+    }
+
+    auto tiles = m_zoomCache.getTiles(zoom, size.height(),
+                                      v->getFrameForX(0), v->getFrameForX(w));
+    if (tiles.empty()) {
+        return;
+    }
+
+    // The image cache has only a single contiguous valid area, so
+    // restore the longest run of adjacent tiles
+    
+    size_t bestStart = 0, bestEnd = 0;
+    sv_frame_t bestDuration = 0;
+    
+    for (size_t i = 0; i < tiles.size(); ) {
+        size_t j = i + 1;
+        while (j < tiles.size() &&
+               tiles[j].startFrame == tiles[j-1].getEndFrame()) {
+            ++j;
+        }
+        sv_frame_t duration = tiles[j-1].getEndFrame() - tiles[i].startFrame;
+        if (duration > bestDuration) {
+            bestStart = i;
+            bestEnd = j;
+            bestDuration = duration;
+        }
+        i = j;
+    }
+
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+    SVDEBUG << "render " << m_sources.source
+            << ": restoring " << (bestEnd - bestStart)
+            << " tile(s) from zoom cache" << endl;
+#endif
+
+    m_cache.setStartFrame(startFrame);
+    m_magCache.setStartFrame(startFrame);
+    m_valueCache.setStartFrame(startFrame);
+    
+    for (size_t i = bestStart; i < bestEnd; ++i) {
+
+        const ImageTilePyramid::Tile &tile = tiles[i];
+
+        int x = v->getXForFrame(tile.startFrame);
+        int left = std::max(x, 0);
+        int right = std::min(x + tile.image.width(), w);
+        if (right <= left) {
+            continue;
+        }
+        
+        m_cache.drawImage(left, right - left, tile.image, left - x, right - left);
+        m_valueCache.clearColumns(left, right - left);
+
+        for (int col = left; col < right; ++col) {
+            const MagnitudeRange &r = tile.ranges[col - x];
+            if (r.isSet()) {
+                m_magCache.sampleColumn(col, r);
+            }
+        }
+    }
+}
+
+void
+Colour3DPlotRenderer::paintFromZoomCache(const LayerGeometryProvider *v,
+                                         QPainter &paint,
+                                         QRect rect, QRect covered)
+{
+    QRegion region = QRegion(rect).subtracted(QRegion(covered));
+    if (region.isEmpty()) {
+        return;
+    }
+
+    int h = m_cache.getSize().height();
+    sv_frame_t f0 = v->getFrameForX(rect.left());
+    sv_frame_t f1 = v->getFrameForX(rect.right() + 1);
+
+    ZoomLevel nearest;
+    if (!m_zoomCache.getNearestZoomLevel(v->getZoomLevel(), h, f0, f1,
+                                         nearest)) {
+        return;
+    }
+
+    Profiler profiler("Colour3DPlotRenderer::paintFromZoomCache");
+    
+    auto tiles = m_zoomCache.getTiles(nearest, h, f0, f1);
+
+    paint.save();
+    paint.setClipRegion(region, Qt::IntersectClip);
+    
+    for (const auto &tile: tiles) {
+        int x0 = v->getXForFrame(tile.startFrame);
+        int x1 = v->getXForFrame(tile.getEndFrame());
+        if (x1 <= x0) x1 = x0 + 1;
+        paint.drawImage(QRect(x0, 0, x1 - x0, h), tile.image);
+    }
+
+    paint.restore();
+}
+
 Colour3DPlotRenderer::RenderResult
 Colour3DPlotRenderer::render(const LayerGeometryProvider *v,
                              QPainter &paint, QRect rect, bool timeConstrained)
@@ -153,11 +430,7 @@ Colour3DPlotRenderer::render(const LayerGeometryProvider *v,
             << endl;
 #endif
     
-    m_cache.resize(v->getPaintSize());
-    m_cache.setZoomLevel(v->getZoomLevel());
-
-    m_magCache.resize(v->getPaintSize().width());
-    m_magCache.setZoomLevel(v->getZoomLevel());
+    updateCacheGeometry(v);
     
     if (renderType == DirectTranslucent) {
         MagnitudeRange range = renderDirectTranslucent(v, paint, rect);
@@ -193,7 +466,7 @@ Colour3DPlotRenderer::render(const LayerGeometryProvider *v,
             count.hit();
             
             // cache is valid for the complete requested area
-            paint.drawImage(rect, m_cache.getImage(), rect);
+            m_cache.drawTo(paint, rect.x(), rect.y(), rect);
 
             MagnitudeRange range = m_magCache.getRange(x0, x1 - x0);
 
@@ -211,6 +484,7 @@ Colour3DPlotRenderer::render(const LayerGeometryProvider *v,
             // partially usable
             m_cache.scrollTo(v, startFrame);
             m_magCache.scrollTo(v, startFrame);
+            m_valueCache.scrollTo(v, startFrame);
 
             // if we are not time-constrained, then we want to paint
             // the whole area in one go; we don't return a partial
@@ -230,6 +504,7 @@ Colour3DPlotRenderer::render(const LayerGeometryProvider *v,
         count.miss();
         m_cache.setStartFrame(startFrame);
         m_magCache.setStartFrame(startFrame);
+        m_valueCache.setStartFrame(startFrame);
     }
 
     bool rightToLeft = false;
@@ -328,8 +603,12 @@ Colour3DPlotRenderer::render(const LayerGeometryProvider *v,
     }
 
     QRect pr = rect & m_cache.getValidArea();
-    paint.drawImage(pr.x(), pr.y(), m_cache.getImage(),
-                    pr.x(), pr.y(), pr.width(), pr.height());
+    m_cache.drawTo(paint, pr.x(), pr.y(), pr);
+
+    if (timeConstrained && (pr != rect)) {
+        // Stand-in for the remainder until it has been rendered
+        paintFromZoomCache(v, paint, rect, pr);
+    }
 
     if (!timeConstrained && (pr != rect)) {
         QRect cva = m_cache.getValidArea();
@@ -457,7 +736,8 @@ Colour3DPlotRenderer::decideRenderType(const LayerGeometryProvider *v) const
 
 ColumnOp::Column
 Colour3DPlotRenderer::getColumn(int sx, int minbin, int nbins,
-                                shared_ptr<DenseThreeDimensionalModel> source) const
+                                shared_ptr<DenseThreeDimensionalModel> source,
+                                int worker, int columnsPerPeak) const
 {
     // order:
     // get column -> scale -> normalise -> record extents ->
@@ -470,15 +750,18 @@ Colour3DPlotRenderer::getColumn(int sx, int minbin, int nbins,
     
     if (m_params.showDerivative && sx > 0) {
 
-        auto prev = getColumnRaw(sx - 1, minbin, nbins, source);
-        column = getColumnRaw(sx, minbin, nbins, source);
+        auto prev = getColumnRaw(sx - 1, minbin, nbins, source,
+                                 worker, columnsPerPeak);
+        column = getColumnRaw(sx, minbin, nbins, source,
+                              worker, columnsPerPeak);
         
         for (int i = 0; i < nbins; ++i) {
             column[i] -= prev[i];
         }
 
     } else {
-        column = getColumnRaw(sx, minbin, nbins, source);
+        column = getColumnRaw(sx, minbin, nbins, source,
+                              worker, columnsPerPeak);
     }
 
     if (m_params.colourScale.getScale() == ColourScaleType::Phase &&
@@ -493,20 +776,48 @@ Colour3DPlotRenderer::getColumn(int sx, int minbin, int nbins,
 
 ColumnOp::Column
 Colour3DPlotRenderer::getColumnRaw(int sx, int minbin, int nbins,
-                                   shared_ptr<DenseThreeDimensionalModel> source) const
+                                   shared_ptr<DenseThreeDimensionalModel> source,
+                                   int worker, int columnsPerPeak) const
 {
+    // Source models (notably FFTModel) are not reentrant, so when
+    // rendering in parallel or in the background we serialise our
+    // reads from them. A worker with a source of its own takes only
+    // that source's lock, which nobody else in this render holds
+    QMutexLocker locker(worker >= 0 ?
+                        m_sources.workerSources[worker].lock.get() :
+                        m_sources.sourceLock.get());
+    
     Profiler profiler("Colour3DPlotRenderer::getColumn");
 
     ColumnOp::Column column;
     ColumnOp::Column fullColumn;
 
     if (m_params.colourScale.getScale() == ColourScaleType::Phase) {
-        auto fftModel = ModelById::getAs<FFTModel>(m_sources.fft);
+        auto fftModel = (worker >= 0 ?
+                         std::dynamic_pointer_cast<FFTModel>(source) :
+                         ModelById::getAs<FFTModel>(m_sources.fft));
         if (fftModel) {
             fullColumn = fftModel->getPhases(sx);
         }
     }
 
+    if (fullColumn.empty() && columnsPerPeak > 1) {
+        int width = source->getWidth();
+        for (int i = 0; i < columnsPerPeak; ++i) {
+            int c = sx * columnsPerPeak + i;
+            if (c >= width) break;
+            auto sourceColumn = source->getColumn(c);
+            if (fullColumn.empty()) {
+                fullColumn = sourceColumn;
+                continue;
+            }
+            for (int j = 0; in_range_for(fullColumn, j) &&
+                     in_range_for(sourceColumn, j); ++j) {
+                fullColumn[j] = std::max(fullColumn[j], sourceColumn[j]);
+            }
+        }
+    }
+
     if (fullColumn.empty()) {
         fullColumn = source->getColumn(sx);
     }
@@ -730,6 +1041,37 @@ Colour3DPlotRenderer::getPreferredPeakCache(const LayerGeometryProvider *v,
 #endif
 }
 
+bool
+Colour3DPlotRenderer::getPixelResolutionBins(const LayerGeometryProvider *v,
+                                             int x0, int width,
+                                             vector<int> &binforx,
+                                             vector<double> &binfory) const
+{
+    auto model = ModelById::getAs<DenseThreeDimensionalModel>(m_sources.source);
+    if (!model) return false;
+
+    int binResolution;
+    double renderBinResolution;
+    if (!getBinResolutions(v, binResolution, renderBinResolution)) return false;
+
+    int h = v->getPaintHeight();
+
+    binforx = vector<int>(width);
+    binfory = vector<double>(h);
+    
+    for (int x = 0; x < width; ++x) {
+        sv_frame_t f0 = v->getFrameForX(x0 + x);
+        double s0 = double(f0 - model->getStartFrame()) / renderBinResolution;
+        binforx[x] = int(s0 + 0.0001);
+    }
+
+    for (int y = 0; y < h; ++y) {
+        binfory[y] = m_sources.verticalBinLayer->getBinForY(v, h - y - 1);
+    }
+
+    return true;
+}
+
 void
 Colour3DPlotRenderer::renderToCachePixelResolution(const LayerGeometryProvider *v,
                                                    int x0, int repaintWidth,
@@ -753,30 +1095,24 @@ Colour3DPlotRenderer::renderToCachePixelResolution(const LayerGeometryProvider *
 
     clearDrawBuffer(repaintWidth, h);
 
-    vector<int> binforx(repaintWidth);
-    vector<double> binfory(h);
-    
-    int binResolution;
-    double renderBinResolution;
-    if (!getBinResolutions(v, binResolution, renderBinResolution)) return;
+    vector<int> binforx;
+    vector<double> binfory;
 
-    for (int x = 0; x < repaintWidth; ++x) {
-        sv_frame_t f0 = v->getFrameForX(x0 + x);
-        double s0 = double(f0 - model->getStartFrame()) / renderBinResolution;
-        binforx[x] = int(s0 + 0.0001);
+    if (!getPixelResolutionBins(v, x0, repaintWidth, binforx, binfory)) {
+        return;
     }
 
     int peakCacheIndex = -1;
     int binsPerPeak = -1;
 
     getPreferredPeakCache(v, peakCacheIndex, binsPerPeak);
-    
-    for (int y = 0; y < h; ++y) {
-        binfory[y] = m_sources.verticalBinLayer->getBinForY(v, h - y - 1);
-    }
 
     int attainedWidth;
 
+    // Peak frequencies are drawn as points rather than mapped from
+    // columns of values, so we have nothing to keep for them
+    bool keepValues = (m_params.binDisplay != BinDisplay::PeakFrequencies);
+
     if (m_params.binDisplay == BinDisplay::PeakFrequencies) {
         attainedWidth = renderDrawBufferPeakFrequencies(v,
                                                         repaintWidth,
@@ -793,7 +1129,8 @@ Colour3DPlotRenderer::renderToCachePixelResolution(const LayerGeometryProvider *
                                          binfory,
                                          peakCacheIndex,
                                          rightToLeft,
-                                         timeConstrained);
+                                         timeConstrained,
+                                         keepValues);
     }
 
     if (attainedWidth == 0) return;
@@ -809,6 +1146,16 @@ Colour3DPlotRenderer::renderToCachePixelResolution(const LayerGeometryProvider *
                       m_drawBuffer,
                       paintedLeft - x0, attainedWidth);
 
+    if (keepValues) {
+        m_valueCache.drawColumns(paintedLeft, attainedWidth,
+                                 m_drawBuffer,
+                                 paintedLeft - x0,
+                                 m_drawBufferValues.data(),
+                                 m_drawBufferStates.data());
+    } else {
+        m_valueCache.clearColumns(paintedLeft, attainedWidth);
+    }
+
     for (int i = 0; in_range_for(m_magRanges, i); ++i) {
         m_magCache.sampleColumn(i, m_magRanges.at(i));
     }
@@ -992,6 +1339,7 @@ Colour3DPlotRenderer::renderToCacheBinResolution(const LayerGeometryProvider *v,
                                          binfory,
                                          -1,
                                          false,
+                                         false,
                                          false);
 
     if (attainedWidth == 0) return;
@@ -1058,6 +1406,9 @@ Colour3DPlotRenderer::renderToCacheBinResolution(const LayerGeometryProvider *v,
         m_cache.drawImage(targetLeft, targetWidth,
                           scaled,
                           sourceLeft, targetWidth);
+
+        // the scaled image doesn't correspond to columns of values
+        m_valueCache.clearColumns(targetLeft, targetWidth);
     }
     
     for (int i = 0; i < targetWidth; ++i) {
@@ -1070,24 +1421,18 @@ Colour3DPlotRenderer::renderToCacheBinResolution(const LayerGeometryProvider *v,
     }
 }
 
-int
-Colour3DPlotRenderer::renderDrawBuffer(int w, int h,
-                                       const vector<int> &binforx,
-                                       const vector<double> &binfory,
-                                       int peakCacheIndex,
-                                       bool rightToLeft,
-                                       bool timeConstrained)
+bool
+Colour3DPlotRenderer::prepareDrawBufferColumnSpec(int w, int h,
+                                                  const vector<int> &binforx,
+                                                  const vector<double> &binfory,
+                                                  int peakCacheIndex,
+                                                  DrawBufferColumnSpec &spec)
+    const
 {
     // Callers must have checked that the appropriate subset of
     // Sources data members are set for the supplied flags (e.g. that
     // peakCache corresponding to peakCacheIndex exists)
     
-    RenderTimer timer(timeConstrained ?
-                      RenderTimer::FastRender :
-                      RenderTimer::NoTimeout);
-
-    Profiler profiler("Colour3DPlotRenderer::renderDrawBuffer");
-    
     int divisor = 1;
 
     std::shared_ptr<DenseThreeDimensionalModel> sourceModel;
@@ -1106,22 +1451,8 @@ Colour3DPlotRenderer::renderDrawBuffer(int w, int h,
             (m_sources.source);
     }
     
-    if (!sourceModel) return 0;
+    if (!sourceModel) return false;
 
-#ifdef DEBUG_COLOUR_PLOT_REPAINT
-    SVDEBUG << "render " << m_sources.source
-            << ": renderDrawBuffer: w = " << w << ", h = " << h
-            << ", peakCacheIndex = " << peakCacheIndex << " (divisor = "
-            << divisor << "), rightToLeft = " << rightToLeft
-            << ", timeConstrained = " << timeConstrained << endl;
-    SVDEBUG << "render " << m_sources.source
-            << ": renderDrawBuffer: normalization = " << int(m_params.normalization)
-            << ", binDisplay = " << int(m_params.binDisplay)
-            << ", binScale = " << int(m_params.binScale)
-            << ", alwaysOpaque = " << m_params.alwaysOpaque
-            << ", interpolate = " << m_params.interpolate << endl;
-#endif
-    
     int sh = sourceModel->getHeight();
     
     int minbin = int(binfory[0] + 0.0001);
@@ -1138,6 +1469,102 @@ Colour3DPlotRenderer::renderDrawBuffer(int w, int h,
             << " (rounds to " << int(binfory[h-1])
             << ") (model height " << sh << ")" << endl;
 #endif
+
+    spec.w = w;
+    spec.h = h;
+    spec.binforx = &binforx;
+    spec.binfory = &binfory;
+    spec.minbin = minbin;
+    spec.nbins = nbins;
+    spec.divisor = divisor;
+    spec.sourceModel = sourceModel;
+    spec.workerModels.clear();
+    for (const auto &ws : m_sources.workerSources) {
+        spec.workerModels.push_back
+            (ModelById::getAs<DenseThreeDimensionalModel>(ws.model));
+    }
+    spec.target = nullptr;
+    spec.bytesPerLine = 0;
+    spec.values = nullptr;
+    spec.valueStates = nullptr;
+    spec.cancelled = nullptr;
+
+    return true;
+}
+
+int
+Colour3DPlotRenderer::renderDrawBuffer(int w, int h,
+                                       const vector<int> &binforx,
+                                       const vector<double> &binfory,
+                                       int peakCacheIndex,
+                                       bool rightToLeft,
+                                       bool timeConstrained,
+                                       bool keepValues)
+{
+    RenderTimer timer(timeConstrained ?
+                      RenderTimer::FastRender :
+                      RenderTimer::NoTimeout);
+
+    Profiler profiler("Colour3DPlotRenderer::renderDrawBuffer");
+
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+    SVDEBUG << "render " << m_sources.source
+            << ": renderDrawBuffer: w = " << w << ", h = " << h
+            << ", peakCacheIndex = " << peakCacheIndex
+            << ", rightToLeft = " << rightToLeft
+            << ", timeConstrained = " << timeConstrained << endl;
+    SVDEBUG << "render " << m_sources.source
+            << ": renderDrawBuffer: normalization = " << int(m_params.normalization)
+            << ", binDisplay = " << int(m_params.binDisplay)
+            << ", binScale = " << int(m_params.binScale)
+            << ", alwaysOpaque = " << m_params.alwaysOpaque
+            << ", interpolate = " << m_params.interpolate << endl;
+#endif
+
+    DrawBufferColumnSpec spec;
+    if (!prepareDrawBufferColumnSpec(w, h, binforx, binfory,
+                                     peakCacheIndex, spec)) {
+        return 0;
+    }
+
+    // Obtain the pixel data pointer here, on the calling thread, so
+    // that any detach happens before we start writing into it
+    spec.target = m_drawBuffer.bits();
+    spec.bytesPerLine = m_drawBuffer.bytesPerLine();
+
+    if (keepValues) {
+        m_drawBufferValues.resize(size_t(w) * h);
+        m_drawBufferStates.assign(w, ScrollableValueCache::ColumnState::Unset);
+        spec.values = m_drawBufferValues.data();
+        spec.valueStates = m_drawBufferStates.data();
+    }
+
+    int threads = m_params.threadCount;
+    
+    if (threads > 1 && w >= threads * minimumStripWidth) {
+
+        // Aim for about ten rounds when time-constrained, so that we
+        // check the timer reasonably often; otherwise do it all at
+        // once
+        int rounds = (timeConstrained ? 10 : 1);
+        int stripWidth = (w + threads * rounds - 1) / (threads * rounds);
+        
+        vector<MagnitudeRange> columnRanges(w);
+        int xPixelCount = renderDrawBufferParallel
+            (spec, rightToLeft, stripWidth, timer, columnRanges);
+
+        // m_magRanges holds only the columns actually rendered, in
+        // the order of rendering
+        for (int j = 0; j < xPixelCount; ++j) {
+            int x = (rightToLeft ? w - j - 1 : j);
+            if (columnRanges[x].isSet()) {
+                m_magRanges.push_back(columnRanges[x]);
+            }
+        }
+        
+        updateTimings(timer, xPixelCount);
+        return xPixelCount;
+    }
     
     int psx = -1;
 
@@ -1155,119 +1582,556 @@ Colour3DPlotRenderer::renderDrawBuffer(int w, int h,
     
     ColumnOp::Column preparedColumn;
 
-    int modelWidth = sourceModel->getWidth();
-
 #ifdef DEBUG_COLOUR_PLOT_REPAINT
     SVDEBUG << "render " << m_sources.source
-            << ": modelWidth " << modelWidth << ", divisor " << divisor << endl;
+            << ": modelWidth " << spec.sourceModel->getWidth()
+            << ", divisor " << spec.divisor << endl;
     SVDEBUG << "render " << m_sources.source
             << ": start = " << start << ", finish = " << finish << ", step = " << step << endl;
 #endif
     
     for (int x = start; x != finish; x += step) {
 
-        // x is the on-canvas pixel coord; sx (later) will be the
-        // source column index
-        
         ++xPixelCount;
-        
-        if (binforx[x] < 0) continue;
 
-        int sx0 = binforx[x] / divisor;
-        int sx1 = sx0;
-        if (x+1 < w) sx1 = binforx[x+1] / divisor;
-        if (sx0 < 0) sx0 = sx1 - 1;
-        if (sx0 < 0) continue;
-        if (sx1 <= sx0) sx1 = sx0 + 1;
+        MagnitudeRange magRange;
+        if (renderDrawBufferColumn(spec, x, psx, preparedColumn, magRange)) {
+            m_magRanges.push_back(magRange);
+        }
 
+        double fractionComplete = double(xPixelCount) / double(w);
+        if (timer.outOfTime(fractionComplete)) {
 #ifdef DEBUG_COLOUR_PLOT_REPAINT
-//        SVDEBUG << "x = " << x << ", binforx[x] = " << binforx[x] << ", sx range " << sx0 << " -> " << sx1 << endl;
+            SVDEBUG << "render " << m_sources.source
+                    << ": out of time with xPixelCount = " << xPixelCount << endl;
 #endif
+            updateTimings(timer, xPixelCount);
+            return xPixelCount;
+        }
+    }
 
-        ColumnOp::Column pixelPeakColumn;
-        MagnitudeRange magRange;
+    updateTimings(timer, xPixelCount);
+
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+    SVDEBUG << "render " << m_sources.source
+            << ": completed with xPixelCount = " << xPixelCount << endl;
+#endif
+    return xPixelCount;
+}
+
+bool
+Colour3DPlotRenderer::renderDrawBufferColumn(const DrawBufferColumnSpec &spec,
+                                             int x,
+                                             int &psx,
+                                             ColumnOp::Column &preparedColumn,
+                                             MagnitudeRange &magRange,
+                                             int worker) const
+{
+    // x is the on-canvas pixel coord; sx (later) will be the source
+    // column index
+
+    const vector<int> &binforx = *spec.binforx;
+    const int w = spec.w;
+    const int h = spec.h;
+
+    // Until we have some values, this column is left blank
+    if (spec.valueStates) {
+        spec.valueStates[x] = ScrollableValueCache::ColumnState::Blank;
+    }
+    
+    if (binforx[x] < 0) return false;
+
+    int sx0 = binforx[x] / spec.divisor;
+    int sx1 = sx0;
+    if (x+1 < w) sx1 = binforx[x+1] / spec.divisor;
+    if (sx0 < 0) sx0 = sx1 - 1;
+    if (sx0 < 0) return false;
+    if (sx1 <= sx0) sx1 = sx0 + 1;
+
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+//    SVDEBUG << "x = " << x << ", binforx[x] = " << binforx[x] << ", sx range " << sx0 << " -> " << sx1 << endl;
+#endif
+
+    // A worker with a source of its own reads from that, in place of
+    // the source or peak cache, taking the peak of the columns the
+    // peak cache would have combined
+    auto model = spec.sourceModel;
+    int columnsPerPeak = 1;
+    if (worker >= 0 && in_range_for(spec.workerModels, worker) &&
+        spec.workerModels[worker]) {
+        model = spec.workerModels[worker];
+        columnsPerPeak = spec.divisor;
+    } else {
+        worker = -1;
+    }
+    
+    int modelWidth = spec.sourceModel->getWidth();
+    
+    ColumnOp::Column pixelPeakColumn;
         
-        for (int sx = sx0; sx < sx1; ++sx) {
+    for (int sx = sx0; sx < sx1; ++sx) {
 
-            if (sx < 0 || sx >= modelWidth) {
-                continue;
-            }
+        if (sx < 0 || sx >= modelWidth) {
+            continue;
+        }
 
-            if (sx != psx) {
+        if (sx != psx) {
                 
-                // order:
-                // get column -> scale -> normalise -> record extents ->
-                // peak pick -> distribute/interpolate -> apply display gain
+            // order:
+            // get column -> scale -> normalise -> record extents ->
+            // peak pick -> distribute/interpolate -> apply display gain
 
-                // this does the first three:
-                ColumnOp::Column column = getColumn(sx, minbin, nbins,
-                                                    sourceModel);
+            // this does the first three:
+            ColumnOp::Column column = getColumn(sx, spec.minbin, spec.nbins,
+                                                model, worker, columnsPerPeak);
 
-                magRange.sample(column);
+            magRange.sample(column);
 
-                if (m_params.binDisplay == BinDisplay::PeakBins) {
-                    column = ColumnOp::peakPick(column);
-                }
+            if (m_params.binDisplay == BinDisplay::PeakBins) {
+                column = ColumnOp::peakPick(column);
+            }
 
-                preparedColumn =
-                    ColumnOp::distribute(column,
-                                         h,
-                                         binfory,
-                                         minbin,
-                                         m_params.interpolate);
+            preparedColumn =
+                ColumnOp::distribute(column,
+                                     h,
+                                     *spec.binfory,
+                                     spec.minbin,
+                                     m_params.interpolate);
 
-                // Display gain belongs to the colour scale and is
-                // applied by the colour scale object when mapping it
+            // Display gain belongs to the colour scale and is
+            // applied by the colour scale object when mapping it
                 
-                psx = sx;
-            }
+            psx = sx;
+        }
 
-            if (sx == sx0) {
-                pixelPeakColumn = preparedColumn;
-            } else {
-                for (int i = 0; in_range_for(pixelPeakColumn, i); ++i) {
-                    pixelPeakColumn[i] = std::max(pixelPeakColumn[i],
-                                                  preparedColumn[i]);
-                }
+        if (sx == sx0) {
+            pixelPeakColumn = preparedColumn;
+        } else {
+            for (int i = 0; in_range_for(pixelPeakColumn, i); ++i) {
+                pixelPeakColumn[i] = std::max(pixelPeakColumn[i],
+                                              preparedColumn[i]);
             }
         }
+    }
 
-        if (!pixelPeakColumn.empty()) {
+    if (pixelPeakColumn.empty()) {
+        return false;
+    }
 
-            for (int y = 0; y < h; ++y) {
-                int py;
-                if (m_params.invertVertical) {
-                    py = y;
-                } else {
-                    py = h - y - 1;
-                }
-                m_drawBuffer.setPixel
-                    (x,
-                     py,
-                     m_params.colourScale.getPixel(pixelPeakColumn[y]));
-            }
+    // Map the whole column at once, straight into the draw buffer
+    // scanlines: bin y goes to row h-y-1, or row y if inverted
+
+    int n = std::min(h, int(pixelPeakColumn.size()));
+    
+    if (m_params.invertVertical) {
+        m_params.colourScale.getPixels(pixelPeakColumn.data(), n,
+                                       spec.target + x,
+                                       spec.bytesPerLine);
+    } else {
+        m_params.colourScale.getPixels(pixelPeakColumn.data(), n,
+                                       spec.target +
+                                       ptrdiff_t(h - 1) * spec.bytesPerLine + x,
+                                       -ptrdiff_t(spec.bytesPerLine));
+    }
+
+    if (spec.values) {
+        if (n == h) {
+            std::copy(pixelPeakColumn.begin(), pixelPeakColumn.begin() + n,
+                      spec.values + size_t(x) * h);
+            spec.valueStates[x] = ScrollableValueCache::ColumnState::HasValues;
+        } else {
+            // part of the column is background, but not because of
+            // anything we can reproduce by mapping its values
+            spec.valueStates[x] = ScrollableValueCache::ColumnState::Unset;
+        }
+    }
+
+    return true;
+}
+
+int
+Colour3DPlotRenderer::renderDrawBufferParallel(const DrawBufferColumnSpec &spec,
+                                               bool rightToLeft,
+                                               int stripWidth,
+                                               RenderTimer &timer,
+                                               vector<MagnitudeRange> &columnRanges)
+    const
+{
+    Profiler profiler("Colour3DPlotRenderer::renderDrawBufferParallel");
+    
+    // The draw buffer is filled in a series of rounds. In each round
+    // we hand one strip of adjacent columns to each worker and wait
+    // for all of them. The timer is consulted between rounds only, so
+    // what we have rendered when we run out of time is always
+    // contiguous from the starting edge, just as it is when rendering
+    // serially. Magnitude ranges are recorded per x coordinate in
+    // columnRanges, which must already have at least spec.w elements.
+
+    const int w = spec.w;
+    const int threads = m_params.threadCount;
+
+    if (stripWidth < minimumStripWidth) {
+        stripWidth = minimumStripWidth;
+    }
+
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+    SVDEBUG << "render " << m_sources.source
+            << ": renderDrawBufferParallel: w = " << w << ", threads = "
+            << threads << ", stripWidth = " << stripWidth << endl;
+#endif
+
+    int xPixelCount = 0;
+
+    while (xPixelCount < w) {
+
+        if (spec.cancelled && *spec.cancelled) {
+            break;
+        }
+        
+        int roundWidth = std::min(w - xPixelCount, stripWidth * threads);
+        int nstrips = (roundWidth + stripWidth - 1) / stripWidth;
+
+        vector<std::function<void()>> tasks;
+        
+        for (int i = 0; i < nstrips; ++i) {
+
+            // a and b are offsets from the starting edge, in the
+            // order of rendering
+            int a = xPixelCount + i * stripWidth;
+            int b = std::min(a + stripWidth, xPixelCount + roundWidth);
             
-            m_magRanges.push_back(magRange);
+            MagnitudeRange *ranges = columnRanges.data();
+
+            // Each strip of a round reads from a worker source of its
+            // own, if there are enough of them
+            tasks.push_back([=, &spec]() {
+                int psx = -1;
+                ColumnOp::Column preparedColumn;
+                for (int j = a; j < b; ++j) {
+                    int x = (rightToLeft ? w - j - 1 : j);
+                    renderDrawBufferColumn(spec, x, psx,
+                                           preparedColumn, ranges[x], i);
+                }
+            });
         }
 
+        RenderThreadPool::runAndWait(tasks);
+
+        xPixelCount += roundWidth;
+        
         double fractionComplete = double(xPixelCount) / double(w);
         if (timer.outOfTime(fractionComplete)) {
 #ifdef DEBUG_COLOUR_PLOT_REPAINT
             SVDEBUG << "render " << m_sources.source
                     << ": out of time with xPixelCount = " << xPixelCount << endl;
 #endif
-            updateTimings(timer, xPixelCount);
-            return xPixelCount;
+            break;
         }
     }
 
-    updateTimings(timer, xPixelCount);
+    return xPixelCount;
+}
+
+Colour3DPlotRenderer::RenderResult
+Colour3DPlotRenderer::renderInBackground(const LayerGeometryProvider *v,
+                                         QPainter &paint, QRect rect,
+                                         std::function<void(QRect)> tileReady)
+{
+    RenderType renderType = decideRenderType(v);
+
+    if (renderType != DrawBufferPixelResolution ||
+        m_params.binDisplay == BinDisplay::PeakFrequencies) {
+        // Bin-resolution and translucent rendering are quick, as we
+        // are zoomed in a long way; peak-frequency rendering needs
+        // the LayerGeometryProvider throughout. These are done in the
+        // foreground as before.
+        cancelBackgroundTile();
+        return render(v, paint, rect, true);
+    }
+    
+    int x0 = v->getXForViewX(rect.x());
+    int x1 = v->getXForViewX(rect.x() + rect.width());
+    if (x0 < 0) x0 = 0;
+    if (x1 > v->getPaintWidth()) x1 = v->getPaintWidth();
+
+    sv_frame_t startFrame = v->getStartFrame();
+    
+    updateCacheGeometry(v);
+
+    m_cache.scrollTo(v, startFrame);
+    m_magCache.scrollTo(v, startFrame);
+    m_valueCache.scrollTo(v, startFrame);
+
+    collectBackgroundTile(v);
+
+    QRect pr = rect & m_cache.getValidArea();
+    m_cache.drawTo(paint, pr.x(), pr.y(), pr);
+
+    // Anything not yet rendered gets the background colour of the
+    // colour map as a placeholder
+    QColor placeholder = m_params.colourScale.getColourForPixel
+        (0, m_params.colourRotation);
+    if (pr.isEmpty()) {
+        paint.fillRect(rect, placeholder);
+    } else {
+        if (rect.left() < pr.left()) {
+            paint.fillRect(QRect(rect.left(), rect.top(),
+                                 pr.left() - rect.left(), rect.height()),
+                           placeholder);
+        }
+        if (rect.right() > pr.right()) {
+            paint.fillRect(QRect(pr.right() + 1, rect.top(),
+                                 rect.right() - pr.right(), rect.height()),
+                           placeholder);
+        }
+    }
+    paintFromZoomCache(v, paint, rect, pr);
+
+    if (!m_tile && m_cache.getValidWidth() < m_cache.getSize().width()) {
+
+        // Queue the next tile. Prefer the requested area; if that is
+        // all valid, carry on filling the rest of the cache
+        
+        int left = x0;
+        int width = x1 - x0;
+        
+        if (m_cache.isValid() &&
+            m_cache.getValidLeft() <= x0 && m_cache.getValidRight() >= x1) {
+            QRect uncached = getLargestUncachedRect(v);
+            left = uncached.x();
+            width = uncached.width();
+        }
+
+        bool isLeftOfValidArea = false;
+        if (m_cache.isValid()) {
+            m_cache.adjustToTouchValidArea(left, width, isLeftOfValidArea);
+        }
+
+        int tileWidth = getBackgroundTileWidth();
+        if (width > tileWidth) {
+            if (isLeftOfValidArea) {
+                left += width - tileWidth;
+            }
+            width = tileWidth;
+        }
+
+        if (width > 0) {
+            startBackgroundTile(v, left, width, tileReady);
+        }
+    }
+
+    MagnitudeRange range = m_magCache.getRange(x0, x1 - x0);
 
 #ifdef DEBUG_COLOUR_PLOT_REPAINT
     SVDEBUG << "render " << m_sources.source
-            << ": completed with xPixelCount = " << xPixelCount << endl;
+            << ": renderInBackground: painted " << pr.x() << "," << pr.y()
+            << " " << pr.width() << "x" << pr.height()
+            << ", tile pending = " << bool(m_tile) << endl;
 #endif
-    return xPixelCount;
+    
+    return { pr, range };
+}
+
+int
+Colour3DPlotRenderer::getBackgroundTileWidth() const
+{
+    // Aim for tiles that take about 50ms, so that something new
+    // appears at a steady rate; before we know how fast we are, use
+    // a modest fixed width
+    
+    if (!m_secondsPerXPixelValid || m_secondsPerXPixel <= 0.0) {
+        return 128;
+    }
+
+    int width = int(0.05 / m_secondsPerXPixel);
+    if (width < minimumStripWidth) width = minimumStripWidth;
+    return width;
+}
+
+void
+Colour3DPlotRenderer::startBackgroundTile(const LayerGeometryProvider *v,
+                                          int left, int width,
+                                          std::function<void(QRect)> tileReady)
+{
+    auto model = ModelById::getAs<DenseThreeDimensionalModel>(m_sources.source);
+    if (!model) return;
+
+    int h = v->getPaintHeight();
+
+    std::unique_ptr<BackgroundTile> tile(new BackgroundTile);
+    tile->startFrame = m_cache.getStartFrame();
+    tile->zoomLevel = m_cache.getZoomLevel();
+    tile->size = m_cache.getSize();
+    tile->left = left;
+    tile->width = width;
+    tile->ready = tileReady;
+    tile->secondsPerXPixel = 0.0;
+
+    int scale = v->getScaleFactor();
+    int viewLeft = v->getViewXForX(left);
+    int viewRight = v->getViewXForX(left + width + scale - 1);
+    tile->viewRect = QRect(viewLeft, 0, viewRight - viewLeft,
+                           (h + scale - 1) / scale);
+
+    // Everything that needs the LayerGeometryProvider is worked out
+    // here, on the calling thread
+    if (!getPixelResolutionBins(v, left, width, tile->binforx, tile->binfory)) {
+        return;
+    }
+    
+    int peakCacheIndex = -1, binsPerPeak = -1;
+    getPreferredPeakCache(v, peakCacheIndex, binsPerPeak);
+    
+    if (!prepareDrawBufferColumnSpec(width, h, tile->binforx, tile->binfory,
+                                     peakCacheIndex, tile->spec)) {
+        return;
+    }
+
+    tile->spec.cancelled = &m_tileCancelled;
+
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+    SVDEBUG << "render " << m_sources.source
+            << ": starting background tile at " << left
+            << " of width " << width << endl;
+#endif
+    
+    m_tileCancelled = false;
+    m_tileDone = false;
+    m_tile = std::move(tile);
+    m_tileThread = std::thread(&Colour3DPlotRenderer::renderBackgroundTile,
+                               this, m_tile.get());
+}
+
+void
+Colour3DPlotRenderer::renderBackgroundTile(BackgroundTile *tile)
+{
+    // This is the only function that runs on the background render
+    // thread. It must not touch the caches, the draw buffer, or any
+    // LayerGeometryProvider.
+    
+    RenderTimer timer(RenderTimer::NoTimeout);
+
+    DrawBufferColumnSpec &spec = tile->spec;
+    
+    tile->image = createDrawBufferImage(spec.w, spec.h);
+    spec.target = tile->image.bits();
+    spec.bytesPerLine = tile->image.bytesPerLine();
+
+    tile->ranges = vector<MagnitudeRange>(spec.w);
+
+    tile->values.resize(size_t(spec.w) * spec.h);
+    tile->valueStates = vector<ScrollableValueCache::ColumnState>
+        (spec.w, ScrollableValueCache::ColumnState::Unset);
+    spec.values = tile->values.data();
+    spec.valueStates = tile->valueStates.data();
+    
+    int xPixelCount = 0;
+    int threads = m_params.threadCount;
+    
+    if (threads > 1 && spec.w >= threads * minimumStripWidth) {
+
+        // a few rounds, so as to notice cancellation promptly
+        int stripWidth = (spec.w + threads * 4 - 1) / (threads * 4);
+        xPixelCount = renderDrawBufferParallel
+            (spec, false, stripWidth, timer, tile->ranges);
+
+    } else {
+        
+        int psx = -1;
+        ColumnOp::Column preparedColumn;
+
+        for (int x = 0; x < spec.w; ++x) {
+            if (m_tileCancelled) break;
+            renderDrawBufferColumn(spec, x, psx, preparedColumn,
+                                   tile->ranges[x]);
+            ++xPixelCount;
+        }
+    }
+    
+    tile->secondsPerXPixel = timer.secondsPerItem(xPixelCount);
+
+    bool cancelled = m_tileCancelled;
+    m_tileDone = true;
+    
+    if (!cancelled && tile->ready) {
+        tile->ready(tile->viewRect);
+    }
+}
+
+void
+Colour3DPlotRenderer::collectBackgroundTile(const LayerGeometryProvider *v)
+{
+    if (!m_tile || !m_tileDone) {
+        return;
+    }
+
+    m_tileThread.join();
+    std::unique_ptr<BackgroundTile> tile(std::move(m_tile));
+
+    if (tile->zoomLevel != m_cache.getZoomLevel() ||
+        tile->size != m_cache.getSize()) {
+#ifdef DEBUG_COLOUR_PLOT_REPAINT
+        SVDEBUG << "render " << m_sources.source
+                << ": discarding background tile for outdated geometry"
+                << endl;
+#endif
+        return;
+    }
+
+    updateTimings(tile->secondsPerXPixel, tile->width);
+    
+    // The view may have scrolled since the tile was started
+    int dx = v->getXForFrame(tile->startFrame) -
+        v->getXForFrame(m_cache.getStartFrame());
+
+    int left = tile->left + dx;
+    int imageLeft = 0;
+    int width = tile->width;
+    
+    if (left < 0) {
+        imageLeft = -left;
+        width += left;
+        left = 0;
+    }
+    if (left + width > m_cache.getSize().width()) {
+        width = m_cache.getSize().width() - left;
+    }
+    if (width <= 0) {
+        return;
+    }
+
+    if (m_cache.isValid() &&
+        (left > m_cache.getValidRight() ||
+         left + width < m_cache.getValidLeft())) {
+        // No longer adjacent to the valid area, and we don't want it
+        // to replace that
+        return;
+    }
+
+    m_cache.drawImage(left, width, tile->image, imageLeft, width);
+    m_valueCache.drawColumns(left, width, tile->image, imageLeft,
+                             tile->values.data(), tile->valueStates.data());
+
+    for (int i = 0; i < width; ++i) {
+        const MagnitudeRange &r = tile->ranges[imageLeft + i];
+        if (r.isSet()) {
+            m_magCache.sampleColumn(left + i, r);
+        }
+    }
+}
+
+void
+Colour3DPlotRenderer::cancelBackgroundTile()
+{
+    if (!m_tile) {
+        return;
+    }
+
+    m_tileCancelled = true;
+    m_tileThread.join();
+    m_tile.reset();
+    m_tileCancelled = false;
+    m_tileDone = false;
 }
 
 int
@@ -1446,8 +2310,12 @@ Colour3DPlotRenderer::renderDrawBufferPeakFrequencies(const LayerGeometryProvide
 void
 Colour3DPlotRenderer::updateTimings(const RenderTimer &timer, int xPixelCount)
 {
-    double secondsPerXPixel = timer.secondsPerItem(xPixelCount);
+    updateTimings(timer.secondsPerItem(xPixelCount), xPixelCount);
+}
 
+void
+Colour3DPlotRenderer::updateTimings(double secondsPerXPixel, int xPixelCount)
+{
     // valid if we have enough data points, or if the overall time is
     // massively slow anyway (as we definitely need to warn about that)
     bool valid = (xPixelCount > 20 || secondsPerXPixel > 0.01);
@@ -1466,19 +2334,32 @@ Colour3DPlotRenderer::updateTimings(const RenderTimer &timer, int xPixelCount)
     }
 }
 
-void
-Colour3DPlotRenderer::recreateDrawBuffer(int w, int h)
+QVector<QRgb>
+Colour3DPlotRenderer::getColourTable() const
 {
-    m_drawBuffer = QImage(w, h, QImage::Format_Indexed8);
+    QVector<QRgb> table(256);
 
     for (int pixel = 0; pixel < 256; ++pixel) {
-        m_drawBuffer.setColor
-            ((unsigned char)pixel,
-             m_params.colourScale.getColourForPixel
-             (pixel, m_params.colourRotation).rgb());
+        table[pixel] = m_params.colourScale.getColourForPixel
+            (pixel, m_params.colourRotation).rgb();
     }
 
-    m_drawBuffer.fill(0);
+    return table;
+}
+
+QImage
+Colour3DPlotRenderer::createDrawBufferImage(int w, int h) const
+{
+    QImage image(w, h, QImage::Format_Indexed8);
+    image.setColorTable(getColourTable());
+    image.fill(0);
+    return image;
+}
+
+void
+Colour3DPlotRenderer::recreateDrawBuffer(int w, int h)
+{
+    m_drawBuffer = createDrawBufferImage(w, h);
     m_magRanges.clear();
 }
 
@@ -19,6 +19,8 @@
 #include "ColourScale.h"
 #include "ScrollableImageCache.h"
 #include "ScrollableMagRangeCache.h"
+#include "ScrollableValueCache.h"
+#include "ImageTilePyramid.h"
 
 #include "base/ColumnOp.h"
 #include "base/MagnitudeRange.h"
@@ -28,6 +30,13 @@
 #include <QRect>
 #include <QPainter>
 #include <QImage>
+#include <QMutex>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
 
 class LayerGeometryProvider;
 class VerticalBinLayer;
@@ -57,6 +66,26 @@ public:
         ModelId source; // always; a DenseThreeDimensionalModel
         ModelId fft; // optionally; an FFTModel; used for phase/peak-freq modes
         std::vector<ModelId> peakCaches; // zero or more
+
+        // Optional; held for every read from the models above. If
+        // several renderers share the same models and any of them
+        // may render in the background, they must share this lock
+        // too. If not supplied, each renderer makes its own.
+        std::shared_ptr<QMutex> sourceLock;
+
+        // Optional; models equivalent to source but each with state
+        // of its own (e.g. separate FFTModels of the same input),
+        // one for each worker when rendering in parallel, so that
+        // the workers can read their columns concurrently. Workers
+        // read these in place of source and of the peak caches, which
+        // must be caches of source. Each has its own lock, which
+        // renderers sharing the model must also share. If source is
+        // also fft, these must be FFTModels.
+        struct WorkerSource {
+            ModelId model;
+            std::shared_ptr<QMutex> lock;
+        };
+        std::vector<WorkerSource> workerSources;
     };        
 
     struct Parameters {
@@ -70,7 +99,9 @@ public:
             invertVertical(false),
             showDerivative(false),
             scaleFactor(1.0),
-            colourRotation(0) { }
+            colourRotation(0),
+            threadCount(1),
+            zoomCacheBudget(32 * 1024 * 1024) { }
 
         /** A complete ColourScale object by value, used for colour
          *  map conversion. Note that the final display gain setting is
@@ -114,14 +145,40 @@ public:
 
         /** Colourmap rotation, in the range 0-255. */
         int colourRotation;
+
+        /** Number of threads to use when filling the draw buffer at
+         *  pixel resolution. With more than one, the buffer is split
+         *  into column strips which are rendered concurrently; reads
+         *  from the source models are still serialised. The default
+         *  of 1 renders everything on the calling thread. */
+        int threadCount;
+
+        /** Memory, in bytes, to use for keeping what was rendered at
+         *  previous zoom levels. Returning to one of those levels
+         *  reuses it, and the nearest one is rescaled to fill in for
+         *  anything not yet rendered during a time-constrained
+         *  render. Zero disables this. */
+        size_t zoomCacheBudget;
     };
     
     Colour3DPlotRenderer(Sources sources, Parameters parameters) :
         m_sources(sources),
         m_params(parameters),
         m_secondsPerXPixel(0.0),
-        m_secondsPerXPixelValid(false)
-    { }
+        m_secondsPerXPixelValid(false),
+        m_tileDone(false),
+        m_tileCancelled(false)
+    {
+        if (!m_sources.sourceLock) {
+            m_sources.sourceLock = std::make_shared<QMutex>();
+        }
+        m_zoomCache.setMemoryBudget(m_params.zoomCacheBudget);
+    }
+
+    ~Colour3DPlotRenderer();
+
+    Colour3DPlotRenderer(const Colour3DPlotRenderer &) = delete;
+    Colour3DPlotRenderer &operator=(const Colour3DPlotRenderer &) = delete;
 
     struct RenderResult {
         /**
@@ -198,6 +255,44 @@ public:
     RenderResult renderTimeConstrained(const LayerGeometryProvider *v,
                                        QPainter &paint, QRect rect);
 
+    /**
+     * Render the requested area using the given painter, obtaining
+     * geometry (e.g. start frame) from the stored
+     * LayerGeometryProvider, without doing any of the expensive work
+     * on the calling thread.
+     *
+     * Only what is already in the cache is painted; the rest of the
+     * requested rect is filled with a placeholder. If the cache is
+     * incomplete, a tile adjacent to its valid area is rendered on a
+     * background thread, and tileReady is called from that thread
+     * when it is finished, with the area of the view that the tile
+     * covers, in view (not scaled) coordinates. The caller should
+     * respond by arranging for that area to be painted again (on
+     * its own thread), which will pick up the finished tile and
+     * start the next one. The returned rect is the
+     * part of the requested rect that was painted from cache.
+     *
+     * Render types that are fast, or that need the
+     * LayerGeometryProvider while rendering (bin resolution, direct
+     * translucent, and peak frequencies) are rendered as if by
+     * renderTimeConstrained instead.
+     *
+     * The same conditions as for render() apply to the model and
+     * LayerGeometryProvider.
+     */
+    RenderResult renderInBackground(const LayerGeometryProvider *v,
+                                    QPainter &paint, QRect rect,
+                                    std::function<void(QRect)> tileReady);
+
+    /**
+     * Return true if a tile is currently being rendered (or has been
+     * rendered and not yet collected) by a previous call to
+     * renderInBackground.
+     */
+    bool isRenderingInBackground() const {
+        return bool(m_tile);
+    }
+
     /**
      * Return the area of the largest rectangle within the entire area
      * of the cache that is unavailable in the cache. This is only
@@ -220,6 +315,22 @@ public:
      */
     bool geometryChanged(const LayerGeometryProvider *v);
     
+    enum RenderType {
+        DrawBufferPixelResolution,
+        DrawBufferBinResolution,
+        DirectTranslucent
+    };
+
+    /**
+     * Return the type of rendering that the next render call would
+     * use for the given LayerGeometryProvider. This depends on the
+     * parameters, the model, and the zoom level and height of the
+     * provider.
+     */
+    RenderType getRenderType(const LayerGeometryProvider *v) const {
+        return decideRenderType(v);
+    }
+    
     /**
      * Return true if the rendering will be opaque. This may be used
      * by the calling layer to determine whether it can scroll
@@ -229,6 +340,31 @@ public:
         return decideRenderType(v) != DirectTranslucent;
     }
     
+    /**
+     * Replace the colour scale and colour rotation used for
+     * rendering, keeping as much of the cache as possible.
+     *
+     * Where the cache was rendered at pixel resolution, the values
+     * behind it are retained, so it can be recoloured without going
+     * back to the source models: if the new scale differs only in
+     * colour map (or the rotation has changed), only the colour table
+     * is replaced; if its gain, threshold or range differ, the
+     * retained values are mapped again. Anything that cannot be
+     * recoloured is invalidated and will be re-rendered from source
+     * on the next render call.
+     *
+     * Any background tile in progress is cancelled.
+     */
+    void setColourScale(ColourScale colourScale, int colourRotation);
+
+    /**
+     * Discard anything cached for the given range of source frames,
+     * for example because the source model has changed there, so
+     * that it is rendered again from the models on the next render
+     * call. The rest of the cache is retained where possible.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
+    
     /**
      * Return the colour corresponding to the given value.
      * \see ColourScale::getPixel
@@ -279,6 +415,25 @@ private:
     // versa (as the image cache is limited to contiguous ranges).
     ScrollableMagRangeCache m_magCache;
 
+    // The value cache records the values behind each column of the
+    // image cache that was rendered at pixel resolution, so that the
+    // image can be recoloured when only the colour scale changes. It
+    // always has the same size, start frame and zoom level as the
+    // image cache. Columns of the image cache rendered any other way
+    // are unset in the value cache.
+    ScrollableValueCache m_valueCache;
+
+    // Values and column states for the draw buffer, when rendering
+    // to it at pixel resolution; laid out as for DrawBufferColumnSpec
+    std::vector<float> m_drawBufferValues;
+    std::vector<ScrollableValueCache::ColumnState> m_drawBufferStates;
+
+    // The zoom cache keeps the contents of the image cache from
+    // previous zoom levels (or sizes), in tiles, within the budget
+    // given in the parameters. It is filled when the image cache is
+    // about to be discarded because of a geometry change.
+    ImageTilePyramid m_zoomCache;
+
     double m_secondsPerXPixel;
     bool m_secondsPerXPixelValid;
 
@@ -289,6 +444,12 @@ private:
     RenderResult render(const LayerGeometryProvider *v,
                         QPainter &paint, QRect rect, bool timeConstrained);
 
+    void updateCacheGeometry(const LayerGeometryProvider *v);
+    void storeInZoomCache();
+    void restoreFromZoomCache(const LayerGeometryProvider *v);
+    void paintFromZoomCache(const LayerGeometryProvider *v,
+                            QPainter &paint, QRect rect, QRect covered);
+
     MagnitudeRange renderDirectTranslucent(const LayerGeometryProvider *v,
                                            QPainter &paint, QRect rect);
     
@@ -304,8 +465,87 @@ private:
                          const std::vector<double> &binfory,
                          int peakCacheIndex, // -1 => don't use a peak cache
                          bool rightToLeft,
-                         bool timeConstrained);
+                         bool timeConstrained,
+                         bool keepValues);
+
+    // Everything needed to render a single column into a draw
+    // buffer, shared read-only between render threads
+    struct DrawBufferColumnSpec {
+        int w;
+        int h;
+        const std::vector<int> *binforx;
+        const std::vector<double> *binfory;
+        int minbin;
+        int nbins;
+        int divisor;
+        std::shared_ptr<DenseThreeDimensionalModel> sourceModel;
+        // from Sources::workerSources, one per parallel worker
+        std::vector<std::shared_ptr<DenseThreeDimensionalModel>> workerModels;
+        uchar *target;
+        int bytesPerLine;
+        float *values; // or nullptr; h values per column, column-major
+        ScrollableValueCache::ColumnState *valueStates; // with values
+        const std::atomic<bool> *cancelled; // or nullptr
+    };
+
+    // Narrowest strip of columns worth handing to a render thread
+    static const int minimumStripWidth = 16;
 
+    bool prepareDrawBufferColumnSpec(int w, int h,
+                                     const std::vector<int> &binforx,
+                                     const std::vector<double> &binfory,
+                                     int peakCacheIndex,
+                                     DrawBufferColumnSpec &spec) const;
+    
+    // worker is the index of the parallel worker calling, if any,
+    // for reading from its own worker source
+    bool renderDrawBufferColumn(const DrawBufferColumnSpec &spec, int x,
+                                int &psx, ColumnOp::Column &preparedColumn,
+                                MagnitudeRange &magRange,
+                                int worker = -1) const;
+
+    int renderDrawBufferParallel(const DrawBufferColumnSpec &spec,
+                                 bool rightToLeft,
+                                 int stripWidth,
+                                 RenderTimer &timer,
+                                 std::vector<MagnitudeRange> &columnRanges)
+        const;
+
+    // A tile of the cache being rendered on the background thread.
+    // The geometry fields record the state of the cache when the
+    // tile was started, so that it can be placed correctly (or
+    // discarded) when collected.
+    struct BackgroundTile {
+        sv_frame_t startFrame;
+        ZoomLevel zoomLevel;
+        QSize size;
+        int left;
+        int width;
+        std::vector<int> binforx;
+        std::vector<double> binfory;
+        DrawBufferColumnSpec spec;
+        QRect viewRect; // for ready, in view coordinates
+        std::function<void(QRect)> ready;
+        QImage image;
+        std::vector<MagnitudeRange> ranges; // per column of image
+        std::vector<float> values; // as in DrawBufferColumnSpec
+        std::vector<ScrollableValueCache::ColumnState> valueStates;
+        double secondsPerXPixel;
+    };
+
+    std::unique_ptr<BackgroundTile> m_tile;
+    std::thread m_tileThread;
+    std::atomic<bool> m_tileDone;
+    std::atomic<bool> m_tileCancelled;
+
+    int getBackgroundTileWidth() const;
+    void startBackgroundTile(const LayerGeometryProvider *v,
+                             int left, int width,
+                             std::function<void(QRect)> tileReady);
+    void renderBackgroundTile(BackgroundTile *tile);
+    void collectBackgroundTile(const LayerGeometryProvider *v);
+    void cancelBackgroundTile();
+    
     int renderDrawBufferPeakFrequencies(const LayerGeometryProvider *v,
                                         int w, int h,
                                         const std::vector<int> &binforx,
@@ -313,29 +553,38 @@ private:
                                         bool rightToLeft,
                                         bool timeConstrained);
     
+    bool getPixelResolutionBins(const LayerGeometryProvider *v,
+                                int x0, int width,
+                                std::vector<int> &binforx,
+                                std::vector<double> &binfory) const;
+    
+    QVector<QRgb> getColourTable() const;
+    QImage createDrawBufferImage(int w, int h) const;
     void recreateDrawBuffer(int w, int h);
     void clearDrawBuffer(int w, int h);
 
-    enum RenderType {
-        DrawBufferPixelResolution,
-        DrawBufferBinResolution,
-        DirectTranslucent
-    };
-
     RenderType decideRenderType(const LayerGeometryProvider *) const;
 
     QImage scaleDrawBufferImage(QImage source, int targetWidth, int targetHeight)
         const;
     
+    // If worker is not negative, source is that worker's own model
+    // from Sources::workerSources, and is read under its lock rather
+    // than the shared source lock. If columnsPerPeak is greater than
+    // 1, column sx is the peak of that many columns of source, as a
+    // peak cache with that divisor would return it
     ColumnOp::Column getColumn(int sx, int minbin, int nbins,
-                               std::shared_ptr<DenseThreeDimensionalModel> source) const;
+                               std::shared_ptr<DenseThreeDimensionalModel> source,
+                               int worker = -1, int columnsPerPeak = 1) const;
     ColumnOp::Column getColumnRaw(int sx, int minbin, int nbins,
-                                  std::shared_ptr<DenseThreeDimensionalModel> source) const;
+                                  std::shared_ptr<DenseThreeDimensionalModel> source,
+                                  int worker, int columnsPerPeak) const;
 
     void getPreferredPeakCache(const LayerGeometryProvider *,
                                int &peakCacheIndex, int &binsPerPeak) const;
 
     void updateTimings(const RenderTimer &timer, int xPixelCount);
+    void updateTimings(double secondsPerXPixel, int xPixelCount);
 };
 
 #endif
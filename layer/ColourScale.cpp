@@ -19,7 +19,14 @@
 #include "base/LogRange.h"
 
 #include <cmath>
+#include <cstring>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -27,7 +34,8 @@ int ColourScale::m_maxPixel = 255;
 
 ColourScale::ColourScale(Parameters parameters) :
     m_params(parameters),
-    m_mapper(m_params.colourMap, m_params.inverted, 1.f, double(m_maxPixel))
+    m_mapper(m_params.colourMap, m_params.inverted, 1.f, double(m_maxPixel)),
+    m_havePixelBounds(false)
 {
     if (m_params.minValue >= m_params.maxValue) {
         SVCERR << "ERROR: ColourScale::ColourScale: minValue = "
@@ -86,6 +94,15 @@ ColourScale::ColourScale(Parameters parameters) :
              << ", mapped maxValue = " << m_mappedMax << endl;
         throw std::logic_error("maxValue must be greater than minValue [after mapping]");
     }
+
+    // The bounds table relies on getPixel being non-decreasing across
+    // positive values, which is so for these scales as long as the
+    // gain and multiple are positive
+    if ((m_params.scaleType == ColourScaleType::Log ||
+         m_params.scaleType == ColourScaleType::Meter) &&
+        m_params.gain > 0.0 && m_params.multiple > 0.0) {
+        buildPixelBounds();
+    }
 }
 
 ColourScale::~ColourScale()
@@ -98,6 +115,17 @@ ColourScale::getScale() const
     return m_params.scaleType;
 }
 
+bool
+ColourScale::hasSameMapping(const ColourScale &other) const
+{
+    return (m_params.scaleType == other.m_params.scaleType &&
+            m_params.minValue == other.m_params.minValue &&
+            m_params.maxValue == other.m_params.maxValue &&
+            m_params.threshold == other.m_params.threshold &&
+            m_params.gain == other.m_params.gain &&
+            m_params.multiple == other.m_params.multiple);
+}
+
 int
 ColourScale::getPixel(double value) const
 {
@@ -154,6 +182,161 @@ ColourScale::getPixel(double value) const
     return pixel;
 }
 
+static float
+floatFromBits(uint32_t bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+void
+ColourScale::buildPixelBounds()
+{
+    // Positive floats are ordered in the same way as their bit
+    // patterns, so we can find each boundary exactly by bisecting on
+    // those. Each boundary is no lower than the previous one.
+    
+    const uint32_t infBits = 0x7f800000u;
+    
+    uint32_t lo = 1;
+
+    for (int p = 1; p <= m_maxPixel; ++p) {
+        uint32_t hi = infBits;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (getPixel(double(floatFromBits(mid))) >= p) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        m_pixelBounds[p-1] = floatFromBits(lo); // infinity if unreachable
+    }
+
+    m_pixelBounds[255] = std::numeric_limits<float>::infinity();
+    m_havePixelBounds = true;
+}
+
+void
+ColourScale::getPixels(const float *values, int n,
+                       unsigned char *pixels, ptrdiff_t stride) const
+{
+    if (m_params.scaleType == ColourScaleType::Linear) {
+        getPixelsLinear(values, n, pixels, stride);
+    } else if (m_havePixelBounds) {
+        getPixelsFromBounds(values, n, pixels, stride);
+    } else {
+        for (int i = 0; i < n; ++i) {
+            pixels[i * stride] = (unsigned char)getPixel(values[i]);
+        }
+    }
+}
+
+void
+ColourScale::getPixelsLinear(const float *values, int n,
+                             unsigned char *pixels, ptrdiff_t stride) const
+{
+    // This follows the arithmetic in getPixel exactly, in double
+    // precision, so that results are identical
+    
+    const double maxPixF = m_maxPixel;
+    const double gain = m_params.gain;
+    const double threshold = m_params.threshold;
+    const double multiple = m_params.multiple;
+    const double mappedMin = m_mappedMin;
+    const double mappedMax = m_mappedMax;
+    const double mappedRange = m_mappedMax - m_mappedMin;
+    
+    int i = 0;
+
+#if defined(__SSE2__)
+
+    const __m128d vgain = _mm_set1_pd(gain);
+    const __m128d vthresh = _mm_set1_pd(threshold);
+    const __m128d vmult = _mm_set1_pd(multiple);
+    const __m128d vmin = _mm_set1_pd(mappedMin);
+    const __m128d vmax = _mm_set1_pd(mappedMax);
+    const __m128d vrange = _mm_set1_pd(mappedRange);
+    const __m128d vmaxpix = _mm_set1_pd(maxPixF);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i top = _mm_set1_epi16(short(m_maxPixel));
+
+    // Map two values, already widened to double, to pixels in the
+    // low two 32-bit lanes of the result
+    auto map2 = [&](__m128d v) {
+        v = _mm_mul_pd(v, vgain);
+        // below threshold, or NaN: both give pixel 0 in getPixel
+        __m128d keep = _mm_cmpge_pd(v, vthresh);
+        __m128d mapped = _mm_mul_pd(v, vmult);
+        mapped = _mm_min_pd(_mm_max_pd(mapped, vmin), vmax);
+        __m128d proportion = _mm_div_pd(_mm_sub_pd(mapped, vmin), vrange);
+        __m128i pixel = _mm_add_epi32
+            (_mm_cvttpd_epi32(_mm_mul_pd(proportion, vmaxpix)), one);
+        // narrow the 64-bit lane mask to the two 32-bit pixel lanes
+        __m128i mask = _mm_shuffle_epi32(_mm_castpd_si128(keep),
+                                         _MM_SHUFFLE(3, 3, 2, 0));
+        return _mm_and_si128(pixel, mask);
+    };
+
+    for (; i + 8 <= n; i += 8) {
+        __m128 f0 = _mm_loadu_ps(values + i);
+        __m128 f1 = _mm_loadu_ps(values + i + 4);
+        __m128i p0 = _mm_unpacklo_epi64
+            (map2(_mm_cvtps_pd(f0)),
+             map2(_mm_cvtps_pd(_mm_movehl_ps(f0, f0))));
+        __m128i p1 = _mm_unpacklo_epi64
+            (map2(_mm_cvtps_pd(f1)),
+             map2(_mm_cvtps_pd(_mm_movehl_ps(f1, f1))));
+        // Saturating packs clamp below at 0; above, clamp to the top
+        // pixel while still in 16 bits
+        __m128i p16 = _mm_min_epi16(_mm_packs_epi32(p0, p1), top);
+        __m128i p8 = _mm_packus_epi16(p16, p16);
+        if (stride == 1) {
+            _mm_storel_epi64((__m128i *)(pixels + i), p8);
+        } else {
+            unsigned char out[8];
+            _mm_storel_epi64((__m128i *)out, p8);
+            for (int j = 0; j < 8; ++j) {
+                pixels[(i + j) * stride] = out[j];
+            }
+        }
+    }
+    
+#endif
+
+    for (; i < n; ++i) {
+        pixels[i * stride] = (unsigned char)getPixel(values[i]);
+    }
+}
+
+void
+ColourScale::getPixelsFromBounds(const float *values, int n,
+                                 unsigned char *pixels, ptrdiff_t stride) const
+{
+    // The pixel for a positive finite value is the number of bounds
+    // at or below it, which we find by branch-free binary search
+    // over the 256-element table. Zero, negative and non-finite
+    // values go through getPixel.
+
+    const float inf = std::numeric_limits<float>::infinity();
+    
+    for (int i = 0; i < n; ++i) {
+        float v = values[i];
+        if (v > 0.f && v < inf) {
+            int index = 0;
+            for (int step = 128; step > 0; step >>= 1) {
+                if (m_pixelBounds[index + step - 1] <= v) {
+                    index += step;
+                }
+            }
+            pixels[i * stride] = (unsigned char)index;
+        } else {
+            pixels[i * stride] = (unsigned char)getPixel(v);
+        }
+    }
+}
+
 QColor
 ColourScale::getColourForPixel(int pixel, int rotation) const
 {
@@ -18,6 +18,8 @@
 
 #include "ColourMapper.h"
 
+#include <cstddef>
+
 enum class ColourScaleType {
     Linear,
     Meter,
@@ -88,6 +90,13 @@ public:
      */
     ColourScaleType getScale() const;
     
+    /**
+     * Return true if this scale maps every value to the same pixel
+     * number as the other one does, i.e. if the two differ at most
+     * in colour map and inversion.
+     */
+    bool hasSameMapping(const ColourScale &other) const;
+    
     /**
      * Return a pixel number (in the range 0-255 inclusive)
      * corresponding to the given value.  The pixel 0 is used only for
@@ -96,6 +105,17 @@ public:
      */
     int getPixel(double value) const;
 
+    /**
+     * Map a series of values to pixel numbers, with results identical
+     * to calling getPixel on each value in turn. The n results are
+     * written to pixels[0], pixels[stride], pixels[2 * stride] and
+     * so on; the stride may be negative, so that a column can be
+     * written bottom-up straight into the scanlines of an 8-bit
+     * indexed image.
+     */
+    void getPixels(const float *values, int n,
+                   unsigned char *pixels, ptrdiff_t stride = 1) const;
+
     /**
      * Return the colour for the given pixel number (which must be in
      * the range 0-255). The pixel 0 is always the background
@@ -118,6 +138,20 @@ private:
     double m_mappedMin;
     double m_mappedMax;
     static int m_maxPixel;
+
+    // For scales whose mapping cannot cheaply be done in bulk (log
+    // and meter), m_pixelBounds[p-1] holds the smallest positive
+    // float that getPixel maps to p or above, so that any positive
+    // finite value can be mapped by binary search. The final element
+    // is padding and is never read.
+    bool m_havePixelBounds;
+    float m_pixelBounds[256];
+
+    void buildPixelBounds();
+    void getPixelsLinear(const float *values, int n,
+                         unsigned char *pixels, ptrdiff_t stride) const;
+    void getPixelsFromBounds(const float *values, int n,
+                             unsigned char *pixels, ptrdiff_t stride) const;
 };
 
 #endif
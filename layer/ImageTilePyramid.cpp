@@ -0,0 +1,247 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ImageTilePyramid.h"
+
+#include "base/HitCount.h"
+#include "base/Debug.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+//#define DEBUG_IMAGE_TILE_PYRAMID 1
+
+static int64_t
+floorDiv(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0))) --q;
+    return q;
+}
+
+void
+ImageTilePyramid::setMemoryBudget(size_t bytes)
+{
+    m_budget = bytes;
+    evict();
+}
+
+void
+ImageTilePyramid::clear()
+{
+    m_entries.clear();
+    m_used = 0;
+}
+
+void
+ImageTilePyramid::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+    auto i = m_entries.begin();
+    while (i != m_entries.end()) {
+        // a column's margin either side, as for the scrollable caches
+        sv_frame_t margin = i->tile.zoomLevel.level;
+        if (i->tile.startFrame < to + margin &&
+            i->tile.getEndFrame() > from - margin) {
+            m_used -= getBytes(i->tile);
+            i = m_entries.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+size_t
+ImageTilePyramid::getBytes(const Tile &tile)
+{
+    return size_t(tile.image.bytesPerLine()) * size_t(tile.image.height()) +
+        tile.ranges.size() * sizeof(MagnitudeRange);
+}
+
+void
+ImageTilePyramid::store(ZoomLevel zoom,
+                        sv_frame_t startFrame,
+                        const QImage &image,
+                        int left,
+                        int width,
+                        const vector<MagnitudeRange> &ranges)
+{
+    if (m_budget == 0 || width <= 0) {
+        return;
+    }
+    if (zoom.zone != ZoomLevel::FramesPerPixel) {
+        return;
+    }
+    if (left < 0 || left + width > image.width()) {
+        SVCERR << "ImageTilePyramid::store: ERROR: Source area (left = "
+               << left << ", width = " << width << ") out of bounds for "
+               << "image of width " << image.width() << endl;
+        throw std::logic_error("Source area out of bounds in ImageTilePyramid::store");
+    }
+
+    sv_frame_t level = zoom.level;
+    int height = image.height();
+
+    if (startFrame % level != 0) {
+        SVCERR << "ImageTilePyramid::store: ERROR: Start frame " << startFrame
+               << " is not on a pixel boundary at zoom level " << zoom << endl;
+        throw std::logic_error("Start frame not on pixel boundary in ImageTilePyramid::store");
+    }
+
+    // Absolute column number (in the grid for this zoom level) of
+    // image column 0
+    int64_t base = startFrame / level;
+
+    int x = left;
+    while (x < left + width) {
+
+        int64_t index = floorDiv(base + x, tileWidth);
+        int64_t tileLeftColumn = index * tileWidth;
+
+        int tileEnd = int(tileLeftColumn + tileWidth - base);
+        if (tileEnd > left + width) tileEnd = left + width;
+        int w = tileEnd - x;
+
+        auto existing = find_if(m_entries.begin(), m_entries.end(),
+                                [&](const Entry &e) {
+                                    return e.tile.zoomLevel == zoom &&
+                                        e.tile.image.height() == height &&
+                                        e.index == index;
+                                });
+
+        if (existing != m_entries.end() &&
+            existing->tile.image.width() > w) {
+            // keep the wider one we already have
+            existing->lastUsed = ++m_clock;
+            x = tileEnd;
+            continue;
+        }
+
+        Tile tile;
+        tile.zoomLevel = zoom;
+        tile.startFrame = (base + x) * level;
+        tile.image = image.copy(x, 0, w, height);
+        if (int(ranges.size()) >= tileEnd) {
+            tile.ranges = vector<MagnitudeRange>(ranges.begin() + x,
+                                                 ranges.begin() + tileEnd);
+        } else {
+            tile.ranges = vector<MagnitudeRange>(w);
+        }
+
+        if (existing != m_entries.end()) {
+            m_used -= getBytes(existing->tile);
+            m_entries.erase(existing);
+        }
+
+        m_used += getBytes(tile);
+        m_entries.push_back({ tile, index, ++m_clock });
+
+#ifdef DEBUG_IMAGE_TILE_PYRAMID
+        SVDEBUG << "ImageTilePyramid::store: stored tile " << index
+                << " at zoom " << zoom << " from frame " << tile.startFrame
+                << " with width " << w << ", now using " << m_used
+                << " of " << m_budget << " bytes" << endl;
+#endif
+
+        x = tileEnd;
+    }
+
+    evict();
+}
+
+vector<ImageTilePyramid::Tile>
+ImageTilePyramid::getTiles(ZoomLevel zoom, int height,
+                           sv_frame_t f0, sv_frame_t f1)
+{
+    static HitCount count("ImageTilePyramid: tiles at zoom level");
+
+    vector<Entry *> found;
+
+    for (auto &e: m_entries) {
+        if (e.tile.zoomLevel == zoom &&
+            e.tile.image.height() == height &&
+            e.tile.startFrame < f1 &&
+            e.tile.getEndFrame() > f0) {
+            found.push_back(&e);
+        }
+    }
+
+    if (found.empty()) {
+        count.miss();
+        return {};
+    }
+    count.hit();
+
+    sort(found.begin(), found.end(),
+         [](const Entry *a, const Entry *b) {
+             return a->tile.startFrame < b->tile.startFrame;
+         });
+
+    vector<Tile> tiles;
+    for (auto e: found) {
+        e->lastUsed = ++m_clock;
+        tiles.push_back(e->tile);
+    }
+    return tiles;
+}
+
+bool
+ImageTilePyramid::getNearestZoomLevel(ZoomLevel zoom, int height,
+                                      sv_frame_t f0, sv_frame_t f1,
+                                      ZoomLevel &nearest) const
+{
+    double target = log(zoom.pixelsToFrames(1.0));
+    double bestDistance = 0.0;
+    bool found = false;
+
+    for (const auto &e: m_entries) {
+        if (e.tile.zoomLevel == zoom ||
+            e.tile.image.height() != height ||
+            e.tile.startFrame >= f1 ||
+            e.tile.getEndFrame() <= f0) {
+            continue;
+        }
+        double distance =
+            fabs(log(e.tile.zoomLevel.pixelsToFrames(1.0)) - target);
+        if (!found || distance < bestDistance) {
+            nearest = e.tile.zoomLevel;
+            bestDistance = distance;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+void
+ImageTilePyramid::evict()
+{
+    while (m_used > m_budget && !m_entries.empty()) {
+
+        auto oldest = min_element(m_entries.begin(), m_entries.end(),
+                                  [](const Entry &a, const Entry &b) {
+                                      return a.lastUsed < b.lastUsed;
+                                  });
+
+#ifdef DEBUG_IMAGE_TILE_PYRAMID
+        SVDEBUG << "ImageTilePyramid::evict: discarding tile "
+                << oldest->index << " at zoom " << oldest->tile.zoomLevel
+                << endl;
+#endif
+
+        m_used -= getBytes(oldest->tile);
+        m_entries.erase(oldest);
+    }
+}
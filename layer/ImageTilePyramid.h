@@ -0,0 +1,137 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef IMAGE_TILE_PYRAMID_H
+#define IMAGE_TILE_PYRAMID_H
+
+#include "base/BaseTypes.h"
+#include "base/MagnitudeRange.h"
+#include "base/ZoomLevel.h"
+
+#include <QImage>
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * A store of previously rendered image tiles for a horizontally
+ * scrolling view such as a spectrogram, kept across several zoom
+ * levels within a fixed memory budget.
+ *
+ * A ScrollableImageCache is discarded whenever the zoom level
+ * changes. Storing its contents here first means that returning to
+ * a zoom level can reuse what was rendered there before, and that a
+ * nearby zoom level can be rescaled to stand in for an exact render
+ * while that is in progress.
+ *
+ * Tiles are tileWidth columns wide and aligned to a fixed grid of
+ * multiples of tileWidth pixels at their own zoom level, so tiles
+ * from different stores at the same zoom level line up. Only tiles
+ * at FramesPerPixel zoom levels are kept. When the budget is
+ * exceeded, the least recently used tiles are discarded first.
+ */
+class ImageTilePyramid
+{
+public:
+    struct Tile {
+        ZoomLevel zoomLevel;
+        sv_frame_t startFrame; // first frame of column 0
+        QImage image;
+        std::vector<MagnitudeRange> ranges; // one per column, maybe unset
+
+        sv_frame_t getEndFrame() const {
+            return startFrame + sv_frame_t(image.width()) * zoomLevel.level;
+        }
+    };
+
+    static const int tileWidth = 256;
+
+    ImageTilePyramid() :
+        m_budget(0),
+        m_used(0),
+        m_clock(0)
+    {}
+
+    /**
+     * Set the memory budget in bytes, discarding tiles if necessary.
+     * A budget of zero disables the store.
+     */
+    void setMemoryBudget(size_t bytes);
+
+    size_t getMemoryBudget() const {
+        return m_budget;
+    }
+
+    size_t getMemoryUsed() const {
+        return m_used;
+    }
+
+    void clear();
+
+    /**
+     * Discard all tiles, at any zoom level, that overlap the given
+     * range of frames.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
+
+    /**
+     * Store columns of an image rendered at the given zoom level.
+     * Column 0 of the image begins at startFrame, which must be on a
+     * pixel boundary at that zoom level; left and width give the
+     * columns to store, and ranges holds the magnitude range for
+     * each column of the image (or is empty). A stored tile is
+     * replaced by a new one at the same position if the new one is at
+     * least as wide.
+     */
+    void store(ZoomLevel zoom,
+               sv_frame_t startFrame,
+               const QImage &image,
+               int left,
+               int width,
+               const std::vector<MagnitudeRange> &ranges);
+
+    /**
+     * Return all tiles of the given zoom level and height that
+     * overlap the frame range f0 to f1, in order of start frame.
+     */
+    std::vector<Tile> getTiles(ZoomLevel zoom, int height,
+                               sv_frame_t f0, sv_frame_t f1);
+
+    /**
+     * Find the stored zoom level closest to the given one, other than
+     * the given one itself, for which there are tiles of the given
+     * height overlapping the frame range f0 to f1. Return false if
+     * there is none.
+     */
+    bool getNearestZoomLevel(ZoomLevel zoom, int height,
+                             sv_frame_t f0, sv_frame_t f1,
+                             ZoomLevel &nearest) const;
+
+private:
+    struct Entry {
+        Tile tile;
+        int64_t index; // position in tile grid at its zoom level
+        uint64_t lastUsed;
+    };
+
+    std::vector<Entry> m_entries;
+    size_t m_budget;
+    size_t m_used;
+    uint64_t m_clock;
+
+    static size_t getBytes(const Tile &tile);
+    void evict();
+};
+
+#endif
@@ -0,0 +1,122 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "InstantCountIndex.h"
+
+#include "data/model/SparseOneDimensionalModel.h"
+
+#include "base/Debug.h"
+
+#include <algorithm>
+
+using namespace std;
+
+//#define DEBUG_INSTANT_COUNT_INDEX 1
+
+InstantCountIndex::InstantCountIndex() :
+    m_built(false)
+{
+}
+
+void
+InstantCountIndex::clear()
+{
+    m_built = false;
+    m_frames.clear();
+    m_pending.clear();
+}
+
+void
+InstantCountIndex::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+    if (!m_built) return;
+
+    // A long run of separate changes (e.g. while a model is being
+    // filled in by a plugin) is cheaper to handle by re-reading the
+    // whole model than range by range
+    if (m_pending.size() >= 64) {
+        clear();
+        return;
+    }
+
+    m_pending.push_back({ from, to });
+}
+
+void
+InstantCountIndex::prepare(const SparseOneDimensionalModel &model)
+{
+    if (!m_built) {
+
+        EventVector events = model.getAllEvents();
+        m_frames.clear();
+        m_frames.reserve(events.size());
+        for (const auto &e: events) {
+            m_frames.push_back(e.getFrame());
+        }
+        sort(m_frames.begin(), m_frames.end());
+        m_built = true;
+        m_pending.clear();
+
+#ifdef DEBUG_INSTANT_COUNT_INDEX
+        SVDEBUG << "InstantCountIndex::prepare: indexed " << m_frames.size()
+                << " events" << endl;
+#endif
+        return;
+    }
+
+    for (auto r: m_pending) {
+
+        sv_frame_t from = r.first, to = r.second;
+        if (to < from) continue;
+
+        auto i0 = lower_bound(m_frames.begin(), m_frames.end(), from);
+        auto i1 = upper_bound(i0, m_frames.end(), to);
+        i0 = m_frames.erase(i0, i1);
+
+        EventVector events = model.getEventsStartingWithin(from, to - from + 1);
+        vector<sv_frame_t> frames;
+        frames.reserve(events.size());
+        for (const auto &e: events) {
+            frames.push_back(e.getFrame());
+        }
+        sort(frames.begin(), frames.end());
+        m_frames.insert(i0, frames.begin(), frames.end());
+
+#ifdef DEBUG_INSTANT_COUNT_INDEX
+        SVDEBUG << "InstantCountIndex::prepare: re-read " << frames.size()
+                << " events from " << from << " to " << to << endl;
+#endif
+    }
+
+    m_pending.clear();
+}
+
+void
+InstantCountIndex::getColumnCounts(const SparseOneDimensionalModel &model,
+                                   const vector<sv_frame_t> &boundaries,
+                                   vector<int> &counts)
+{
+    int n = int(boundaries.size()) - 1;
+    counts.assign(max(n, 0), 0);
+    if (n <= 0) return;
+
+    prepare(model);
+
+    auto prev = lower_bound(m_frames.begin(), m_frames.end(), boundaries[0]);
+    for (int c = 0; c < n; ++c) {
+        auto next = lower_bound(prev, m_frames.end(), boundaries[c+1]);
+        counts[c] = int(next - prev);
+        prev = next;
+    }
+}
@@ -0,0 +1,68 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef INSTANT_COUNT_INDEX_H
+#define INSTANT_COUNT_INDEX_H
+
+#include "base/BaseTypes.h"
+
+#include <vector>
+#include <utility>
+
+class SparseOneDimensionalModel;
+
+/**
+ * An index of the frames of the events in a SparseOneDimensionalModel,
+ * for counting the instants that fall within many adjacent ranges
+ * (such as the pixel columns of a view) without retrieving the events
+ * themselves.
+ *
+ * The index is a sorted vector of event frames, read from the model
+ * in full when first used and afterwards kept up to date by
+ * re-reading only the frame ranges reported as changed. Counting the
+ * events in a range costs a pair of binary searches.
+ *
+ * Not thread-safe.
+ */
+class InstantCountIndex
+{
+public:
+    InstantCountIndex();
+
+    void clear();
+
+    /**
+     * Note that the events from frame from to frame to inclusive may
+     * have changed. They are re-read on the next request.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
+
+    /**
+     * Fill counts with the number of events at or after boundaries[i]
+     * and before boundaries[i+1], for each interval between
+     * successive frames in boundaries, which must be non-decreasing.
+     */
+    void getColumnCounts(const SparseOneDimensionalModel &model,
+                         const std::vector<sv_frame_t> &boundaries,
+                         std::vector<int> &counts);
+
+private:
+    bool m_built;
+    std::vector<sv_frame_t> m_frames;
+    std::vector<std::pair<sv_frame_t, sv_frame_t>> m_pending;
+
+    void prepare(const SparseOneDimensionalModel &model);
+};
+
+#endif
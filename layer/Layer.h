@@ -345,6 +345,34 @@ public:
      */
     virtual bool isLayerOpaque() const { return false; }
 
+    /**
+     * This should return true if the layer can safely be painted on
+     * a thread other than the GUI thread, concurrently with other
+     * layers being painted (but never with itself). A view that
+     * paints its layers in parallel will then paint this one into an
+     * image of its own and composite it in stacking order. The layer
+     * must not touch widget state in paint(), and its painting must
+     * composite correctly over other layers with ordinary source-over
+     * blending. The background and foreground of the geometry
+     * provider passed to paint() are fixed before painting starts,
+     * so they may still be asked for, but tasks the layer starts
+     * itself should be given any colours they need rather than
+     * asking for them.
+     */
+    virtual bool isLayerThreadSafe() const { return false; }
+
+    /**
+     * This should return true if a change to the layer's model
+     * within a range of frames affects what the layer paints only
+     * over that range (give or take a column), so that a view may
+     * keep whatever it has cached of the layer outside it. Layers
+     * whose painting anywhere can depend on the model as a whole,
+     * for example through scaling to fit its extents or joining
+     * distant points, should return false, in which case a view
+     * discards its whole cache when the model changes.
+     */
+    virtual bool isLayerPaintLocalInTime() const { return false; }
+
     enum ColourSignificance {
         ColourAbsent,
         ColourIrrelevant,
@@ -0,0 +1,184 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "OversampledWaveformCache.h"
+
+#include "data/model/DenseTimeValueModel.h"
+#include "data/model/WaveformOversampler.h"
+
+#include "base/HitCount.h"
+#include "base/Debug.h"
+
+#include <algorithm>
+
+using namespace std;
+
+//#define DEBUG_OVERSAMPLED_WAVEFORM_CACHE 1
+
+void
+OversampledWaveformCache::setMemoryBudget(size_t bytes)
+{
+    m_budget = bytes;
+    if (m_budget == 0) {
+        clear();
+    } else {
+        evict({ -1, 0, 0 });
+    }
+}
+
+void
+OversampledWaveformCache::clear()
+{
+    m_entries.clear();
+    m_used = 0;
+}
+
+void
+OversampledWaveformCache::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+    // The oversampling filter reaches a little way either side of
+    // each block, so a change just outside one affects it too. A
+    // whole block's margin is more than enough.
+    
+    auto i = m_entries.begin();
+    while (i != m_entries.end()) {
+        sv_frame_t start = i->first.blockStart;
+        if (start < to + blockFrames &&
+            start + blockFrames > from - blockFrames) {
+            m_used -= i->second.data.size() * sizeof(float);
+            i = m_entries.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+const floatvec_t &
+OversampledWaveformCache::getBlock(const DenseTimeValueModel &model,
+                                   const Key &key)
+{
+    static HitCount count("OversampledWaveformCache: blocks");
+    
+    auto i = m_entries.find(key);
+    if (i != m_entries.end()) {
+        count.hit();
+        i->second.lastUsed = ++m_clock;
+        return i->second.data;
+    }
+
+    count.miss();
+
+    sv_frame_t frames = blockFrames;
+    sv_frame_t end = model.getEndFrame();
+    if (key.blockStart + frames > end) {
+        frames = std::max(sv_frame_t(0), end - key.blockStart);
+    }
+
+#ifdef DEBUG_OVERSAMPLED_WAVEFORM_CACHE
+    SVDEBUG << "OversampledWaveformCache::getBlock: oversampling "
+            << frames << " frames from " << key.blockStart
+            << " in channel " << key.channel << " by "
+            << key.oversampleBy << endl;
+#endif
+
+    Entry &e = m_entries[key];
+    e.data = WaveformOversampler::getOversampledData
+        (model, key.channel, key.blockStart, frames, key.oversampleBy);
+    e.lastUsed = ++m_clock;
+    m_used += e.data.size() * sizeof(float);
+
+    evict(key);
+
+    return e.data;
+}
+
+floatvec_t
+OversampledWaveformCache::getOversampledData(const DenseTimeValueModel &model,
+                                             int channel,
+                                             sv_frame_t frame,
+                                             sv_frame_t count,
+                                             int oversampleBy)
+{
+    if (m_budget == 0 || frame < 0 || oversampleBy < 1) {
+        return WaveformOversampler::getOversampledData
+            (model, channel, frame, count, oversampleBy);
+    }
+
+    floatvec_t result;
+    if (count <= 0) {
+        return result;
+    }
+    result.reserve(size_t(count * oversampleBy));
+
+    sv_frame_t end = frame + count;
+    sv_frame_t blockStart = (frame / blockFrames) * blockFrames;
+
+    while (blockStart < end) {
+
+        const floatvec_t &block =
+            getBlock(model, { channel, oversampleBy, blockStart });
+
+        sv_frame_t f0 = std::max(frame, blockStart);
+        sv_frame_t f1 = std::min(end, blockStart + blockFrames);
+        
+        sv_frame_t i0 = (f0 - blockStart) * oversampleBy;
+        sv_frame_t i1 = (f1 - blockStart) * oversampleBy;
+        if (i1 > sv_frame_t(block.size())) {
+            i1 = sv_frame_t(block.size());
+        }
+        if (i1 <= i0) {
+            // past the end of the model
+            break;
+        }
+
+        result.insert(result.end(), block.begin() + i0, block.begin() + i1);
+
+        blockStart += blockFrames;
+    }
+
+    return result;
+}
+
+void
+OversampledWaveformCache::evict(const Key &keep)
+{
+    // Never evict the block just added, even if it alone exceeds the
+    // budget, as the caller is about to use it
+
+    while (m_used > m_budget && !m_entries.empty()) {
+
+        auto oldest = m_entries.end();
+        for (auto i = m_entries.begin(); i != m_entries.end(); ++i) {
+            if (!(i->first < keep) && !(keep < i->first)) {
+                continue;
+            }
+            if (oldest == m_entries.end() ||
+                i->second.lastUsed < oldest->second.lastUsed) {
+                oldest = i;
+            }
+        }
+        if (oldest == m_entries.end()) {
+            break;
+        }
+        
+#ifdef DEBUG_OVERSAMPLED_WAVEFORM_CACHE
+        SVDEBUG << "OversampledWaveformCache::evict: discarding block at "
+                << oldest->first.blockStart << " in channel "
+                << oldest->first.channel << endl;
+#endif
+
+        m_used -= oldest->second.data.size() * sizeof(float);
+        m_entries.erase(oldest);
+    }
+}
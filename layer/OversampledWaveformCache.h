@@ -0,0 +1,113 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef OVERSAMPLED_WAVEFORM_CACHE_H
+#define OVERSAMPLED_WAVEFORM_CACHE_H
+
+#include "base/BaseTypes.h"
+
+#include <map>
+#include <cstdint>
+
+class DenseTimeValueModel;
+
+/**
+ * A store of oversampled audio data, for waveforms shown at zoom
+ * levels of more than one pixel per frame, kept within a fixed memory
+ * budget.
+ *
+ * Data is oversampled through WaveformOversampler in blocks of
+ * blockFrames source frames, aligned to multiples of blockFrames,
+ * and kept as plain float arrays keyed by channel, block and
+ * oversampling ratio. A request for a range of frames is assembled
+ * from the blocks it overlaps, so that scrolling only oversamples the
+ * blocks newly coming into view. When the budget is exceeded, the
+ * least recently used blocks are discarded first.
+ */
+class OversampledWaveformCache
+{
+public:
+    static const int blockFrames = 1024;
+    
+    OversampledWaveformCache() :
+        m_budget(16 * 1024 * 1024),
+        m_used(0),
+        m_clock(0)
+    {}
+
+    /**
+     * Set the memory budget in bytes, discarding blocks if
+     * necessary. A budget of zero disables the store, so that every
+     * request is oversampled afresh.
+     */
+    void setMemoryBudget(size_t bytes);
+
+    size_t getMemoryBudget() const {
+        return m_budget;
+    }
+
+    size_t getMemoryUsed() const {
+        return m_used;
+    }
+
+    void clear();
+
+    /**
+     * Discard any blocks that could be affected by a change to the
+     * source frames from, to.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
+
+    /**
+     * Return the oversampled data for count frames from frame in the
+     * given channel of the model, as would be returned by
+     * WaveformOversampler::getOversampledData.
+     */
+    floatvec_t getOversampledData(const DenseTimeValueModel &model,
+                                  int channel,
+                                  sv_frame_t frame,
+                                  sv_frame_t count,
+                                  int oversampleBy);
+
+private:
+    struct Key {
+        int channel;
+        int oversampleBy;
+        sv_frame_t blockStart;
+
+        bool operator<(const Key &k) const {
+            if (channel != k.channel) return channel < k.channel;
+            if (oversampleBy != k.oversampleBy) {
+                return oversampleBy < k.oversampleBy;
+            }
+            return blockStart < k.blockStart;
+        }
+    };
+
+    struct Entry {
+        floatvec_t data;
+        uint64_t lastUsed;
+    };
+
+    std::map<Key, Entry> m_entries;
+    size_t m_budget;
+    size_t m_used;
+    uint64_t m_clock;
+
+    const floatvec_t &getBlock(const DenseTimeValueModel &model,
+                               const Key &key);
+    void evict(const Key &keep);
+};
+
+#endif
@@ -0,0 +1,182 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "PaintTelemetry.h"
+
+#include <algorithm>
+
+using namespace std;
+
+PaintTelemetry *
+PaintTelemetry::getInstance()
+{
+    static PaintTelemetry instance;
+    return &instance;
+}
+
+PaintTelemetry::PaintTelemetry() :
+    m_enabled(false),
+    m_next(0),
+    m_outOfTime(0),
+    m_slots(capacity)
+{
+    for (auto &slot : m_slots) {
+        slot.version.store(0, memory_order_relaxed);
+    }
+}
+
+void
+PaintTelemetry::write(PaintRecord &record)
+{
+    // Each writer claims its own sequence number, and so its own
+    // slot. The slot's version is odd while it is being written, so
+    // that a reader that overlaps with the write can tell and skip it
+    // (a seqlock). Paints happen on the GUI thread, so writers will
+    // not normally contend at all.
+    
+    uint64_t sequence = m_next.fetch_add(1, memory_order_acq_rel);
+    record.sequence = sequence;
+
+    Slot &slot = m_slots[sequence % capacity];
+
+    slot.version.store(2 * sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot.record = record;
+    slot.version.store(2 * (sequence + 1), memory_order_release);
+}
+
+vector<PaintTelemetry::PaintRecord>
+PaintTelemetry::getRecentRecords(int maxCount) const
+{
+    vector<PaintRecord> records;
+    if (maxCount <= 0) {
+        return records;
+    }
+
+    uint64_t next = m_next.load(memory_order_acquire);
+    uint64_t count = min<uint64_t>(next, min(maxCount, int(capacity)));
+    
+    for (uint64_t sequence = next - count; sequence < next; ++sequence) {
+
+        const Slot &slot = m_slots[sequence % capacity];
+
+        uint64_t before = slot.version.load(memory_order_acquire);
+        if (before != 2 * (sequence + 1)) {
+            // being written, overwritten already, or claimed but not
+            // yet written
+            continue;
+        }
+        
+        PaintRecord record = slot.record;
+        
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t after = slot.version.load(memory_order_relaxed);
+        if (after != before) {
+            continue;
+        }
+
+        records.push_back(record);
+    }
+
+    return records;
+}
+
+PaintTelemetry::PaintRecorder::PaintRecorder(int viewId) :
+    m_active(PaintTelemetry::getInstance()->isEnabled()),
+    m_record(),
+    m_outOfTimeAtStart(0),
+    m_layer(nullptr)
+{
+    if (!m_active) {
+        return;
+    }
+
+    m_start = chrono::steady_clock::now();
+    m_outOfTimeAtStart = PaintTelemetry::getInstance()->getOutOfTimeCount();
+
+    m_record.viewId = viewId;
+    m_record.startNsec = chrono::duration_cast<chrono::nanoseconds>
+        (m_start.time_since_epoch()).count();
+    m_record.cacheOutcome = CacheOutcome::NoCache;
+}
+
+PaintTelemetry::PaintRecorder::~PaintRecorder()
+{
+    commit();
+}
+
+void
+PaintTelemetry::PaintRecorder::startLayer(const Layer *layer)
+{
+    if (!m_active) {
+        return;
+    }
+    m_layer = layer;
+    m_layerStart = chrono::steady_clock::now();
+}
+
+void
+PaintTelemetry::PaintRecorder::endLayer()
+{
+    if (!m_active || !m_layer) {
+        return;
+    }
+
+    int64_t nsec = chrono::duration_cast<chrono::nanoseconds>
+        (chrono::steady_clock::now() - m_layerStart).count();
+
+    // A layer may be painted more than once in a paint event (for
+    // example into both parts of a wrapped cache), so accumulate
+
+    for (int i = 0; i < m_record.layerCount; ++i) {
+        if (m_record.layers[i].layer == m_layer) {
+            m_record.layers[i].nsec += nsec;
+            m_layer = nullptr;
+            return;
+        }
+    }
+
+    if (m_record.layerCount < maxLayers) {
+        m_record.layers[m_record.layerCount++] = { m_layer, nsec };
+    }
+    m_layer = nullptr;
+}
+
+int64_t
+PaintTelemetry::PaintRecorder::getElapsedNsec() const
+{
+    if (!m_active) {
+        return 0;
+    }
+    return chrono::duration_cast<chrono::nanoseconds>
+        (chrono::steady_clock::now() - m_start).count();
+}
+
+void
+PaintTelemetry::PaintRecorder::commit()
+{
+    if (!m_active) {
+        return;
+    }
+    m_active = false;
+
+    PaintTelemetry *telemetry = PaintTelemetry::getInstance();
+    
+    m_record.durationNsec = chrono::duration_cast<chrono::nanoseconds>
+        (chrono::steady_clock::now() - m_start).count();
+    m_record.outOfTimeEvents =
+        telemetry->getOutOfTimeCount() - m_outOfTimeAtStart;
+
+    telemetry->write(m_record);
+}
@@ -0,0 +1,178 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_PAINT_TELEMETRY_H
+#define SV_PAINT_TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+class Layer;
+
+/**
+ * A process-wide record of recent view paints, for finding out which
+ * view or layer is slow to paint in a running session without
+ * rebuilding with debug output enabled.
+ *
+ * Each paint event of a view produces one PaintRecord, holding the
+ * time taken overall and by each layer, the outcome of the view's
+ * cache lookup, the number of pixels painted afresh and reused from
+ * the cache, and the number of RenderTimer out-of-time events that
+ * occurred during it. Records are kept in a fixed-size ring buffer
+ * that is written without locking, so the most recent records can be
+ * read at any time from any thread by getRecentRecords().
+ *
+ * Recording is disabled by default, in which case the cost to the
+ * paint path is a single atomic load per paint.
+ */
+class PaintTelemetry
+{
+public:
+    enum class CacheOutcome : char {
+        NoCache,
+        Hit,
+        Partial,
+        Miss
+    };
+
+    struct LayerTiming {
+        const Layer *layer; // for identification only; may since be gone
+        int64_t nsec;
+    };
+
+    static const int maxLayers = 16;
+
+    struct PaintRecord {
+        uint64_t sequence;      // increasing across all views
+        int viewId;
+        int64_t startNsec;      // steady clock, from an arbitrary epoch
+        int64_t durationNsec;
+        CacheOutcome cacheOutcome;
+        int64_t pixelsRendered;
+        int64_t pixelsReused;
+        int outOfTimeEvents;
+        int layerCount;         // layers timed, at most maxLayers
+        LayerTiming layers[maxLayers];
+    };
+
+    static const int capacity = 4096;
+
+    static PaintTelemetry *getInstance();
+
+    void setEnabled(bool enabled) {
+        m_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool isEnabled() const {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Return up to maxCount of the most recent records, oldest first.
+     * Records that are being overwritten while this is called are
+     * skipped.
+     */
+    std::vector<PaintRecord> getRecentRecords(int maxCount = capacity) const;
+
+    /**
+     * Return the total number of records made since startup
+     * (including those since overwritten).
+     */
+    uint64_t getRecordCount() const {
+        return m_next.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Note that a RenderTimer has reported running out of time. May
+     * be called from any thread.
+     */
+    void noteOutOfTime() {
+        m_outOfTime.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int getOutOfTimeCount() const {
+        return m_outOfTime.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Helper for the paint path. Make one of these at the start of a
+     * paint and fill it in as the paint proceeds; it is committed to
+     * the ring buffer when commit() is called or when it is
+     * destroyed. If recording is disabled when it is constructed, it
+     * does nothing.
+     */
+    class PaintRecorder
+    {
+    public:
+        PaintRecorder(int viewId);
+        ~PaintRecorder();
+
+        bool isActive() const {
+            return m_active;
+        }
+
+        void setCacheOutcome(CacheOutcome outcome) {
+            m_record.cacheOutcome = outcome;
+        }
+        void addPixels(int64_t rendered, int64_t reused) {
+            m_record.pixelsRendered += rendered;
+            m_record.pixelsReused += reused;
+        }
+
+        void startLayer(const Layer *layer);
+        void endLayer();
+
+        /**
+         * Return the time elapsed since construction, in nanoseconds.
+         */
+        int64_t getElapsedNsec() const;
+
+        void commit();
+
+    private:
+        bool m_active;
+        PaintRecord m_record;
+        int m_outOfTimeAtStart;
+        std::chrono::steady_clock::time_point m_start;
+        std::chrono::steady_clock::time_point m_layerStart;
+        const Layer *m_layer;
+
+        PaintRecorder(const PaintRecorder &) = delete;
+        PaintRecorder &operator=(const PaintRecorder &) = delete;
+    };
+
+private:
+    PaintTelemetry();
+
+    struct Slot {
+        // Even when stable: 2 * (1 + sequence) of the record in it,
+        // or 0 if never written. Odd while being written.
+        std::atomic<uint64_t> version;
+        PaintRecord record;
+    };
+
+    std::atomic<bool> m_enabled;
+    std::atomic<uint64_t> m_next;
+    std::atomic<int> m_outOfTime;
+    std::vector<Slot> m_slots;
+
+    void write(PaintRecord &record);
+
+    PaintTelemetry(const PaintTelemetry &) = delete;
+    PaintTelemetry &operator=(const PaintTelemetry &) = delete;
+};
+
+#endif
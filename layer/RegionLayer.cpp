@@ -90,6 +90,9 @@ RegionLayer::setModel(ModelId modelId)
 
         connect(newModel.get(), SIGNAL(modelChanged(ModelId)),
                 this, SLOT(recalcSpacing()));
+        connect(newModel.get(),
+                SIGNAL(modelChangedWithin(ModelId, sv_frame_t, sv_frame_t)),
+                this, SLOT(updateSpacing(ModelId, sv_frame_t, sv_frame_t)));
     
         recalcSpacing();
 
@@ -279,20 +282,86 @@ RegionLayer::isLayerScrollable(const LayerGeometryProvider *v) const
 void
 RegionLayer::recalcSpacing()
 {
-    m_spacingMap.clear();
+    m_regionValues.clear();
     m_distributionMap.clear();
 
     auto model = ModelById::getAs<RegionModel>(m_model);
-    if (!model) return;
+    if (!model) {
+        m_spacingMap.clear();
+        return;
+    }
 
 //    SVDEBUG << "RegionLayer::recalcSpacing" << endl;
 
     EventVector allEvents = model->getAllEvents();
     for (const Event &e: allEvents) {
+        m_regionValues.insert({ e.getFrame(), e.getValue() });
         m_distributionMap[e.getValue()]++;
 //        SVDEBUG << "RegionLayer::recalcSpacing: value found: " << e.getValue() << " (now have " << m_distributionMap[e.getValue()] << " of this value)" <<  endl;
     }
 
+    recalcSpacingIndices();
+}
+
+void
+RegionLayer::updateSpacing(ModelId modelId, sv_frame_t from, sv_frame_t to)
+{
+    if (modelId != m_model) return;
+    
+    auto model = ModelById::getAs<RegionModel>(m_model);
+    if (!model) return;
+
+    // Every region added or removed has its start frame within the
+    // changed range, so we can bring the distribution up to date by
+    // replacing what we last saw starting in that range with what
+    // the model has there now. The spacing indices only need to be
+    // recalculated if a value appears or disappears altogether.
+    
+    auto i0 = m_regionValues.lower_bound(from);
+    auto i1 = m_regionValues.upper_bound(to);
+
+    std::vector<double> decremented;
+    for (auto i = i0; i != i1; ++i) {
+        auto d = m_distributionMap.find(i->second);
+        if (d != m_distributionMap.end()) {
+            --d->second;
+            decremented.push_back(i->second);
+        }
+    }
+    m_regionValues.erase(i0, i1);
+
+    bool distinctValuesChanged = false;
+
+    EventVector events = model->getEventsStartingWithin(from, to - from + 1);
+    for (const Event &e: events) {
+        m_regionValues.insert({ e.getFrame(), e.getValue() });
+        auto d = m_distributionMap.find(e.getValue());
+        if (d == m_distributionMap.end()) {
+            m_distributionMap[e.getValue()] = 1;
+            distinctValuesChanged = true;
+        } else {
+            ++d->second;
+        }
+    }
+
+    for (double value: decremented) {
+        auto d = m_distributionMap.find(value);
+        if (d != m_distributionMap.end() && d->second <= 0) {
+            m_distributionMap.erase(d);
+            distinctValuesChanged = true;
+        }
+    }
+
+    if (distinctValuesChanged) {
+        recalcSpacingIndices();
+    }
+}
+
+void
+RegionLayer::recalcSpacingIndices()
+{
+    m_spacingMap.clear();
+
     int n = 0;
 
     for (SpacingMap::const_iterator i = m_distributionMap.begin();
@@ -1178,8 +1247,6 @@ RegionLayer::drawStart(LayerGeometryProvider *v, QMouseEvent *e)
     m_editingCommand = new ChangeEventsCommand(m_model.untyped, tr("Draw Region"));
     m_editingCommand->add(m_editingPoint);
 
-    recalcSpacing();
-
     m_editing = true;
 }
 
@@ -1211,8 +1278,6 @@ RegionLayer::drawDrag(LayerGeometryProvider *v, QMouseEvent *e)
         .withValue(float(newValue))
         .withDuration(newDuration);
     m_editingCommand->add(m_editingPoint);
-
-    recalcSpacing();
 }
 
 void
@@ -1223,8 +1288,6 @@ RegionLayer::drawEnd(LayerGeometryProvider *, QMouseEvent *)
     finish(m_editingCommand);
     m_editingCommand = nullptr;
     m_editing = false;
-
-    recalcSpacing();
 }
 
 void
@@ -1241,7 +1304,6 @@ RegionLayer::eraseStart(LayerGeometryProvider *v, QMouseEvent *e)
     }
 
     m_editing = true;
-    recalcSpacing();
 }
 
 void
@@ -1270,7 +1332,6 @@ RegionLayer::eraseEnd(LayerGeometryProvider *v, QMouseEvent *e)
     finish(m_editingCommand);
     m_editingCommand = nullptr;
     m_editing = false;
-    recalcSpacing();
 }
 
 void
@@ -1296,7 +1357,6 @@ RegionLayer::editStart(LayerGeometryProvider *v, QMouseEvent *e)
     m_editing = true;
     m_dragStartX = e->x();
     m_dragStartY = e->y();
-    recalcSpacing();
 }
 
 void
@@ -1316,10 +1376,13 @@ RegionLayer::editDrag(LayerGeometryProvider *v, QMouseEvent *e)
 
     // Do not bisect between two values, if one of those values is
     // that of the point we're actually moving ...
-    int avoid = m_spacingMap[m_editingPoint.getValue()];
+    int avoid = -1;
+    auto si = m_spacingMap.find(m_editingPoint.getValue());
+    if (si != m_spacingMap.end()) avoid = si->second;
 
     // ... unless there are other points with the same value
-    if (m_distributionMap[m_editingPoint.getValue()] > 1) avoid = -1;
+    auto di = m_distributionMap.find(m_editingPoint.getValue());
+    if (di != m_distributionMap.end() && di->second > 1) avoid = -1;
 
     double value = getValueForY(v, newy, avoid);
 
@@ -1333,7 +1396,6 @@ RegionLayer::editDrag(LayerGeometryProvider *v, QMouseEvent *e)
         .withFrame(frame)
         .withValue(float(value));
     m_editingCommand->add(m_editingPoint);
-    recalcSpacing();
 }
 
 void
@@ -1362,7 +1424,6 @@ RegionLayer::editEnd(LayerGeometryProvider *, QMouseEvent *)
 
     m_editingCommand = nullptr;
     m_editing = false;
-    recalcSpacing();
 }
 
 bool
@@ -1403,7 +1464,6 @@ RegionLayer::editOpen(LayerGeometryProvider *v, QMouseEvent *e)
     }
 
     delete dialog;
-    recalcSpacing();
     return true;
 }
 
@@ -1429,7 +1489,6 @@ RegionLayer::moveSelection(Selection s, sv_frame_t newStartFrame)
     }
 
     finish(command);
-    recalcSpacing();
 }
 
 void
@@ -1461,7 +1520,6 @@ RegionLayer::resizeSelection(Selection s, Selection newSize)
     }
 
     finish(command);
-    recalcSpacing();
 }
 
 void
@@ -1485,7 +1543,6 @@ RegionLayer::deleteSelection(Selection s)
     }
 
     finish(command);
-    recalcSpacing();
 }    
 
 void
@@ -1579,7 +1636,6 @@ RegionLayer::paste(LayerGeometryProvider *v, const Clipboard &from,
     }
 
     finish(command);
-    recalcSpacing();
     return true;
 }
 
@@ -134,6 +134,7 @@ public:
 
 protected slots:
     void recalcSpacing();
+    void updateSpacing(ModelId, sv_frame_t startFrame, sv_frame_t endFrame);
 
 protected:
     double getValueForY(LayerGeometryProvider *v, int y, int avoid) const;
@@ -168,6 +169,12 @@ protected:
     // region value -> number of regions with this value
     SpacingMap m_distributionMap;
 
+    // region start frame -> value, for the regions counted in
+    // m_distributionMap
+    std::multimap<sv_frame_t, double> m_regionValues;
+
+    void recalcSpacingIndices();
+
     int spacingIndexToY(LayerGeometryProvider *v, int i) const;
     double yToSpacingIndex(LayerGeometryProvider *v, int y) const;
 
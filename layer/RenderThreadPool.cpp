@@ -0,0 +1,95 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "RenderThreadPool.h"
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+
+namespace {
+
+// Set on the pool's own threads, so that we can tell when we are
+// asked to wait for work from within a task
+thread_local bool onPoolThread = false;
+
+class RenderTask : public QRunnable
+{
+public:
+    RenderTask(std::function<void()> fn, QSemaphore *done) :
+        m_fn(fn), m_done(done) { }
+
+    void run() override {
+        onPoolThread = true;
+        m_fn();
+        m_done->release();
+    }
+
+private:
+    std::function<void()> m_fn;
+    QSemaphore *m_done;
+};
+
+}
+
+QThreadPool *
+RenderThreadPool::getPool()
+{
+    // Initialised on first use, which may be from any thread
+    static QThreadPool *pool = []() {
+        QThreadPool *p = new QThreadPool;
+        p->setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+        return p;
+    }();
+    return pool;
+}
+
+void
+RenderThreadPool::runAndWait(const std::vector<std::function<void()>> &tasks)
+{
+    if (tasks.empty()) {
+        return;
+    }
+    
+    if (tasks.size() == 1 || onPoolThread) {
+        for (const auto &task : tasks) {
+            task();
+        }
+        return;
+    }
+    
+    QThreadPool *pool = getPool();
+    QSemaphore done;
+
+    for (const auto &task : tasks) {
+        pool->start(new RenderTask(task, &done));
+    }
+
+    done.acquire(int(tasks.size()));
+}
+
+void
+RenderThreadPool::start(std::function<void()> task, QSemaphore *done)
+{
+    if (onPoolThread) {
+        task();
+        done->release();
+        return;
+    }
+
+    getPool()->start(new RenderTask(task, done));
+}
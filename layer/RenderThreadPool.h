@@ -0,0 +1,55 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_RENDER_THREAD_POOL_H
+#define SV_RENDER_THREAD_POOL_H
+
+#include <functional>
+#include <vector>
+
+class QThreadPool;
+class QSemaphore;
+
+/**
+ * A thread pool shared by layers and renderers for splitting a single
+ * paint into pieces that can be rendered concurrently, such as
+ * columns of a spectrogram or channels of a waveform.
+ *
+ * This is a pool of our own rather than the global one, so that the
+ * painting thread, which blocks until its pieces are done, can never
+ * be starved by unrelated long-running work. Work submitted from
+ * within a task already running on the pool is run in place on that
+ * task's thread, so that a task can never wait on others that have
+ * no thread to run on.
+ */
+class RenderThreadPool
+{
+public:
+    static QThreadPool *getPool();
+
+    /**
+     * Run the given tasks on the pool, and return when all of them
+     * have completed.
+     */
+    static void runAndWait(const std::vector<std::function<void()>> &tasks);
+
+    /**
+     * Start the given task on the pool and return without waiting
+     * for it. The given semaphore is released once when the task has
+     * completed.
+     */
+    static void start(std::function<void()> task, QSemaphore *done);
+};
+
+#endif
@@ -15,6 +15,8 @@
 #ifndef RENDER_TIMER_H
 #define RENDER_TIMER_H
 
+#include "PaintTelemetry.h"
+
 #include <chrono>
 
 class RenderTimer
@@ -46,7 +48,8 @@ public:
         m_minFraction(0.1),
         m_softLimit(0.1),
         m_hardLimit(0.2),
-        m_softLimitOverridden(false) {
+        m_softLimitOverridden(false),
+        m_reported(false) {
 
         if (t == NoTimeout) {
             m_haveLimits = false;
@@ -74,7 +77,7 @@ public:
         double elapsed = std::chrono::duration<double>(t - m_start).count();
         
         if (elapsed > m_hardLimit) {
-            return true;
+            return reportOutOfTime();
         } else if (!m_softLimitOverridden && elapsed > m_softLimit) {
             if (fractionComplete > 0.6) {
                 // If we're significantly more than half way by the
@@ -83,7 +86,7 @@ public:
                 // respect the soft limit and report out of time now.
                 m_softLimitOverridden = true;
             } else {
-                return true;
+                return reportOutOfTime();
             }
         }
 
@@ -107,6 +110,16 @@ private:
     double m_softLimit; // seconds
     double m_hardLimit; // seconds
     bool m_softLimitOverridden;
+    bool m_reported;
+
+    bool reportOutOfTime() {
+        // Count each timer at most once in the paint telemetry
+        if (!m_reported) {
+            PaintTelemetry::getInstance()->noteOutOfTime();
+            m_reported = true;
+        }
+        return true;
+    }
 };
 
 #endif
@@ -17,6 +17,8 @@
 #include "base/HitCount.h"
 
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 using namespace std;
 
 //#define DEBUG_SCROLLABLE_IMAGE_CACHE 1
@@ -65,20 +67,13 @@ ScrollableImageCache::scrollTo(const LayerGeometryProvider *v,
 
     count.partial();
         
-    // dx is in range, cache is scrollable
+    // dx is in range, cache is scrollable. A positive dx means the
+    // content moves right, so view column x now shows what was in
+    // column x - dx: move the origin to match, leaving the pixels
+    // where they are
 
-    int dxp = dx;
-    if (dxp < 0) dxp = -dxp;
-
-    int copylen = (w - dxp) * int(sizeof(QRgb));
-    for (int y = 0; y < m_image.height(); ++y) {
-        QRgb *line = (QRgb *)m_image.scanLine(y);
-        if (dx < 0) {
-            memmove(line, line + dxp, copylen);
-        } else {
-            memmove(line + dxp, line, copylen);
-        }
-    }
+    m_origin = (m_origin - dx) % w;
+    if (m_origin < 0) m_origin += w;
         
     // update valid area
         
@@ -110,6 +105,93 @@ ScrollableImageCache::scrollTo(const LayerGeometryProvider *v,
     m_validWidth = pw;
 }
 
+void
+ScrollableImageCache::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+    if (!isValid()) {
+        return;
+    }
+
+    int w = m_image.width();
+    
+    double px0 = m_zoomLevel.framesToPixels(double(from - m_startFrame));
+    double px1 = m_zoomLevel.framesToPixels(double(to - m_startFrame));
+    if (px1 < 0.0 || px0 > double(w)) {
+        return;
+    }
+
+    // Take a column's margin either side, as the rendering of a
+    // column may depend on its neighbours
+    int x0 = int(floor(std::max(px0, -1.0))) - 1;
+    int x1 = int(ceil(std::min(px1, double(w)))) + 1;
+    
+#ifdef DEBUG_SCROLLABLE_IMAGE_CACHE
+    cerr << "ScrollableImageCache::invalidateFrameRange: frames " << from
+         << " to " << to << " -> columns " << x0 << " to " << x1
+         << " (valid area " << m_validLeft << " to " << getValidRight()
+         << ")" << endl;
+#endif
+
+    int left = m_validLeft;
+    int right = getValidRight();
+    
+    if (x1 <= left || x0 >= right) {
+        return;
+    }
+
+    int leftPart = x0 - left;
+    int rightPart = right - x1;
+
+    if (leftPart >= rightPart) {
+        m_validWidth = (leftPart > 0 ? leftPart : 0);
+    } else {
+        m_validLeft = x1;
+        m_validWidth = rightPart;
+    }
+}
+
+QImage
+ScrollableImageCache::getImage() const
+{
+    if (m_origin == 0) {
+        return m_image;
+    }
+
+    QImage image(m_image.size(), m_image.format());
+    QPainter painter(&image);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    drawTo(painter, 0, 0, m_image.rect());
+    painter.end();
+    return image;
+}
+
+void
+ScrollableImageCache::drawTo(QPainter &paint, int x, int y, QRect area) const
+{
+    area &= m_image.rect();
+    if (area.isEmpty()) {
+        return;
+    }
+
+    // View columns up to the seam are found from m_origin onwards in
+    // the image, those from the seam onwards at the start of it
+    
+    int seam = m_image.width() - m_origin;
+    int left = area.x();
+    int right = area.x() + area.width();
+
+    if (left < seam) {
+        int w = std::min(right, seam) - left;
+        paint.drawImage(x, y, m_image,
+                        left + m_origin, area.y(), w, area.height());
+    }
+    if (right > seam) {
+        int l = std::max(left, seam);
+        paint.drawImage(x + (l - left), y, m_image,
+                        l - seam, area.y(), right - l, area.height());
+    }
+}
+
 void
 ScrollableImageCache::adjustToTouchValidArea(int &left, int &width,
                                              bool &isLeftOfValidArea) const
@@ -167,10 +249,31 @@ ScrollableImageCache::drawImage(int left,
         throw std::logic_error("Source area out of bounds in ScrollableImageCache::drawImage");
     }
         
+    int seam = m_image.width() - m_origin;
+    int right = left + width;
+    int h = m_image.height();
+
     QPainter painter(&m_image);
-    painter.drawImage(QRect(left, 0, width, m_image.height()),
-                      image,
-                      QRect(imageLeft, 0, imageWidth, image.height()));
+
+    if (right <= seam || left >= seam) {
+        int x = (left < seam ? left + m_origin : left - seam);
+        painter.drawImage(QRect(x, 0, width, h),
+                          image,
+                          QRect(imageLeft, 0, imageWidth, image.height()));
+    } else {
+        // Target straddles the wrap point: split the source in the
+        // same proportion
+        double scale = double(imageWidth) / double(width);
+        int w0 = seam - left;
+        painter.drawImage(QRectF(left + m_origin, 0, w0, h),
+                          image,
+                          QRectF(imageLeft, 0, w0 * scale, image.height()));
+        painter.drawImage(QRectF(0, 0, right - seam, h),
+                          image,
+                          QRectF(imageLeft + w0 * scale, 0,
+                                 (right - seam) * scale, image.height()));
+    }
+    
     painter.end();
 
     if (!isValid()) {
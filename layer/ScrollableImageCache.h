@@ -31,6 +31,13 @@
  * the image, and can report and update which contiguous horizontal
  * range of the image is valid.
  *
+ * The image is used as a ring buffer: scrolling moves the origin
+ * (the image column that holds the leftmost column of the view)
+ * rather than the pixels, so that the only per-scroll cost is
+ * rendering the newly exposed strip. All coordinates in the API are
+ * view coordinates, and drawing into or out of the cache takes at
+ * most two blits, one either side of the wrap point.
+ *
  * The only way to *update* the valid area in a cache is to draw to it
  * using the drawImage call.
  */
@@ -40,12 +47,23 @@ public:
     ScrollableImageCache() :
         m_validLeft(0),
         m_validWidth(0),
+        m_origin(0),
         m_startFrame(0)
     {}
 
     void invalidate() {
         m_validWidth = 0;
+        m_origin = 0;
     }
+
+    /**
+     * Invalidate the part of the cache that shows the given range of
+     * frames, according to the current start frame and zoom level,
+     * together with a column either side of it. As the valid area
+     * must be contiguous, if the range falls in the middle of it,
+     * only the larger of the parts to either side remains valid.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
     
     bool isValid() const {
         return m_validWidth > 0;
@@ -117,9 +135,20 @@ public:
         }
     }
     
-    const QImage &getImage() const {
-        return m_image;
-    }
+    /**
+     * Return the cache image in view order. If the cache has not
+     * been scrolled since it was last invalidated this is a shallow
+     * copy of the underlying image; otherwise the two parts either
+     * side of the wrap point have to be reassembled into a new image,
+     * so prefer drawTo() for painting.
+     */
+    QImage getImage() const;
+
+    /**
+     * Draw the given area of the cache, in view coordinates, onto the
+     * painter with its top-left corner at x, y.
+     */
+    void drawTo(QPainter &paint, int x, int y, QRect area) const;
 
     /**
      * Set the new start frame for the cache, according to the
@@ -156,6 +185,7 @@ private:
     QImage m_image;
     int m_validLeft;
     int m_validWidth;
+    int m_origin; // image column holding view column 0
     sv_frame_t m_startFrame;
     ZoomLevel m_zoomLevel;
 };
@@ -18,10 +18,104 @@
 #include "base/Debug.h"
 
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 using namespace std;
 
 //#define DEBUG_SCROLLABLE_MAG_RANGE_CACHE 1
 
+MagnitudeRange
+ScrollableMagRangeCache::combine(const MagnitudeRange &a,
+                                 const MagnitudeRange &b)
+{
+    if (!b.isSet()) return a;
+    if (!a.isSet()) return b;
+    MagnitudeRange r(a);
+    r.sample(b);
+    return r;
+}
+
+void
+ScrollableMagRangeCache::setLeaf(int leaf, const MagnitudeRange &r)
+{
+    m_tree[leaf] = r;
+    int set = (r.isSet() ? 1 : 0);
+    m_setCount += set - m_setCounts[leaf];
+    m_setCounts[leaf] = set;
+
+    for (int i = leaf / 2; i >= 1; i /= 2) {
+        m_tree[i] = combine(m_tree[2*i], m_tree[2*i + 1]);
+        m_setCounts[i] = m_setCounts[2*i] + m_setCounts[2*i + 1];
+    }
+}
+
+void
+ScrollableMagRangeCache::rebuild()
+{
+    int n = m_width;
+    m_setCount = 0;
+    for (int i = n; i < 2*n; ++i) {
+        m_setCounts[i] = (m_tree[i].isSet() ? 1 : 0);
+        m_setCount += m_setCounts[i];
+    }
+    for (int i = n - 1; i >= 1; --i) {
+        m_tree[i] = combine(m_tree[2*i], m_tree[2*i + 1]);
+        m_setCounts[i] = m_setCounts[2*i] + m_setCounts[2*i + 1];
+    }
+}
+
+void
+ScrollableMagRangeCache::clearColumns(int x, int count)
+{
+    int x0 = std::max(x, 0);
+    int x1 = std::min(x + count, m_width);
+    if (x1 <= x0) {
+        return;
+    }
+
+    // Updating leaf by leaf costs O(log n) each; past a certain
+    // proportion of the width it's cheaper to reset the leaves and
+    // rebuild the whole tree in one O(n) pass
+
+    int depth = 1;
+    while ((1 << depth) < m_width) ++depth;
+    
+    if ((x1 - x0) * depth < m_width) {
+        for (int c = x0; c < x1; ++c) {
+            setLeaf(getLeaf(c), MagnitudeRange());
+        }
+    } else {
+        for (int c = x0; c < x1; ++c) {
+            m_tree[getLeaf(c)] = MagnitudeRange();
+        }
+        rebuild();
+    }
+}
+
+MagnitudeRange
+ScrollableMagRangeCache::queryLeaves(int p0, int p1) const
+{
+    // Range of leaf positions p0 (inclusive) to p1 (exclusive),
+    // without wrapping
+    MagnitudeRange r;
+    for (p0 += m_width, p1 += m_width; p0 < p1; p0 /= 2, p1 /= 2) {
+        if (p0 & 1) r = combine(r, m_tree[p0++]);
+        if (p1 & 1) r = combine(r, m_tree[--p1]);
+    }
+    return r;
+}
+
+int
+ScrollableMagRangeCache::countLeaves(int p0, int p1) const
+{
+    int n = 0;
+    for (p0 += m_width, p1 += m_width; p0 < p1; p0 /= 2, p1 /= 2) {
+        if (p0 & 1) n += m_setCounts[p0++];
+        if (p1 & 1) n += m_setCounts[--p1];
+    }
+    return n;
+}
+
 void
 ScrollableMagRangeCache::scrollTo(const LayerGeometryProvider *v,
                                   sv_frame_t newStartFrame)
@@ -50,7 +144,7 @@ ScrollableMagRangeCache::scrollTo(const LayerGeometryProvider *v,
         return;
     }
         
-    int w = int(m_ranges.size());
+    int w = m_width;
 
     if (dx <= -w || dx >= w) {
         // scrolled entirely off
@@ -61,58 +155,120 @@ ScrollableMagRangeCache::scrollTo(const LayerGeometryProvider *v,
 
     count.partial();
         
-    // dx is in range, cache is scrollable
+    // dx is in range, cache is scrollable. As in ScrollableImageCache,
+    // a positive dx means the content moves right, leaving dx new
+    // columns at the left. Moving the origin moves every column at
+    // once; only the columns that have come into view need resetting.
 
     if (dx < 0) {
-        // The new start frame is to the left of the old start
-        // frame. We need to add some empty ranges at the left (start)
-        // end and clip the right end. Assemble -dx new values, then
-        // w+dx old values starting at index 0.
-
-        auto newRanges = vector<MagnitudeRange>(-dx);
-        newRanges.insert(newRanges.end(),
-                         m_ranges.begin(), m_ranges.begin() + (w + dx));
-        m_ranges = newRanges;
-        
-    } else {
         // The new start frame is to the right of the old start
-        // frame. We want to clip the left (start) end and add some
-        // empty ranges at the right end. Assemble w-dx old values
-        // starting at index dx, then dx new values.
-
-        auto newRanges = vector<MagnitudeRange>(dx);
-        newRanges.insert(newRanges.begin(),
-                         m_ranges.begin() + dx, m_ranges.end());
-        m_ranges = newRanges;
+        // frame. Column x now shows what was column x - dx, and the
+        // last -dx columns are new.
+        m_origin = (m_origin - dx) % w;
+        clearColumns(w + dx, -dx);
+    } else {
+        // The new start frame is to the left of the old start
+        // frame. Column x now shows what was column x - dx, and the
+        // first dx columns are new.
+        m_origin = (m_origin - dx + w) % w;
+        clearColumns(0, dx);
     }
 
 #ifdef DEBUG_SCROLLABLE_MAG_RANGE_CACHE
-    SVDEBUG << "maxes (" << m_ranges.size() << ") now: ";
-    for (int i = 0; in_range_for(m_ranges, i); ++i) {
-        SVDEBUG << m_ranges[i].getMax() << " ";
+    SVDEBUG << "maxes (" << w << ") now: ";
+    for (int i = 0; i < w; ++i) {
+        SVDEBUG << getRange(i).getMax() << " ";
     }
     SVDEBUG << endl;
 #endif
 }
 
+void
+ScrollableMagRangeCache::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+    int w = m_width;
+    
+    double px0 = m_zoomLevel.framesToPixels(double(from - m_startFrame));
+    double px1 = m_zoomLevel.framesToPixels(double(to - m_startFrame));
+    if (px1 < 0.0 || px0 > double(w)) {
+        return;
+    }
+
+    int x0 = int(floor(std::max(px0, -1.0))) - 1;
+    int x1 = int(ceil(std::min(px1, double(w)))) + 1;
+
+#ifdef DEBUG_SCROLLABLE_MAG_RANGE_CACHE
+    SVDEBUG << "ScrollableMagRangeCache::invalidateFrameRange: frames " << from
+            << " to " << to << " -> columns " << x0 << " to " << x1 << endl;
+#endif
+
+    clearColumns(x0, x1 - x0);
+}
+
+bool
+ScrollableMagRangeCache::areColumnsSet(int x, int count) const
+{
+    if (count <= 0) {
+        return true;
+    }
+    if (x < 0 || x + count > m_width) {
+        return false;
+    }
+    if (m_setCount == m_width) {
+        return true;
+    }
+    if (count == m_width) {
+        return false;
+    }
+    
+    int p0 = getLeaf(x) - m_width;
+    int p1 = p0 + count;
+    if (p1 <= m_width) {
+        return countLeaves(p0, p1) == count;
+    } else {
+        return countLeaves(p0, m_width) + countLeaves(0, p1 - m_width)
+            == count;
+    }
+}
+
+MagnitudeRange
+ScrollableMagRangeCache::getRange(int column) const
+{
+    if (column < 0 || column >= m_width) {
+        SVCERR << "ERROR: ScrollableMagRangeCache::getRange: column " << column
+               << " is out of range for cache of width " << m_width << endl;
+        throw logic_error("column out of range");
+    }
+    return m_tree[getLeaf(column)];
+}
+
 MagnitudeRange
 ScrollableMagRangeCache::getRange(int x, int count) const
 {
-    MagnitudeRange r;
 #ifdef DEBUG_SCROLLABLE_MAG_RANGE_CACHE
     SVDEBUG << "ScrollableMagRangeCache::getRange(" << x << ", " << count << ")" << endl;
 #endif
-    for (int i = 0; i < count; ++i) {
-        const auto &cr = m_ranges.at(x + i);
-        if (cr.isSet()) {
-            r.sample(cr);
-        }
-#ifdef DEBUG_SCROLLABLE_MAG_RANGE_CACHE
-        SVDEBUG << cr.getMin() << "->" << cr.getMax() << " ";
-#endif
+    if (count <= 0) {
+        return {};
+    }
+    if (x < 0 || x + count > m_width) {
+        SVCERR << "ERROR: ScrollableMagRangeCache::getRange: columns " << x
+               << " to " << x + count << " are out of range for cache of width "
+               << m_width << endl;
+        throw logic_error("column out of range");
     }
+
+    MagnitudeRange r;
+    int p0 = getLeaf(x) - m_width;
+    int p1 = p0 + count;
+    if (p1 <= m_width) {
+        r = queryLeaves(p0, p1);
+    } else {
+        r = combine(queryLeaves(p0, m_width), queryLeaves(0, p1 - m_width));
+    }
+    
 #ifdef DEBUG_SCROLLABLE_MAG_RANGE_CACHE
-    SVDEBUG << endl;
+    SVDEBUG << "-> " << r.getMin() << "->" << r.getMax() << endl;
 #endif
     return r;
 }
@@ -120,13 +276,13 @@ ScrollableMagRangeCache::getRange(int x, int count) const
 void
 ScrollableMagRangeCache::sampleColumn(int column, const MagnitudeRange &r)
 {
-    if (!in_range_for(m_ranges, column)) {
+    if (column < 0 || column >= m_width) {
         SVCERR << "ERROR: ScrollableMagRangeCache::sampleColumn: column " << column
-               << " is out of range for cache of width " << m_ranges.size()
+               << " is out of range for cache of width " << m_width
                << " (with start frame " << m_startFrame << ")" << endl;
         throw logic_error("column out of range");
     } else {
-        m_ranges[column].sample(r);
+        int leaf = getLeaf(column);
+        setLeaf(leaf, combine(m_tree[leaf], r));
     }
 }
-
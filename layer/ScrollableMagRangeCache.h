@@ -29,6 +29,14 @@
  * of ranges, and can report and update which columns have had a range
  * specified.
  *
+ * The ranges are held as the leaves of a segment tree, each internal
+ * node of which holds the union of the ranges beneath it and a count
+ * of how many of them are set. Updating a column and querying the
+ * range or set-ness of any span of columns are therefore O(log n) in
+ * the width rather than linear. The leaves are addressed circularly
+ * from a movable origin, so scrolling does not move any data: it
+ * only resets the columns that have scrolled into view.
+ *
  * The only way to *update* the valid area in a cache is to update the
  * magnitude range for a column using the sampleColumn call.
  */
@@ -36,15 +44,28 @@ class ScrollableMagRangeCache
 {
 public:
     ScrollableMagRangeCache() :
+        m_width(0),
+        m_origin(0),
+        m_setCount(0),
         m_startFrame(0)
     {}
 
     void invalidate() {
-        m_ranges = std::vector<MagnitudeRange>(m_ranges.size());
+        m_tree = std::vector<MagnitudeRange>(m_tree.size());
+        m_setCounts = std::vector<int>(m_setCounts.size(), 0);
+        m_setCount = 0;
+        m_origin = 0;
     }
+
+    /**
+     * Invalidate the columns that show the given range of frames,
+     * according to the current start frame and zoom level, together
+     * with a column either side.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
     
     int getWidth() const {
-        return int(m_ranges.size());
+        return m_width;
     }
 
     /**
@@ -53,7 +74,11 @@ public:
      */
     void resize(int newWidth) {
         if (getWidth() != newWidth) {
-            m_ranges = std::vector<MagnitudeRange>(newWidth);
+            m_width = newWidth;
+            m_tree = std::vector<MagnitudeRange>(size_t(newWidth) * 2);
+            m_setCounts = std::vector<int>(size_t(newWidth) * 2, 0);
+            m_setCount = 0;
+            m_origin = 0;
         }
     }
         
@@ -93,25 +118,24 @@ public:
     }
 
     bool isColumnSet(int column) const {
-        return in_range_for(m_ranges, column) && m_ranges.at(column).isSet();
+        return column >= 0 && column < m_width &&
+            m_tree[getLeaf(column)].isSet();
     }
 
-    bool areColumnsSet(int x, int count) const {
-        for (int i = 0; i < count; ++i) {
-            if (!isColumnSet(x + i)) return false;
-        }
-        return true;
-    }
+    /**
+     * Return true if every column in the given span has been set. This
+     * is O(1) if the whole cache is set, O(log n) otherwise.
+     */
+    bool areColumnsSet(int x, int count) const;
     
     /**
      * Get the magnitude range for a single column.
      */
-    MagnitudeRange getRange(int column) const {
-        return m_ranges.at(column);
-    }
+    MagnitudeRange getRange(int column) const;
 
     /**
-     * Get the magnitude range for a range of columns.
+     * Get the magnitude range for a range of columns, i.e. the union
+     * of the ranges of those columns that have been set.
      */
     MagnitudeRange getRange(int x, int count) const;
     
@@ -131,9 +155,29 @@ public:
     void sampleColumn(int column, const MagnitudeRange &r);
     
 private:
-    std::vector<MagnitudeRange> m_ranges;
+    int m_width;
+    int m_origin; // leaf offset of column 0
+    std::vector<MagnitudeRange> m_tree; // 2 * m_width nodes, leaves last
+    std::vector<int> m_setCounts; // set leaves beneath each node
+    int m_setCount;
     sv_frame_t m_startFrame;
     ZoomLevel m_zoomLevel;
+
+    int getLeaf(int column) const {
+        int p = column + m_origin;
+        if (p >= m_width) p -= m_width;
+        return m_width + p;
+    }
+
+    static MagnitudeRange combine(const MagnitudeRange &a,
+                                  const MagnitudeRange &b);
+
+    void setLeaf(int leaf, const MagnitudeRange &r);
+    void clearColumns(int x, int count);
+    void rebuild();
+
+    MagnitudeRange queryLeaves(int p0, int p1) const;
+    int countLeaves(int p0, int p1) const;
 };
 
 #endif
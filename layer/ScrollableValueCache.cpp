@@ -0,0 +1,244 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ScrollableValueCache.h"
+
+#include "base/HitCount.h"
+#include "base/Debug.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+//#define DEBUG_SCROLLABLE_VALUE_CACHE 1
+
+void
+ScrollableValueCache::resize(QSize newSize)
+{
+    if (getSize() == newSize) {
+        return;
+    }
+
+    m_indices = QImage(newSize, QImage::Format_Indexed8);
+    m_indices.setColorCount(256);
+    m_indices.fill(0);
+
+    m_values = vector<float>(size_t(newSize.width()) * newSize.height());
+    m_states = vector<ColumnState>(newSize.width(), ColumnState::Unset);
+}
+
+void
+ScrollableValueCache::scrollTo(const LayerGeometryProvider *v,
+                               sv_frame_t newStartFrame)
+{
+    static HitCount count("ScrollableValueCache: scrolling");
+
+    int dx = (v->getXForFrame(m_startFrame) -
+              v->getXForFrame(newStartFrame));
+
+#ifdef DEBUG_SCROLLABLE_VALUE_CACHE
+    SVDEBUG << "ScrollableValueCache::scrollTo: start frame " << m_startFrame
+            << " -> " << newStartFrame << ", dx = " << dx << endl;
+#endif
+
+    if (m_startFrame == newStartFrame) {
+        // haven't moved
+        count.hit();
+        return;
+    }
+
+    m_startFrame = newStartFrame;
+
+    if (dx == 0) {
+        // haven't moved visibly (even though start frame may have changed)
+        count.hit();
+        return;
+    }
+
+    int w = int(m_states.size());
+
+    if (dx <= -w || dx >= w) {
+        // scrolled entirely off
+        invalidate();
+        count.miss();
+        return;
+    }
+
+    count.partial();
+
+    // dx is in range, cache is scrollable. A positive dx means the
+    // content moves right, so view column x now shows what was in
+    // column x - dx: move the origin to match, leaving the data where
+    // it is, and mark the dx newly exposed columns as unset
+
+    m_origin = (m_origin - dx) % w;
+    if (m_origin < 0) m_origin += w;
+
+    if (dx < 0) {
+        clearColumns(w + dx, -dx);
+    } else {
+        clearColumns(0, dx);
+    }
+}
+
+QImage
+ScrollableValueCache::getIndexImage() const
+{
+    if (m_origin == 0) {
+        return m_indices;
+    }
+
+    int w = m_indices.width();
+    int h = m_indices.height();
+    int seam = w - m_origin;
+
+    QImage image(m_indices.size(), QImage::Format_Indexed8);
+    image.setColorCount(256);
+
+    for (int y = 0; y < h; ++y) {
+        const uchar *source = m_indices.constScanLine(y);
+        uchar *target = image.scanLine(y);
+        memcpy(target, source + m_origin, seam);
+        memcpy(target + seam, source, m_origin);
+    }
+
+    return image;
+}
+
+void
+ScrollableValueCache::drawColumns(int left,
+                                  int width,
+                                  const QImage &indices,
+                                  int imageLeft,
+                                  const float *values,
+                                  const ColumnState *states)
+{
+    int h = m_indices.height();
+
+    if (indices.height() != h) {
+        SVCERR << "ScrollableValueCache::drawColumns: ERROR: Supplied image height "
+               << indices.height() << " does not match cache height "
+               << h << endl;
+        throw std::logic_error("Image height must match cache height in ScrollableValueCache::drawColumns");
+    }
+    if (indices.format() != QImage::Format_Indexed8) {
+        throw std::logic_error("Image must be 8-bit indexed in ScrollableValueCache::drawColumns");
+    }
+    if (left < 0 || width < 0 || left + width > int(m_states.size())) {
+        SVCERR << "ScrollableValueCache::drawColumns: ERROR: Target area (left = "
+               << left << ", width = " << width << ", so right = " << left + width
+               << ") out of bounds for cache of width " << m_states.size() << endl;
+        throw std::logic_error("Target area out of bounds in ScrollableValueCache::drawColumns");
+    }
+    if (imageLeft < 0 || imageLeft + width > indices.width()) {
+        SVCERR << "ScrollableValueCache::drawColumns: ERROR: Source area (left = "
+               << imageLeft << ", width = " << width << ", so right = "
+               << imageLeft + width << ") out of bounds for image of "
+               << "width " << indices.width() << endl;
+        throw std::logic_error("Source area out of bounds in ScrollableValueCache::drawColumns");
+    }
+
+    // The target may straddle the wrap point, in which case it is
+    // copied as two runs, one either side of it
+
+    int seam = int(m_states.size()) - m_origin;
+    size_t hs = size_t(h);
+
+    int done = 0;
+    while (done < width) {
+        int x = left + done;
+        int run = width - done;
+        if (x < seam) {
+            run = std::min(run, seam - x);
+        }
+        int target = storageColumn(x);
+        int source = imageLeft + done;
+
+        for (int y = 0; y < h; ++y) {
+            memcpy(m_indices.scanLine(y) + target,
+                   indices.constScanLine(y) + source,
+                   run);
+        }
+
+        for (int i = 0; i < run; ++i) {
+            ColumnState state = states[source + i];
+            m_states[target + i] = state;
+            if (state == ColumnState::HasValues) {
+                const float *column = values + (source + i) * hs;
+                copy(column, column + hs,
+                     m_values.begin() + (target + i) * hs);
+            }
+        }
+
+        done += run;
+    }
+}
+
+void
+ScrollableValueCache::clearColumns(int left, int width)
+{
+    for (int i = 0; i < width; ++i) {
+        if (in_range_for(m_states, left + i)) {
+            m_states[storageColumn(left + i)] = ColumnState::Unset;
+        }
+    }
+}
+
+void
+ScrollableValueCache::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+    int w = int(m_states.size());
+    
+    double px0 = m_zoomLevel.framesToPixels(double(from - m_startFrame));
+    double px1 = m_zoomLevel.framesToPixels(double(to - m_startFrame));
+    if (px1 < 0.0 || px0 > double(w)) {
+        return;
+    }
+
+    int x0 = int(floor(std::max(px0, -1.0))) - 1;
+    int x1 = int(ceil(std::min(px1, double(w)))) + 1;
+
+    clearColumns(x0, x1 - x0);
+}
+
+void
+ScrollableValueCache::remap(const ColourScale &scale, bool invertVertical)
+{
+    int h = m_indices.height();
+    if (h == 0) {
+        return;
+    }
+
+    // Write each column straight into the scanlines, as when
+    // rendering it in the first place
+
+    uchar *bits = m_indices.bits();
+    ptrdiff_t bpl = m_indices.bytesPerLine();
+    size_t hs = size_t(h);
+
+    for (int x = 0; in_range_for(m_states, x); ++x) {
+        int sx = storageColumn(x);
+        if (m_states[sx] != ColumnState::HasValues) {
+            continue;
+        }
+        const float *column = m_values.data() + sx * hs;
+        if (invertVertical) {
+            scale.getPixels(column, h, bits + sx, bpl);
+        } else {
+            scale.getPixels(column, h, bits + (h - 1) * bpl + sx, -bpl);
+        }
+    }
+}
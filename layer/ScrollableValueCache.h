@@ -0,0 +1,209 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SCROLLABLE_VALUE_CACHE_H
+#define SCROLLABLE_VALUE_CACHE_H
+
+#include "base/BaseTypes.h"
+
+#include "ColourScale.h"
+#include "LayerGeometryProvider.h"
+
+#include <QImage>
+#include <QSize>
+
+#include <vector>
+
+/**
+ * A cached set of per-pixel values for a view that scrolls
+ * horizontally, such as a spectrogram. For each column of the view
+ * the cache holds the value that was mapped to each pixel, together
+ * with the colour index it was mapped to, so that a rendering of
+ * those values can be recoloured (with a new colour map) or remapped
+ * (with a new gain or threshold) without going back to the source
+ * data.
+ *
+ * This is intended to be kept alongside a ScrollableImageCache, with
+ * the same size, zoom level and start frame. Like
+ * ScrollableMagRangeCache it records which columns have been set
+ * rather than a single valid range.
+ *
+ * As in ScrollableImageCache, the indices, values and column states
+ * are held as ring buffers sharing a single origin, so scrolling
+ * moves the origin rather than the data and only marks the newly
+ * exposed columns as unset. All column coordinates in the API are
+ * view coordinates.
+ *
+ * The only way to *update* the cache is to draw to it using the
+ * drawColumns call.
+ */
+class ScrollableValueCache
+{
+public:
+    /**
+     * What is known about a single column: nothing; that it is blank,
+     * i.e. there was no source data and every pixel has colour index
+     * 0; or its values.
+     */
+    enum class ColumnState : char {
+        Unset,
+        Blank,
+        HasValues
+    };
+
+    ScrollableValueCache() :
+        m_origin(0),
+        m_startFrame(0)
+    {}
+
+    void invalidate() {
+        m_states = std::vector<ColumnState>(m_states.size(),
+                                            ColumnState::Unset);
+        m_origin = 0;
+    }
+
+    QSize getSize() const {
+        return m_indices.size();
+    }
+
+    /**
+     * Set the size of the cache. If the new size differs from the
+     * current size, the cache is invalidated.
+     */
+    void resize(QSize newSize);
+
+    ZoomLevel getZoomLevel() const {
+        return m_zoomLevel;
+    }
+
+    /**
+     * Set the zoom level. If the new zoom level differs from the
+     * current one, the cache is invalidated.
+     */
+    void setZoomLevel(ZoomLevel zoom) {
+        using namespace std::rel_ops;
+        if (m_zoomLevel != zoom) {
+            m_zoomLevel = zoom;
+            invalidate();
+        }
+    }
+
+    sv_frame_t getStartFrame() const {
+        return m_startFrame;
+    }
+
+    /**
+     * Set the start frame. If the new start frame differs from the
+     * current one, the cache is invalidated. To scroll, i.e. to set
+     * the start frame while retaining cache validity where possible,
+     * use scrollTo() instead.
+     */
+    void setStartFrame(sv_frame_t frame) {
+        if (m_startFrame != frame) {
+            m_startFrame = frame;
+            invalidate();
+        }
+    }
+
+    bool isColumnSet(int column) const {
+        return in_range_for(m_states, column) &&
+            m_states[storageColumn(column)] != ColumnState::Unset;
+    }
+
+    bool areColumnsSet(int x, int count) const {
+        if (x < 0 || count < 0 || x + count > int(m_states.size())) {
+            return false;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (m_states[storageColumn(x + i)] == ColumnState::Unset) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Return the colour indices for the whole cache, in view order,
+     * as an 8-bit indexed image of the cache size. If the cache has
+     * not been scrolled since it was last invalidated this is a
+     * shallow copy of the underlying image; otherwise the two parts
+     * either side of the wrap point are reassembled into a new
+     * image. The colour table of the image is not meaningful;
+     * callers should set their own.
+     */
+    QImage getIndexImage() const;
+
+    /**
+     * Set the new start frame for the cache, according to the
+     * geometry of the supplied LayerGeometryProvider, if possible
+     * also moving along any existing columns within the cache so
+     * that they continue to be valid for the new start frame.
+     */
+    void scrollTo(const LayerGeometryProvider *v, sv_frame_t newStartFrame);
+
+    /**
+     * Update a range of columns in the cache. The colour indices are
+     * copied from the given 8-bit indexed image, which must have the
+     * same height h as the cache. The values array holds h values
+     * for each column of the image in turn, in the order in which
+     * they were passed to ColourScale::getPixels, and the states
+     * array holds one state per column of the image. The left and
+     * width parameters determine the target columns of the cache,
+     * imageLeft the first source column of the image.
+     */
+    void drawColumns(int left,
+                     int width,
+                     const QImage &indices,
+                     int imageLeft,
+                     const float *values,
+                     const ColumnState *states);
+
+    /**
+     * Mark a range of columns as unset, for example because the
+     * corresponding area of the image cache has been drawn from
+     * something other than a column of values.
+     */
+    void clearColumns(int left, int width);
+
+    /**
+     * Mark the columns that show the given range of frames as unset,
+     * according to the current start frame and zoom level, together
+     * with a column either side.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
+
+    /**
+     * Recalculate the colour indices of every column that has values,
+     * using the given colour scale. If invertVertical is false, the
+     * first value in each column maps to the bottom row; otherwise
+     * to the top.
+     */
+    void remap(const ColourScale &scale, bool invertVertical);
+
+private:
+    QImage m_indices;
+    std::vector<float> m_values; // column-major, height() values per column
+    std::vector<ColumnState> m_states;
+    int m_origin; // storage column holding view column 0
+    sv_frame_t m_startFrame;
+    ZoomLevel m_zoomLevel;
+
+    int storageColumn(int column) const {
+        int p = column + m_origin;
+        int w = int(m_states.size());
+        return (p >= w ? p - w : p);
+    }
+};
+
+#endif
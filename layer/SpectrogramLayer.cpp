@@ -45,6 +45,7 @@
 #include <QMouseEvent>
 #include <QTextStream>
 #include <QSettings>
+#include <QThread>
 
 #include <iostream>
 
@@ -181,9 +182,15 @@ void
 SpectrogramLayer::deleteDerivedModels()
 {
     ModelById::release(m_fftModel);
+    ModelById::release(m_renderFftModel);
     ModelById::release(m_peakCache);
     ModelById::release(m_wholeCache);
 
+    for (const auto &ws: m_renderWorkerSources) {
+        ModelById::release(ws.model);
+    }
+    m_renderWorkerSources.clear();
+
     for (auto exporterId: m_exporters) {
         if (auto exporter =
             ModelById::getAs<Colour3DPlotExporter>(exporterId)) {
@@ -194,6 +201,7 @@ SpectrogramLayer::deleteDerivedModels()
     m_exporters.clear();
     
     m_fftModel = {};
+    m_renderFftModel = {};
     m_peakCache = {};
     m_wholeCache = {};
 }
@@ -741,6 +749,37 @@ SpectrogramLayer::invalidateRenderers()
     m_renderers.clear();
 }
 
+void
+SpectrogramLayer::recolourRenderer(int viewId) const
+{
+    auto i = m_renderers.find(viewId);
+    if (i == m_renderers.end()) return;
+    
+    ColourScale::Parameters cparams = getColourScaleParameters(viewId);
+
+    m_lastRenderedMags[viewId] = MagnitudeRange(float(cparams.minValue),
+                                                float(cparams.maxValue));
+
+    i->second->setColourScale(ColourScale(cparams), m_colourRotation);
+}
+
+void
+SpectrogramLayer::recolourRenderers()
+{
+#ifdef DEBUG_SPECTROGRAM
+    cerr << "SpectrogramLayer::recolourRenderers called" << endl;
+#endif
+
+    for (ViewRendererMap::iterator i = m_renderers.begin();
+         i != m_renderers.end(); ++i) {
+        recolourRenderer(i->first);
+    }
+
+    m_crosshairColour =
+        ColourMapper(m_colourMap, m_colourInverted, 1.f, 255.f)
+        .getContrastingColour();
+}
+
 void
 SpectrogramLayer::preferenceChanged(PropertyContainer::PropertyName name)
 {
@@ -865,9 +904,9 @@ SpectrogramLayer::setGain(float gain)
 
     if (m_gain == gain) return;
 
-    invalidateRenderers();
-    
     m_gain = gain;
+
+    recolourRenderers();
     
     emit layerParametersChanged();
 }
@@ -883,10 +922,10 @@ SpectrogramLayer::setThreshold(float threshold)
 {
     if (m_threshold == threshold) return;
 
-    invalidateRenderers();
-    
     m_threshold = threshold;
 
+    recolourRenderers();
+
     emit layerParametersChanged();
 }
 
@@ -957,11 +996,9 @@ SpectrogramLayer::setColourRotation(int r)
         m_colourRotation = r;
     }
 
-    // Initially the idea with colour rotation was that we would just
-    // rotate the palette of an already-generated cache. That's not
-    // really practical now that cacheing is handled in a separate
-    // class in which the main cache no longer has a palette.
-    invalidateRenderers();
+    // The renderers retain the colour indices behind their caches,
+    // so this only replaces the palette
+    recolourRenderers();
     
     emit layerParametersChanged();
 }
@@ -989,9 +1026,9 @@ SpectrogramLayer::setColourScaleMultiple(double multiple)
 {
     if (m_colourScaleMultiple == multiple) return;
 
-    invalidateRenderers();
-    
     m_colourScaleMultiple = multiple;
+
+    recolourRenderers();
     
     emit layerParametersChanged();
 }
@@ -1007,10 +1044,10 @@ SpectrogramLayer::setColourMap(int map)
 {
     if (m_colourMap == map) return;
 
-    invalidateRenderers();
-    
     m_colourMap = map;
 
+    recolourRenderers();
+
     emit layerParametersChanged();
 }
 
@@ -1135,29 +1172,36 @@ SpectrogramLayer::cacheInvalid(ModelId)
 }
 
 void
-SpectrogramLayer::cacheInvalid(
-    ModelId,
-#ifdef DEBUG_SPECTROGRAM_REPAINT
-    sv_frame_t from, sv_frame_t to
-#else 
-    sv_frame_t     , sv_frame_t
-#endif
-    )
+SpectrogramLayer::cacheInvalid(ModelId, sv_frame_t from, sv_frame_t to)
 {
 #ifdef DEBUG_SPECTROGRAM_REPAINT
     cerr << "SpectrogramLayer::cacheInvalid(" << from << ", " << to << ")" << endl;
 #endif
 
-    // We used to call invalidateMagnitudes(from, to) to invalidate
-    // only those caches whose views contained some of the (from, to)
-    // range. That's the right thing to do; it has been lost in
-    // pulling out the image cache code, but it might not matter very
-    // much, since the underlying models for spectrogram layers don't
-    // change very often. Let's see.
-    invalidateRenderers();
+    // Only the part of each renderer's cache showing the (from, to)
+    // range need be rendered again. But each FFT column draws on a
+    // whole window of frames, so a change affects every column whose
+    // window overlaps it, which at zoom levels below the window size
+    // reaches several columns either side. The visible-area
+    // magnitudes are cheap to rebuild from the renderers' range
+    // caches on the next paint.
+    sv_frame_t extent = m_windowSize;
+    for (ViewRendererMap::iterator i = m_renderers.begin();
+         i != m_renderers.end(); ++i) {
+        i->second->invalidateFrameRange(from - extent, to + extent);
+    }
     invalidateMagnitudes();
 }
 
+void
+SpectrogramLayer::backgroundTileReady(int viewId, QRect rect)
+{
+    auto i = m_renderingViews.find(viewId);
+    if (i != m_renderingViews.end() && i->second) {
+        i->second->updatePaintRect(rect);
+    }
+}
+
 bool
 SpectrogramLayer::hasLightBackground() const 
 {
@@ -1459,6 +1503,10 @@ SpectrogramLayer::recreateFFTModel()
 {
     SVDEBUG << "SpectrogramLayer::recreateFFTModel called" << endl;
 
+    // Renderers may still be reading from the old models in the
+    // background
+    invalidateRenderers();
+
     { // scope, avoid hanging on to this pointer
         auto model = ModelById::getAs<DenseTimeValueModel>(m_model);
         if (!model || !model->isOK()) {
@@ -1476,7 +1524,14 @@ SpectrogramLayer::recreateFFTModel()
                                                   getWindowIncrement(),
                                                   getFFTSize());
 
-    if (!newFFTModel->isOK()) {
+    auto newRenderFFTModel = std::make_shared<FFTModel>(m_model,
+                                                        m_channel,
+                                                        m_windowType,
+                                                        m_windowSize,
+                                                        getWindowIncrement(),
+                                                        getFFTSize());
+
+    if (!newFFTModel->isOK() || !newRenderFFTModel->isOK()) {
         QMessageBox::critical
             (nullptr, tr("FFT cache failed"),
              tr("Failed to create the FFT model for this spectrogram.\n"
@@ -1486,25 +1541,50 @@ SpectrogramLayer::recreateFFTModel()
 
     if (m_verticallyFixed) {
         newFFTModel->setMaximumFrequency(getMaxFrequency());
+        newRenderFFTModel->setMaximumFrequency(getMaxFrequency());
     }
     
     m_fftModel = ModelById::add(newFFTModel);
+    m_renderFftModel = ModelById::add(newRenderFFTModel);
+    m_renderSourceLock = std::make_shared<QMutex>();
+
+    // Reading a column is where the FFT is calculated, so renderers
+    // working in parallel get an FFTModel for each worker as well
+    int threads = QThread::idealThreadCount();
+    if (threads > 1) {
+        for (int i = 0; i < threads; ++i) {
+            auto workerModel = std::make_shared<FFTModel>(m_model,
+                                                          m_channel,
+                                                          m_windowType,
+                                                          m_windowSize,
+                                                          getWindowIncrement(),
+                                                          getFFTSize());
+            if (!workerModel->isOK()) {
+                break;
+            }
+            if (m_verticallyFixed) {
+                workerModel->setMaximumFrequency(getMaxFrequency());
+            }
+            m_renderWorkerSources.push_back
+                ({ ModelById::add(workerModel), std::make_shared<QMutex>() });
+        }
+    }
 
     bool createWholeCache = false;
     checkCacheSpace(&m_peakCacheDivisor, &createWholeCache);
     
     if (createWholeCache) {
 
-        auto whole = std::make_shared<Dense3DModelPeakCache>(m_fftModel, 1);
+        auto whole = std::make_shared<Dense3DModelPeakCache>(m_renderFftModel, 1);
         m_wholeCache = ModelById::add(whole);
 
-        auto peaks = std::make_shared<Dense3DModelPeakCache>(m_fftModel,
+        auto peaks = std::make_shared<Dense3DModelPeakCache>(m_renderFftModel,
                                                              m_peakCacheDivisor);
         m_peakCache = ModelById::add(peaks);
 
     } else {
 
-        auto peaks = std::make_shared<Dense3DModelPeakCache>(m_fftModel,
+        auto peaks = std::make_shared<Dense3DModelPeakCache>(m_renderFftModel,
                                                              m_peakCacheDivisor);
         m_peakCache = ModelById::add(peaks);
     }
@@ -1573,6 +1653,43 @@ SpectrogramLayer::setSynchronousPainting(bool synchronous)
     m_synchronous = synchronous;
 }
 
+ColourScale::Parameters
+SpectrogramLayer::getColourScaleParameters(int viewId) const
+{
+    ColourScale::Parameters cparams;
+    cparams.colourMap = m_colourMap;
+    cparams.scaleType = m_colourScale;
+    cparams.multiple = m_colourScaleMultiple;
+
+    if (m_colourScale != ColourScaleType::Phase) {
+        cparams.gain = m_gain;
+        cparams.threshold = m_threshold;
+    }
+
+    double minValue = 0.0f;
+    double maxValue = 1.0f;
+        
+    if (m_normalizeVisibleArea && m_viewMags[viewId].isSet()) {
+        minValue = m_viewMags[viewId].getMin();
+        maxValue = m_viewMags[viewId].getMax();
+    } else if (m_colourScale == ColourScaleType::Linear &&
+               m_normalization == ColumnNormalization::None) {
+        maxValue = 0.1f;
+    }
+
+    if (maxValue <= minValue) {
+        maxValue = minValue + 0.1f;
+    }
+    if (maxValue <= m_threshold) {
+        maxValue = m_threshold + 0.1f;
+    }
+
+    cparams.minValue = minValue;
+    cparams.maxValue = maxValue;
+
+    return cparams;
+}
+
 Colour3DPlotRenderer *
 SpectrogramLayer::getRenderer(LayerGeometryProvider *v) const
 {
@@ -1582,44 +1699,17 @@ SpectrogramLayer::getRenderer(LayerGeometryProvider *v) const
 
         Colour3DPlotRenderer::Sources sources;
         sources.verticalBinLayer = this;
-        sources.fft = m_fftModel;
+        sources.fft = m_renderFftModel;
         sources.source = sources.fft;
         if (!m_peakCache.isNone()) sources.peakCaches.push_back(m_peakCache);
         if (!m_wholeCache.isNone()) sources.peakCaches.push_back(m_wholeCache);
+        sources.sourceLock = m_renderSourceLock;
+        sources.workerSources = m_renderWorkerSources;
 
-        ColourScale::Parameters cparams;
-        cparams.colourMap = m_colourMap;
-        cparams.scaleType = m_colourScale;
-        cparams.multiple = m_colourScaleMultiple;
+        ColourScale::Parameters cparams = getColourScaleParameters(viewId);
 
-        if (m_colourScale != ColourScaleType::Phase) {
-            cparams.gain = m_gain;
-            cparams.threshold = m_threshold;
-        }
-
-        double minValue = 0.0f;
-        double maxValue = 1.0f;
-        
-        if (m_normalizeVisibleArea && m_viewMags[viewId].isSet()) {
-            minValue = m_viewMags[viewId].getMin();
-            maxValue = m_viewMags[viewId].getMax();
-        } else if (m_colourScale == ColourScaleType::Linear &&
-                   m_normalization == ColumnNormalization::None) {
-            maxValue = 0.1f;
-        }
-
-        if (maxValue <= minValue) {
-            maxValue = minValue + 0.1f;
-        }
-        if (maxValue <= m_threshold) {
-            maxValue = m_threshold + 0.1f;
-        }
-
-        cparams.minValue = minValue;
-        cparams.maxValue = maxValue;
-
-        m_lastRenderedMags[viewId] = MagnitudeRange(float(minValue),
-                                                    float(maxValue));
+        m_lastRenderedMags[viewId] = MagnitudeRange(float(cparams.minValue),
+                                                    float(cparams.maxValue));
 
         Colour3DPlotRenderer::Parameters params;
         params.colourScale = ColourScale(cparams);
@@ -1641,6 +1731,8 @@ SpectrogramLayer::getRenderer(LayerGeometryProvider *v) const
         params.interpolate = 
             (smoothing != Preferences::NoSpectrogramSmoothing);
 
+        params.threadCount = QThread::idealThreadCount();
+
         m_renderers[viewId] = new Colour3DPlotRenderer(sources, params);
 
         m_crosshairColour =
@@ -1672,17 +1764,35 @@ SpectrogramLayer::paintWithRenderer(LayerGeometryProvider *v, QPainter &paint, Q
 
     } else {
 
-        result = renderer->renderTimeConstrained(v, paint, rect);
+        // The renderer calls back from its render thread when a tile
+        // is ready; we then repaint the tile's area of the view from
+        // the GUI thread
+        m_renderingViews[viewId] = v->getView();
+        QObject *receiver = const_cast<SpectrogramLayer *>(this);
+        
+        result = renderer->renderInBackground
+            (v, paint, rect,
+             [receiver, viewId](QRect tileRect) {
+                 QMetaObject::invokeMethod(receiver, "backgroundTileReady",
+                                           Qt::QueuedConnection,
+                                           Q_ARG(int, viewId),
+                                           Q_ARG(QRect, tileRect));
+             });
 
 #ifdef DEBUG_SPECTROGRAM_REPAINT
         cerr << "rect width from this paint: " << result.rendered.width()
              << ", mag range in this paint: " << result.range.getMin() << " -> "
              << result.range.getMax() << endl;
 #endif
-        
-        QRect uncached = renderer->getLargestUncachedRect(v);
-        if (uncached.width() > 0) {
-            v->updatePaintRect(uncached);
+
+        // If nothing is rendering in the background, the renderer
+        // fell back to a time-constrained render and we must ask for
+        // the remainder ourselves
+        if (!renderer->isRenderingInBackground()) {
+            QRect uncached = renderer->getLargestUncachedRect(v);
+            if (uncached.width() > 0) {
+                v->updatePaintRect(uncached);
+            }
         }
     }
 
@@ -1701,11 +1811,10 @@ SpectrogramLayer::paintWithRenderer(LayerGeometryProvider *v, QPainter &paint, Q
     if (!continuingPaint && m_normalizeVisibleArea &&
         m_viewMags[viewId] != m_lastRenderedMags[viewId]) {
 #ifdef DEBUG_SPECTROGRAM_REPAINT
-        cerr << "mag range has changed from last rendered range: re-rendering"
+        cerr << "mag range has changed from last rendered range: recolouring"
              << endl;
 #endif
-        delete m_renderers[viewId];
-        m_renderers.erase(viewId);
+        recolourRenderer(viewId);
         v->updatePaintRect(v->getPaintRect());
     }
 }
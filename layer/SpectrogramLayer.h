@@ -34,6 +34,7 @@
 #include <QWaitCondition>
 #include <QImage>
 #include <QPixmap>
+#include <QPointer>
 
 class View;
 class QPainter;
@@ -120,6 +121,14 @@ public:
 
     void setOversampling(int oversampling);
     int getOversampling() const;
+
+    int getWindowIncrement() const {
+        if (m_windowHopLevel == 0) return m_windowSize;
+        else if (m_windowHopLevel == 1) return (m_windowSize * 3) / 4;
+        else return m_windowSize / (1 << (m_windowHopLevel - 1));
+    }
+
+    int getFFTSize() const; // m_windowSize * getOversampling()
     
     void setWindowType(WindowType type);
     WindowType getWindowType() const;
@@ -263,6 +272,8 @@ protected slots:
     
     void preferenceChanged(PropertyContainer::PropertyName name);
 
+    void backgroundTileReady(int viewId, QRect rect);
+
 protected:
     ModelId m_model; // a DenseTimeValueModel
 
@@ -320,20 +331,23 @@ protected:
     bool getXYBinSourceRange(LayerGeometryProvider *v, int x, int y, double &min, double &max,
                              double &phaseMin, double &phaseMax) const;
 
-    int getWindowIncrement() const {
-        if (m_windowHopLevel == 0) return m_windowSize;
-        else if (m_windowHopLevel == 1) return (m_windowSize * 3) / 4;
-        else return m_windowSize / (1 << (m_windowHopLevel - 1));
-    }
-
-    int getFFTSize() const; // m_windowSize * getOversampling()
-
     // We take responsibility for registering/deregistering these
     // models and caches with ModelById
     ModelId m_fftModel; // an FFTModel
-    ModelId m_wholeCache; // a Dense3DModelPeakCache
-    ModelId m_peakCache; // a Dense3DModelPeakCache
+    ModelId m_renderFftModel; // an FFTModel, used only by renderers
+    ModelId m_wholeCache; // a Dense3DModelPeakCache, of m_renderFftModel
+    ModelId m_peakCache; // a Dense3DModelPeakCache, of m_renderFftModel
     int m_peakCacheDivisor;
+
+    // Renderers may read their models from background threads, so
+    // they get an FFTModel of their own (FFTModel is not reentrant)
+    // and share this lock for access to it and to the peak caches
+    std::shared_ptr<QMutex> m_renderSourceLock;
+
+    // Further FFTModels of the same input, with a lock each, one per
+    // render thread, for renderers to read from in parallel
+    std::vector<Colour3DPlotRenderer::Sources::WorkerSource>
+    m_renderWorkerSources;
     
     mutable std::vector<ModelId> m_exporters; // used, waiting to be released
     
@@ -348,9 +362,16 @@ protected:
 
     typedef std::map<int, Colour3DPlotRenderer *> ViewRendererMap; // key is view id
     mutable ViewRendererMap m_renderers;
+    mutable std::map<int, QPointer<View>> m_renderingViews; // key is view id
     Colour3DPlotRenderer *getRenderer(LayerGeometryProvider *) const;
     void invalidateRenderers();
 
+    // For changes that affect only the colour scale: existing
+    // renderers keep their caches and recolour them
+    ColourScale::Parameters getColourScaleParameters(int viewId) const;
+    void recolourRenderer(int viewId) const;
+    void recolourRenderers();
+
     void deleteDerivedModels();
     
     void paintWithRenderer(LayerGeometryProvider *v, QPainter &paint, QRect rect) const;
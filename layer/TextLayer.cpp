@@ -31,9 +31,15 @@
 
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+
+static const int labelMaxWidth = 150;
+static const int labelMaxHeight = 200;
+static const int labelLayoutCacheSize = 4096;
 
 TextLayer::TextLayer() :
     SingleColourLayer(),
+    m_labelLayoutClock(0),
     m_editing(false),
     m_originalPoint(0, 0.0, tr("Empty Label")),
     m_editingPoint(0, 0.0, tr("Empty Label")),
@@ -135,7 +141,6 @@ TextLayer::getLocalPoints(LayerGeometryProvider *v, int x, int y) const
     EventVector points(model->getEventsSpanning(frame0, frame1 - frame0));
 
     EventVector rv;
-    QFontMetrics metrics = QFontMetrics(QFont());
 
     for (EventVector::iterator i = points.begin(); i != points.end(); ++i) {
 
@@ -149,9 +154,7 @@ TextLayer::getLocalPoints(LayerGeometryProvider *v, int x, int y) const
             label = tr("<no text>");
         }
 
-        QRect rect = metrics.boundingRect
-            (QRect(0, 0, 150, 200),
-             Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap, label);
+        QRect rect(QPoint(0, 0), getLabelLayout(label, QFont()).size);
 
         if (py + rect.height() > v->getPaintHeight()) {
             if (rect.height() > v->getPaintHeight()) py = 0;
@@ -330,11 +333,8 @@ TextLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) const
                                           illuminatePoint);
     }
 
-    int boxMaxWidth = 150;
-    int boxMaxHeight = 200;
-
     paint.save();
-    paint.setClipRect(rect.x(), 0, rect.width() + boxMaxWidth, v->getPaintHeight());
+    paint.setClipRect(rect.x(), 0, rect.width() + labelMaxWidth, v->getPaintHeight());
     
     for (EventVector::const_iterator i = points.begin();
          i != points.end(); ++i) {
@@ -357,12 +357,10 @@ TextLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) const
             label = tr("<no text>");
         }
 
-        QRect boxRect = paint.fontMetrics().boundingRect
-            (QRect(0, 0, boxMaxWidth, boxMaxHeight),
-             Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap, label);
+        const LabelLayout &layout = getLabelLayout(label, paint.font());
 
-        QRect textRect = QRect(3, 2, boxRect.width(), boxRect.height());
-        boxRect = QRect(0, 0, boxRect.width() + 6, boxRect.height() + 2);
+        QRect boxRect = QRect(0, 0, layout.size.width() + 6,
+                              layout.size.height() + 2);
 
         if (y + boxRect.height() > v->getPaintHeight()) {
             if (boxRect.height() > v->getPaintHeight()) y = 0;
@@ -370,7 +368,6 @@ TextLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) const
         }
 
         boxRect = QRect(x, y, boxRect.width(), boxRect.height());
-        textRect = QRect(x + 3, y + 2, textRect.width(), textRect.height());
 
 //        boxRect = QRect(x, y, boxRect.width(), boxRect.height());
 //        textRect = QRect(x + 3, y + 2, textRect.width(), textRect.height());
@@ -379,9 +376,7 @@ TextLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) const
         paint.drawRect(boxRect);
 
         paint.setRenderHint(QPainter::Antialiasing, true);
-        paint.drawText(textRect,
-                       Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap,
-                       label);
+        paint.drawStaticText(x + 3, y + 2, layout.text);
 
 ///        if (p.getLabel() != "") {
 ///            paint.drawText(x + 5, y - paint.fontMetrics().height() + paint.fontMetrics().ascent(), p.getLabel());
@@ -394,6 +389,56 @@ TextLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) const
     paint.setRenderHint(QPainter::Antialiasing, false);
 }
 
+const TextLayer::LabelLayout &
+TextLayer::getLabelLayout(const QString &label, const QFont &font) const
+{
+    LabelLayoutKey key(label, font.key());
+
+    auto i = m_labelLayouts.find(key);
+    if (i != m_labelLayouts.end()) {
+        i->second.lastUsed = ++m_labelLayoutClock;
+        return i->second;
+    }
+
+    if (int(m_labelLayouts.size()) >= labelLayoutCacheSize) {
+        // Discard the less recently used half
+        std::vector<uint64_t> used;
+        used.reserve(m_labelLayouts.size());
+        for (const auto &l: m_labelLayouts) {
+            used.push_back(l.second.lastUsed);
+        }
+        auto mid = used.begin() + used.size() / 2;
+        std::nth_element(used.begin(), mid, used.end());
+        uint64_t cutoff = *mid;
+        for (auto j = m_labelLayouts.begin(); j != m_labelLayouts.end(); ) {
+            if (j->second.lastUsed < cutoff) {
+                j = m_labelLayouts.erase(j);
+            } else {
+                ++j;
+            }
+        }
+    }
+
+    // The box is sized from the font metrics as before, and the
+    // static text wraps at the same width, so the two agree on where
+    // the lines break
+    
+    QRect bounds = QFontMetrics(font).boundingRect
+        (QRect(0, 0, labelMaxWidth, labelMaxHeight),
+         Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap, label);
+
+    LabelLayout layout;
+    layout.text.setText(label);
+    layout.text.setTextFormat(Qt::PlainText);
+    layout.text.setTextWidth(labelMaxWidth);
+    layout.text.setPerformanceHint(QStaticText::AggressiveCaching);
+    layout.text.prepare(QTransform(), font);
+    layout.size = bounds.size();
+    layout.lastUsed = ++m_labelLayoutClock;
+
+    return m_labelLayouts.insert({ key, layout }).first->second;
+}
+
 void
 TextLayer::drawStart(LayerGeometryProvider *v, QMouseEvent *e)
 {
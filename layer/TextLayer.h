@@ -21,6 +21,10 @@
 
 #include <QObject>
 #include <QColor>
+#include <QStaticText>
+
+#include <map>
+#include <utility>
 
 class View;
 class QPainter;
@@ -100,6 +104,25 @@ protected:
 
     bool getPointToDrag(LayerGeometryProvider *v, int x, int y, Event &) const;
 
+    struct LabelLayout {
+        QStaticText text;
+        QSize size;         // of the wrapped text, without the box margins
+        uint64_t lastUsed;
+    };
+
+    /**
+     * Return the layout of a label, wrapped as it is drawn in its
+     * box, in the given font. Layouts are cached by label text and
+     * font, so they are recalculated only when a label changes. The
+     * returned reference is valid only until the next call.
+     */
+    const LabelLayout &getLabelLayout(const QString &label,
+                                      const QFont &font) const;
+
+    typedef std::pair<QString, QString> LabelLayoutKey;
+    mutable std::map<LabelLayoutKey, LabelLayout> m_labelLayouts;
+    mutable uint64_t m_labelLayoutClock;
+
     ModelId m_model;
     bool m_editing;
     QPoint m_editOrigin;
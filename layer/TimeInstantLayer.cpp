@@ -22,6 +22,7 @@
 #include "base/Clipboard.h"
 
 #include "ColourDatabase.h"
+#include "ColourMapper.h"
 #include "PaintAssistant.h"
 
 #include "data/model/SparseOneDimensionalModel.h"
@@ -30,6 +31,7 @@
 #include "widgets/ListInputDialog.h"
 
 #include <QPainter>
+#include <QImage>
 #include <QMouseEvent>
 #include <QTextStream>
 #include <QMessageBox>
@@ -72,8 +74,18 @@ TimeInstantLayer::setModel(ModelId modelId)
     if (m_model == modelId) return;
     m_model = modelId;
 
+    m_countIndex.clear();
+
     if (newModel) {
         connectSignals(m_model);
+
+        connect(newModel.get(),
+                SIGNAL(modelChanged(ModelId)),
+                this, SLOT(indexInvalid(ModelId)));
+        connect(newModel.get(),
+                SIGNAL(modelChangedWithin(ModelId, sv_frame_t, sv_frame_t)),
+                this, SLOT(indexInvalid(ModelId, sv_frame_t, sv_frame_t)));
+
         if (!m_propertiesExplicitlySet) {
             if (newModel->getRDFTypeURI().endsWith("Segment")) {
                 setPlotStyle(PlotSegmentation);
@@ -84,6 +96,20 @@ TimeInstantLayer::setModel(ModelId modelId)
     emit modelReplaced();
 }
 
+void
+TimeInstantLayer::indexInvalid(ModelId modelId)
+{
+    if (modelId != m_model) return;
+    m_countIndex.clear();
+}
+
+void
+TimeInstantLayer::indexInvalid(ModelId modelId, sv_frame_t from, sv_frame_t to)
+{
+    if (modelId != m_model) return;
+    m_countIndex.invalidateFrameRange(from, to);
+}
+
 Layer::PropertyList
 TimeInstantLayer::getProperties() const
 {
@@ -324,6 +350,11 @@ TimeInstantLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) c
 
 //    Profiler profiler("TimeInstantLayer::paint", true);
 
+    if (shouldPaintDensity(v, *model)) {
+        paintDensity(v, paint, rect, *model);
+        return;
+    }
+
     // Allow margin so as to improve our odds of repainting the heads
     // or tails of labels
     int margin = 100;
@@ -520,6 +551,123 @@ TimeInstantLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) c
     }
 }
 
+int
+TimeInstantLayer::getVisibleInstantCount(LayerGeometryProvider *v,
+                                         const SparseOneDimensionalModel &model) const
+{
+    // A single column spanning the whole view, so that the count
+    // is the same for every rect painted at this view position
+    
+    int w = v->getPaintWidth();
+    if (w <= 0) {
+        return 0;
+    }
+    
+    std::vector<sv_frame_t> boundaries {
+        v->getFrameForX(0), v->getFrameForX(w)
+    };
+    std::vector<int> counts;
+    m_countIndex.getColumnCounts(model, boundaries, counts);
+    if (counts.empty()) {
+        return 0;
+    }
+    return counts[0];
+}
+
+bool
+TimeInstantLayer::shouldPaintDensity(LayerGeometryProvider *v,
+                                     const SparseOneDimensionalModel &model) const
+{
+    ZoomLevel zoom = v->getZoomLevel();
+    if (zoom.zone != ZoomLevel::FramesPerPixel) {
+        return false;
+    }
+
+    if (model.getEventCount() < 2) {
+        return false;
+    }
+
+    int w = v->getPaintWidth();
+    if (w <= 0) {
+        return false;
+    }
+
+    // Individual instants are still distinguishable at one per three
+    // pixels or so, but not much closer than that. Going by what is
+    // visible means that a sparse stretch of a dense model still
+    // shows its instants, and a dense burst in a sparse one does not
+    int count = getVisibleInstantCount(v, model);
+    return count * 3 >= w;
+}
+
+void
+TimeInstantLayer::paintDensity(LayerGeometryProvider *v, QPainter &paint,
+                               QRect rect,
+                               const SparseOneDimensionalModel &model) const
+{
+    Profiler profiler("TimeInstantLayer::paintDensity");
+
+    int x0 = rect.left();
+    int n = rect.width();
+    if (n <= 0) return;
+
+    std::vector<sv_frame_t> boundaries(n + 1);
+    for (int i = 0; i <= n; ++i) {
+        boundaries[i] = v->getFrameForX(x0 + i);
+    }
+
+    std::vector<int> counts;
+    m_countIndex.getColumnCounts(model, boundaries, counts);
+
+    // Scale counts logarithmically against a reference of four times
+    // the average per column across the visible range. This is the
+    // same for every rect painted at one view position, so strips
+    // painted separately match one another.
+    
+    double reference = 1.0;
+    int w = v->getPaintWidth();
+    if (w > 0) {
+        reference = std::max
+            (4.0 * getVisibleInstantCount(v, model) / double(w), 1.0);
+    }
+    double scale = 1.0 / log1p(reference);
+
+    // Columns are drawn through an indexed image whose colour table
+    // holds the map, with index 0 (no instants) left transparent so
+    // the background shows through
+
+    ColourMapper mapper(ColourMapper::Sunset, v->hasLightBackground(),
+                        0.0, 1.0);
+
+    QVector<QRgb> table(256);
+    table[0] = qRgba(0, 0, 0, 0);
+    for (int i = 1; i < 256; ++i) {
+        table[i] = mapper.map(0.1 + 0.9 * double(i) / 255.0).rgb();
+    }
+
+    QImage strip(n, 1, QImage::Format_Indexed8);
+    strip.setColorTable(table);
+    uchar *line = strip.scanLine(0);
+
+    for (int i = 0; i < n; ++i) {
+        int c = counts[i];
+        if (c == 0) {
+            line[i] = 0;
+        } else {
+            double d = std::min(log1p(double(c)) * scale, 1.0);
+            line[i] = uchar(1 + int(d * 254.0 + 0.5));
+        }
+    }
+
+#ifdef DEBUG_TIME_INSTANT_LAYER
+    SVCERR << "TimeInstantLayer[" << this << "]::paintDensity: " << n
+           << " columns from frame " << boundaries[0] << " to "
+           << boundaries[n] << ", reference count " << reference << endl;
+#endif
+
+    paint.drawImage(QRect(x0, 0, n, v->getPaintHeight()), strip);
+}
+
 void
 TimeInstantLayer::drawStart(LayerGeometryProvider *v, QMouseEvent *e)
 {
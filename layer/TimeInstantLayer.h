@@ -17,6 +17,7 @@
 #define SV_TIME_INSTANT_LAYER_H
 
 #include "SingleColourLayer.h"
+#include "InstantCountIndex.h"
 #include "data/model/SparseOneDimensionalModel.h"
 
 #include <QObject>
@@ -111,9 +112,29 @@ public:
 
     int getVerticalScaleWidth(LayerGeometryProvider *, bool, QPainter &) const override { return 0; }
 
+protected slots:
+    void indexInvalid(ModelId);
+    void indexInvalid(ModelId, sv_frame_t startFrame, sv_frame_t endFrame);
+
 protected:
     EventVector getLocalPoints(LayerGeometryProvider *v, int) const;
 
+    /**
+     * Return the number of instants within the visible range of v.
+     */
+    int getVisibleInstantCount(LayerGeometryProvider *v,
+                               const SparseOneDimensionalModel &model) const;
+
+    /**
+     * Return true if the instants visible in v are dense enough, on
+     * average, for paint() to draw a density strip instead of each
+     * instant.
+     */
+    bool shouldPaintDensity(LayerGeometryProvider *v,
+                            const SparseOneDimensionalModel &model) const;
+    void paintDensity(LayerGeometryProvider *v, QPainter &paint, QRect rect,
+                      const SparseOneDimensionalModel &model) const;
+
     int getDefaultColourHint(bool dark, bool &impose) override;
 
     bool clipboardAlignmentDiffers(LayerGeometryProvider *v, const Clipboard &) const;
@@ -125,6 +146,8 @@ protected:
     PlotStyle m_plotStyle;
     bool m_propertiesExplicitlySet;
 
+    mutable InstantCountIndex m_countIndex;
+
     void finish(ChangeEventsCommand *command) {
         Command *c = command->finish();
         if (c) CommandHistory::getInstance()->addCommand(c, false);
@@ -95,10 +95,19 @@ TimeValueLayer::setModel(ModelId modelId)
     if (m_model == modelId) return;
     m_model = modelId;
 
+    m_summary.clear();
+
     if (newModel) {
         
         connectSignals(m_model);
 
+        connect(newModel.get(),
+                SIGNAL(modelChanged(ModelId)),
+                this, SLOT(summaryInvalid(ModelId)));
+        connect(newModel.get(),
+                SIGNAL(modelChangedWithin(ModelId, sv_frame_t, sv_frame_t)),
+                this, SLOT(summaryInvalid(ModelId, sv_frame_t, sv_frame_t)));
+
         m_scaleMinimum = 0;
         m_scaleMaximum = 0;
 
@@ -122,6 +131,20 @@ TimeValueLayer::setModel(ModelId modelId)
     emit modelReplaced();
 }
 
+void
+TimeValueLayer::summaryInvalid(ModelId modelId)
+{
+    if (modelId != m_model) return;
+    m_summary.clear();
+}
+
+void
+TimeValueLayer::summaryInvalid(ModelId modelId, sv_frame_t from, sv_frame_t to)
+{
+    if (modelId != m_model) return;
+    m_summary.invalidateFrameRange(from, to);
+}
+
 Layer::PropertyList
 TimeValueLayer::getProperties() const
 {
@@ -982,6 +1005,11 @@ TimeValueLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) con
     sv_frame_t frame1 = v->getFrameForX(x1);
     if (m_derivative) --frame0;
 
+    if (shouldPaintEnvelope(v, *model)) {
+        paintEnvelope(v, paint, rect, *model);
+        return;
+    }
+
     EventVector points(model->getEventsWithin(frame0, frame1 - frame0, 1));
 
 #ifdef DEBUG_TIME_VALUE_LAYER
@@ -1351,6 +1379,160 @@ TimeValueLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) con
     }
 }
 
+bool
+TimeValueLayer::shouldPaintEnvelope(LayerGeometryProvider *v,
+                                    const SparseTimeValueModel &model) const
+{
+    // Derivatives depend on the order of individual points, and
+    // segments need their individual extents, so neither can be drawn
+    // from a summary
+    if (m_derivative || m_plotStyle == PlotSegmentation) {
+        return false;
+    }
+
+    ZoomLevel zoom = v->getZoomLevel();
+    if (zoom.zone != ZoomLevel::FramesPerPixel) {
+        return false;
+    }
+
+    if (model.getEventCount() < 2) {
+        return false;
+    }
+
+    // Count the points in the visible range, from a single summary
+    // covering all of it, so that the decision follows the part of
+    // the model being shown rather than its average density, and is
+    // the same for every rect painted at this view position
+    
+    int w = v->getPaintWidth();
+    if (w <= 0) {
+        return false;
+    }
+    
+    std::vector<sv_frame_t> boundaries {
+        v->getFrameForX(0), v->getFrameForX(w)
+    };
+    std::vector<TimeValueSummaryPyramid::Summary> visible;
+    m_summary.getColumnSummaries(model, boundaries, visible);
+    if (visible.empty()) {
+        return false;
+    }
+
+    // Use the envelope when there are at least two visible points per
+    // column on average
+    int count = visible[0].count + visible[0].zeroCount;
+    return count >= 2 * w;
+}
+
+void
+TimeValueLayer::paintEnvelope(LayerGeometryProvider *v, QPainter &paint,
+                              QRect rect,
+                              const SparseTimeValueModel &model) const
+{
+    Profiler profiler("TimeValueLayer::paintEnvelope");
+
+    // One column either side, so that the joins reach the edges
+    int x0 = rect.left() - 1;
+    int x1 = rect.right() + 2;
+    int n = x1 - x0;
+
+    std::vector<sv_frame_t> boundaries(n + 1);
+    for (int i = 0; i <= n; ++i) {
+        boundaries[i] = v->getFrameForX(x0 + i);
+    }
+
+    std::vector<TimeValueSummaryPyramid::Summary> columns;
+    m_summary.getColumnSummaries(model, boundaries, columns);
+
+#ifdef DEBUG_TIME_VALUE_LAYER
+    SVCERR << "TimeValueLayer[" << this << "]::paintEnvelope in "
+           << v->getId() << ": " << n << " columns from frame "
+           << boundaries[0] << " to " << boundaries[n] << endl;
+#endif
+
+    // Zeros are gaps in discrete curves, as in paint()
+    bool discrete = (m_plotStyle == PlotDiscreteCurves);
+    bool connected = (m_plotStyle == PlotConnectedPoints ||
+                      m_plotStyle == PlotLines ||
+                      m_plotStyle == PlotCurve ||
+                      discrete);
+
+    QColor brushColour(getBaseQColor());
+    brushColour.setAlpha(80);
+
+    paint.save();
+    paint.setRenderHint(QPainter::Antialiasing, false);
+
+    int originY = getYForValue(v, 0.f);
+    if (originY > 0 && originY < v->getPaintHeight()) {
+        paint.setPen(getPartialShades(v)[1]);
+        paint.drawLine(x0, originY, x1, originY);
+    }
+
+    // Each column is drawn as a vertical line covering the range of
+    // its values (and the origin, for stems), and the connected
+    // styles join the column means as well
+
+    QVector<QLine> spans;
+    spans.reserve(n);
+    QPolygon joins;
+    std::vector<QPolygon> runs;
+
+    for (int i = 0; i < n; ++i) {
+
+        const auto &s = columns[i];
+        int x = x0 + i;
+
+        if (s.isEmpty(discrete)) {
+            if (discrete && !joins.empty()) {
+                runs.push_back(joins);
+                joins.clear();
+            }
+            continue;
+        }
+
+        int yMax = getYForValue(v, s.getMaximum(discrete));
+        int yMin = getYForValue(v, s.getMinimum(discrete));
+        int top = std::min(yMin, yMax);
+        int bottom = std::max(yMin, yMax);
+
+        if (m_plotStyle == PlotStems) {
+            top = std::min(top, originY);
+            bottom = std::max(bottom, originY);
+        }
+        if (bottom - top < 1) {
+            // as tall as a single point would be
+            top = bottom - 1;
+        }
+
+        spans.push_back(QLine(x, top, x, bottom));
+
+        if (connected) {
+            joins.push_back(QPoint(x, getYForValue(v, s.getMean(discrete))));
+        }
+    }
+
+    if (!joins.empty()) {
+        runs.push_back(joins);
+    }
+
+    paint.setPen(v->scalePen(QPen(getBaseQColor())));
+    paint.drawLines(spans);
+
+    if (connected) {
+        if (m_plotStyle == PlotConnectedPoints) {
+            paint.setPen(v->scalePen(QPen(brushColour)));
+        } else if (discrete) {
+            paint.setPen(v->scalePen(QPen(getBaseQColor(), 3)));
+        }
+        for (const auto &r: runs) {
+            paint.drawPolyline(r);
+        }
+    }
+
+    paint.restore();
+}
+
 int
 TimeValueLayer::getVerticalScaleWidth(LayerGeometryProvider *v, bool, QPainter &paint) const
 {
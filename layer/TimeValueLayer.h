@@ -19,6 +19,7 @@
 #include "SingleColourLayer.h"
 #include "VerticalScaleLayer.h"
 #include "ColourScaleLayer.h"
+#include "TimeValueSummaryPyramid.h"
 
 #include "data/model/SparseTimeValueModel.h"
 
@@ -180,12 +181,26 @@ public:
 signals:
     void frameIlluminated(sv_frame_t);
     
+protected slots:
+    void summaryInvalid(ModelId);
+    void summaryInvalid(ModelId, sv_frame_t startFrame, sv_frame_t endFrame);
+
 protected:
     void getScaleExtents(LayerGeometryProvider *, double &min, double &max, bool &log) const;
     bool shouldAutoAlign() const;
 
     EventVector getLocalPoints(LayerGeometryProvider *v, int) const;
 
+    /**
+     * Return true if the points visible in v are dense enough, on
+     * average, for paint() to draw one envelope per pixel column from
+     * the summary pyramid instead of drawing each point.
+     */
+    bool shouldPaintEnvelope(LayerGeometryProvider *v,
+                             const SparseTimeValueModel &model) const;
+    void paintEnvelope(LayerGeometryProvider *v, QPainter &paint, QRect rect,
+                       const SparseTimeValueModel &model) const;
+
     int getDefaultColourHint(bool dark, bool &impose) override;
 
     ModelId m_model;
@@ -208,6 +223,8 @@ protected:
     mutable double m_scaleMinimum;
     mutable double m_scaleMaximum;
 
+    mutable TimeValueSummaryPyramid m_summary;
+
     void finish(ChangeEventsCommand *command) {
         Command *c = command->finish();
         if (c) CommandHistory::getInstance()->addCommand(c, false);
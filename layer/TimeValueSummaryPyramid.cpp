@@ -0,0 +1,233 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "TimeValueSummaryPyramid.h"
+
+#include "data/model/SparseTimeValueModel.h"
+
+#include "base/HitCount.h"
+#include "base/Debug.h"
+
+using namespace std;
+
+//#define DEBUG_TIME_VALUE_SUMMARY_PYRAMID 1
+
+TimeValueSummaryPyramid::TimeValueSummaryPyramid() :
+    m_baseFrames(0)
+{
+}
+
+void
+TimeValueSummaryPyramid::clear()
+{
+    m_baseFrames = 0;
+    m_levels.clear();
+}
+
+void
+TimeValueSummaryPyramid::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+    if (m_baseFrames == 0 || to < 0) return;
+    if (from < 0) from = 0;
+
+    for (int level = 0; level < int(m_levels.size()); ++level) {
+        Level &l = m_levels[level];
+        sv_frame_t bf = getBlockFrames(level);
+        int64_t i0 = from / bf;
+        int64_t i1 = min(to / bf, int64_t(l.valid.size()) - 1);
+        for (int64_t i = i0; i <= i1; ++i) {
+            l.valid[i] = false;
+        }
+    }
+}
+
+sv_frame_t
+TimeValueSummaryPyramid::getBlockFrames(int level) const
+{
+    sv_frame_t bf = m_baseFrames;
+    for (int i = 0; i < level; ++i) {
+        bf *= fanout;
+    }
+    return bf;
+}
+
+void
+TimeValueSummaryPyramid::prepare(const SparseTimeValueModel &model)
+{
+    if (m_baseFrames > 0) return;
+
+    // Aim for blockEvents events per level-0 block on average, using
+    // the model's resolution as the spacing if that is wider (as it
+    // is for a model with few events so far)
+
+    sv_frame_t extent = model.getEndFrame() - model.getStartFrame();
+    int count = model.getEventCount();
+    sv_frame_t spacing = max(sv_frame_t(model.getResolution()),
+                             extent / max(count, 1));
+    sv_frame_t target = max(spacing, sv_frame_t(1)) * blockEvents;
+
+    m_baseFrames = 1;
+    while (m_baseFrames < target) {
+        m_baseFrames *= 2;
+    }
+    m_levels.clear();
+
+#ifdef DEBUG_TIME_VALUE_SUMMARY_PYRAMID
+    SVDEBUG << "TimeValueSummaryPyramid::prepare: " << count
+            << " events over " << extent << " frames, base block size "
+            << m_baseFrames << endl;
+#endif
+}
+
+void
+TimeValueSummaryPyramid::ensureBlocks(const SparseTimeValueModel &model,
+                                      int level, int64_t from, int64_t to)
+{
+    static HitCount count("TimeValueSummaryPyramid: blocks");
+
+    if (int(m_levels.size()) <= level) {
+        m_levels.resize(level + 1);
+    }
+
+    Level &l = m_levels[level];
+    if (int64_t(l.blocks.size()) < to) {
+        l.blocks.resize(to);
+        l.valid.resize(to, false);
+    }
+
+    sv_frame_t bf = getBlockFrames(level);
+
+    int64_t i = from;
+    while (i < to) {
+
+        if (l.valid[i]) {
+            count.hit();
+            ++i;
+            continue;
+        }
+
+        // Summarise a contiguous run of invalid blocks together, with
+        // a single model query for level 0
+
+        int64_t j = i;
+        while (j < to && !l.valid[j]) {
+            count.miss();
+            l.blocks[j] = Summary();
+            ++j;
+        }
+
+        if (level == 0) {
+            EventVector events = model.getEventsStartingWithin
+                (i * bf, (j - i) * bf);
+            for (const auto &e: events) {
+                int64_t b = e.getFrame() / bf;
+                if (b >= i && b < j) {
+                    l.blocks[b].add(e.getValue());
+                }
+            }
+        } else {
+            ensureBlocks(model, level - 1, i * fanout, j * fanout);
+            const Level &below = m_levels[level - 1];
+            for (int64_t b = i; b < j; ++b) {
+                for (int k = 0; k < fanout; ++k) {
+                    l.blocks[b].merge(below.blocks[b * fanout + k]);
+                }
+            }
+        }
+
+        for (int64_t b = i; b < j; ++b) {
+            l.valid[b] = true;
+        }
+
+        i = j;
+    }
+}
+
+void
+TimeValueSummaryPyramid::getColumnSummaries(const SparseTimeValueModel &model,
+                                            const vector<sv_frame_t> &boundaries,
+                                            vector<Summary> &columns)
+{
+    int n = int(boundaries.size()) - 1;
+    columns.assign(max(n, 0), Summary());
+    if (n <= 0) return;
+
+    prepare(model);
+
+    sv_frame_t minWidth = boundaries[n] - boundaries[0];
+    for (int c = 0; c < n; ++c) {
+        minWidth = min(minWidth, boundaries[c+1] - boundaries[c]);
+    }
+
+    int level = -1;
+    while (getBlockFrames(level + 1) * fanout <= minWidth) {
+        ++level;
+    }
+
+#ifdef DEBUG_TIME_VALUE_SUMMARY_PYRAMID
+    SVDEBUG << "TimeValueSummaryPyramid::getColumnSummaries: " << n
+            << " columns of at least " << minWidth << " frames, using level "
+            << level << endl;
+#endif
+
+    if (level < 0) {
+        summariseDirect(model, boundaries, columns);
+        return;
+    }
+
+    sv_frame_t start = max(boundaries[0], sv_frame_t(0));
+    sv_frame_t end = boundaries[n];
+    if (end <= start) return;
+
+    sv_frame_t bf = getBlockFrames(level);
+    int64_t first = start / bf;
+    int64_t last = (end - 1) / bf + 1;
+
+    ensureBlocks(model, level, first, last);
+
+    // Each block goes to the column containing its midpoint
+
+    const Level &l = m_levels[level];
+    int c = 0;
+    for (int64_t b = first; b < last; ++b) {
+        sv_frame_t mid = b * bf + bf / 2;
+        if (mid < boundaries[0]) continue;
+        while (c < n && boundaries[c+1] <= mid) ++c;
+        if (c >= n) break;
+        columns[c].merge(l.blocks[b]);
+    }
+}
+
+void
+TimeValueSummaryPyramid::summariseDirect(const SparseTimeValueModel &model,
+                                         const vector<sv_frame_t> &boundaries,
+                                         vector<Summary> &columns)
+{
+    // Columns are narrower than a few level-0 blocks, so they hold
+    // few events each and we can afford to read them all
+
+    int n = int(boundaries.size()) - 1;
+
+    EventVector events = model.getEventsStartingWithin
+        (boundaries[0], boundaries[n] - boundaries[0]);
+
+    int c = 0;
+    for (const auto &e: events) {
+        sv_frame_t f = e.getFrame();
+        if (f < boundaries[0]) continue;
+        while (c < n && boundaries[c+1] <= f) ++c;
+        if (c >= n) break;
+        columns[c].add(e.getValue());
+    }
+}
@@ -0,0 +1,152 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TIME_VALUE_SUMMARY_PYRAMID_H
+#define TIME_VALUE_SUMMARY_PYRAMID_H
+
+#include "base/BaseTypes.h"
+
+#include <vector>
+#include <algorithm>
+
+class SparseTimeValueModel;
+
+/**
+ * A multi-resolution summary of the values in a SparseTimeValueModel,
+ * for drawing zoomed-out views of dense feature tracks in time
+ * proportional to the number of pixel columns rather than the number
+ * of events.
+ *
+ * Level 0 divides the timeline into blocks of a fixed number of
+ * frames, chosen when the pyramid is first used so that a block holds
+ * around blockEvents events on average, and each higher level has
+ * blocks fanout times as long. Every block records the minimum,
+ * maximum, sum and count of the values of the events starting within
+ * it. Blocks are summarised lazily, from the model for level 0 and
+ * from the level below for the others, and individually discarded
+ * when the model reports a change to their frame range.
+ *
+ * Zero values are counted separately from the others, so that the
+ * same summaries serve both plot styles that treat zeros as gaps and
+ * those that do not.
+ *
+ * Not thread-safe.
+ */
+class TimeValueSummaryPyramid
+{
+public:
+    static const int blockEvents = 16;
+    static const int fanout = 4;
+
+    struct Summary {
+        Summary() :
+            count(0), zeroCount(0), minimum(0.f), maximum(0.f), sum(0.0) { }
+
+        int count;          // of non-zero values
+        int zeroCount;
+        float minimum;      // of non-zero values, if count > 0
+        float maximum;      // of non-zero values, if count > 0
+        double sum;
+
+        void add(float value) {
+            if (value == 0.f) {
+                ++zeroCount;
+                return;
+            }
+            if (count == 0) {
+                minimum = maximum = value;
+            } else {
+                minimum = std::min(minimum, value);
+                maximum = std::max(maximum, value);
+            }
+            sum += value;
+            ++count;
+        }
+
+        void merge(const Summary &s) {
+            zeroCount += s.zeroCount;
+            if (s.count == 0) return;
+            if (count == 0) {
+                minimum = s.minimum;
+                maximum = s.maximum;
+            } else {
+                minimum = std::min(minimum, s.minimum);
+                maximum = std::max(maximum, s.maximum);
+            }
+            sum += s.sum;
+            count += s.count;
+        }
+
+        bool isEmpty(bool ignoreZeros) const {
+            return count == 0 && (ignoreZeros || zeroCount == 0);
+        }
+        float getMinimum(bool ignoreZeros) const {
+            if (ignoreZeros || zeroCount == 0) return minimum;
+            return count > 0 ? std::min(minimum, 0.f) : 0.f;
+        }
+        float getMaximum(bool ignoreZeros) const {
+            if (ignoreZeros || zeroCount == 0) return maximum;
+            return count > 0 ? std::max(maximum, 0.f) : 0.f;
+        }
+        double getMean(bool ignoreZeros) const {
+            int n = (ignoreZeros ? count : count + zeroCount);
+            return n > 0 ? sum / n : 0.0;
+        }
+    };
+
+    TimeValueSummaryPyramid();
+
+    void clear();
+
+    /**
+     * Discard the summaries of any blocks that include frames from
+     * from to to inclusive.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
+
+    /**
+     * Fill columns with one summary for each interval between
+     * successive frames in the boundaries vector, which must be
+     * non-decreasing. The summary for interval i covers the events
+     * starting at or after boundaries[i] and before boundaries[i+1],
+     * to within the block size of the level used.
+     *
+     * Where the intervals are long enough, this uses the coarsest
+     * level whose blocks are no more than 1/fanout of an interval, so
+     * that the cost is bounded by the number of intervals. Otherwise
+     * it summarises the events in the range directly.
+     */
+    void getColumnSummaries(const SparseTimeValueModel &model,
+                            const std::vector<sv_frame_t> &boundaries,
+                            std::vector<Summary> &columns);
+
+private:
+    struct Level {
+        std::vector<Summary> blocks;
+        std::vector<bool> valid;
+    };
+
+    sv_frame_t m_baseFrames; // block length at level 0, or 0 if unset
+    std::vector<Level> m_levels;
+
+    sv_frame_t getBlockFrames(int level) const;
+    void prepare(const SparseTimeValueModel &model);
+    void ensureBlocks(const SparseTimeValueModel &model,
+                      int level, int64_t from, int64_t to);
+    void summariseDirect(const SparseTimeValueModel &model,
+                         const std::vector<sv_frame_t> &boundaries,
+                         std::vector<Summary> &columns);
+};
+
+#endif
@@ -24,16 +24,18 @@
 
 #include "ColourDatabase.h"
 #include "PaintAssistant.h"
-
-#include "data/model/WaveformOversampler.h"
+#include "RenderThreadPool.h"
 
 #include <QPainter>
 #include <QPainterPath>
-#include <QPixmap>
+#include <QPaintEngine>
+#include <QImage>
 #include <QTextStream>
 
 #include <iostream>
 #include <cmath>
+#include <limits>
+#include <functional>
 
 //#define DEBUG_WAVEFORM_PAINT 1
 //#define DEBUG_WAVEFORM_PAINT_BY_PIXEL 1
@@ -54,15 +56,12 @@ WaveformLayer::WaveformLayer() :
     m_channelCount(0),
     m_scale(LinearScale),
     m_middleLineHeight(0.5),
-    m_aggressive(false),
-    m_cache(nullptr),
-    m_cacheValid(false)
+    m_aggressive(false)
 {
 }
 
 WaveformLayer::~WaveformLayer()
 {
-    delete m_cache;
 }
 
 const ZoomConstraint *
@@ -88,7 +87,7 @@ WaveformLayer::setModel(ModelId modelId)
 
     // NB newModel may legitimately be null
     
-    m_cacheValid = false;
+    invalidateImageCaches();
     
     bool channelsChanged = false;
     if (m_channel == -1) {
@@ -104,9 +103,19 @@ WaveformLayer::setModel(ModelId modelId)
         }
     }
 
+    m_peakCaches.clear();
+    m_oversampledCache.clear();
+    
     if (newModel) {
         m_channelCount = newModel->getChannelCount();
         connectSignals(m_model);
+
+        connect(newModel.get(),
+                SIGNAL(modelChanged(ModelId)),
+                this, SLOT(cacheInvalid(ModelId)));
+        connect(newModel.get(),
+                SIGNAL(modelChangedWithin(ModelId, sv_frame_t, sv_frame_t)),
+                this, SLOT(cacheInvalid(ModelId, sv_frame_t, sv_frame_t)));
     }
         
     emit modelReplaced();
@@ -286,7 +295,7 @@ WaveformLayer::setGain(float gain)
 {
     if (m_gain == gain) return;
     m_gain = gain;
-    m_cacheValid = false;
+    invalidateImageCaches();
     emit layerParametersChanged();
     emit verticalZoomChanged();
 }
@@ -296,7 +305,7 @@ WaveformLayer::setAutoNormalize(bool autoNormalize)
 {
     if (m_autoNormalize == autoNormalize) return;
     m_autoNormalize = autoNormalize;
-    m_cacheValid = false;
+    invalidateImageCaches();
     emit layerParametersChanged();
 }
 
@@ -305,7 +314,7 @@ WaveformLayer::setShowOversampledLines(bool oversample)
 {
     if (m_oversampling == oversample) return;
     m_oversampling = oversample;
-    m_cacheValid = false;
+    invalidateImageCaches();
     emit layerParametersChanged();
 }
 
@@ -314,7 +323,7 @@ WaveformLayer::setShowMeans(bool showMeans)
 {
     if (m_showMeans == showMeans) return;
     m_showMeans = showMeans;
-    m_cacheValid = false;
+    invalidateImageCaches();
     emit layerParametersChanged();
 }
 
@@ -323,7 +332,7 @@ WaveformLayer::setChannelMode(ChannelMode channelMode)
 {
     if (m_channelMode == channelMode) return;
     m_channelMode = channelMode;
-    m_cacheValid = false;
+    invalidateImageCaches();
     emit layerParametersChanged();
 }
 
@@ -334,7 +343,7 @@ WaveformLayer::setChannel(int channel)
 
     if (m_channel == channel) return;
     m_channel = channel;
-    m_cacheValid = false;
+    invalidateImageCaches();
     emit layerParametersChanged();
 }
 
@@ -343,7 +352,7 @@ WaveformLayer::setScale(Scale scale)
 {
     if (m_scale == scale) return;
     m_scale = scale;
-    m_cacheValid = false;
+    invalidateImageCaches();
     emit layerParametersChanged();
 }
 
@@ -352,7 +361,7 @@ WaveformLayer::setMiddleLineHeight(double height)
 {
     if (m_middleLineHeight == height) return;
     m_middleLineHeight = height;
-    m_cacheValid = false;
+    invalidateImageCaches();
     emit layerParametersChanged();
 }
 
@@ -361,7 +370,7 @@ WaveformLayer::setAggressiveCacheing(bool aggressive)
 {
     if (m_aggressive == aggressive) return;
     m_aggressive = aggressive;
-    m_cacheValid = false;
+    m_imageCaches.clear();
     emit layerParametersChanged();
 }
 
@@ -515,6 +524,27 @@ WaveformLayer::getChannelArrangement(int &min, int &max,
     return channels;
 }    
 
+void
+WaveformLayer::setLayerDormant(const LayerGeometryProvider *v, bool dormant)
+{
+    if (dormant) {
+
+        if (isLayerDormant(v)) {
+            return;
+        }
+
+        Layer::setLayerDormant(v, true);
+
+        // for memory-saving purposes
+        m_imageCaches.erase(v->getId());
+        m_peakCaches.erase(v->getId());
+        
+    } else {
+
+        Layer::setLayerDormant(v, false);
+    }
+}
+
 bool
 WaveformLayer::isLayerScrollable(const LayerGeometryProvider *) const
 {
@@ -560,26 +590,8 @@ WaveformLayer::getNormalizeGain(LayerGeometryProvider *v, int channel) const
 {
     auto model = ModelById::getAs<RangeSummarisableTimeValueModel>(m_model);
     if (!model) return 0.f;
-    
-    sv_frame_t startFrame = v->getStartFrame();
-    sv_frame_t endFrame = v->getEndFrame();
-
-    sv_frame_t modelStart = model->getStartFrame();
-    sv_frame_t modelEnd = model->getEndFrame();
-    
-    sv_frame_t rangeStart, rangeEnd;
-            
-    if (startFrame < modelStart) rangeStart = modelStart;
-    else rangeStart = startFrame;
-
-    if (endFrame < 0) rangeEnd = 0;
-    else if (endFrame > modelEnd) rangeEnd = modelEnd;
-    else rangeEnd = endFrame;
 
-    if (rangeEnd < rangeStart) rangeEnd = rangeStart;
-
-    RangeSummarisableTimeValueModel::Range range =
-        model->getSummary(channel, rangeStart, rangeEnd - rangeStart);
+    MagnitudeRange range = getVisiblePeakRange(v, channel);
 
     int minChannel = 0, maxChannel = 0;
     bool mergingChannels = false, mixingChannels = false;
@@ -589,15 +601,188 @@ WaveformLayer::getNormalizeGain(LayerGeometryProvider *v, int channel) const
 
     if (mergingChannels || mixingChannels) {
         if (m_channelCount > 1) {
-            RangeSummarisableTimeValueModel::Range otherRange =
-                model->getSummary(1, rangeStart, rangeEnd - rangeStart);
-            range.setMax(std::max(range.max(), otherRange.max()));
-            range.setMin(std::min(range.min(), otherRange.min()));
-            range.setAbsmean(std::min(range.absmean(), otherRange.absmean()));
+            range.sample(getVisiblePeakRange(v, 1));
+        }
+    }
+
+    double peak = std::max(fabs(range.getMin()), fabs(range.getMax()));
+
+    // see fillPeakColumns
+    if (peak <= std::numeric_limits<float>::min()) {
+        peak = 0.0;
+    }
+    
+    return float(1.0 / peak);
+}
+
+void
+WaveformLayer::preparePeakCaches(const LayerGeometryProvider *v) const
+{
+    ChannelPeakCaches &caches = m_peakCaches[v->getId()];
+
+    if (int(caches.size()) != m_channelCount) {
+        caches = ChannelPeakCaches(m_channelCount);
+    }
+
+    for (auto &cache: caches) {
+        cache.resize(v->getPaintWidth());
+        cache.setZoomLevel(v->getZoomLevel());
+        cache.scrollTo(v, v->getStartFrame());
+    }
+}
+
+MagnitudeRange
+WaveformLayer::getVisiblePeakRange(LayerGeometryProvider *v, int channel) const
+{
+    auto model = ModelById::getAs<RangeSummarisableTimeValueModel>(m_model);
+    if (!model) return {};
+
+    auto i = m_peakCaches.find(v->getId());
+    if (i == m_peakCaches.end() || !in_range_for(i->second, channel)) {
+        throw std::logic_error("Internal error: peak caches have not been prepared for this view and channel");
+    }
+
+    ScrollableMagRangeCache &cache = i->second[channel];
+    int w = cache.getWidth();
+
+    if (cache.areColumnsSet(0, w)) {
+        return cache.getRange(0, w);
+    }
+
+    // Use the same summary block size and source frames for each
+    // column as paint does
+    
+    int desiredBlockSize = 1;
+    if (v->getZoomLevel().zone == ZoomLevel::FramesPerPixel) {
+        desiredBlockSize = v->getZoomLevel().level;
+    }
+    int blockSize = model->getSummaryBlockSize(desiredBlockSize);
+
+    int x = 0;
+    while (x < w) {
+        if (cache.isColumnSet(x)) {
+            ++x;
+            continue;
         }
+        int x1 = x + 1;
+        while (x1 < w && !cache.isColumnSet(x1)) {
+            ++x1;
+        }
+        fillPeakColumns(v, channel, blockSize, cache, x, x1);
+        x = x1;
     }
 
-    return float(1.0 / std::max(fabs(range.max()), fabs(range.min())));
+    return cache.getRange(0, w);
+}
+
+void
+WaveformLayer::fillPeakColumns(LayerGeometryProvider *v, int channel,
+                               int blockSize, ScrollableMagRangeCache &cache,
+                               int x0, int x1) const
+{
+    auto model = ModelById::getAs<RangeSummarisableTimeValueModel>(m_model);
+    if (!model) return;
+
+    Profiler profiler("WaveformLayer::fillPeakColumns");
+    
+    // A column with no sample values, or only zeros, still needs to
+    // be marked as set so that we don't fetch it again, but an unset
+    // MagnitudeRange is indistinguishable from one holding zero. Use
+    // the smallest float either side of zero instead: it can't
+    // change the union with any real range, and getNormalizeGain
+    // treats a peak no bigger than it as silence.
+    
+    float silent = std::numeric_limits<float>::min();
+    
+    vector<sv_frame_t> f0s(x1 - x0), f1s(x1 - x0);
+    vector<bool> valid(x1 - x0, false);
+    sv_frame_t frame0 = 0, frame1 = 0;
+    bool any = false;
+    
+    for (int x = x0; x < x1; ++x) {
+        sv_frame_t f0, f1;
+        if (!getSourceFramesForX(v, x, blockSize, f0, f1)) {
+            continue;
+        }
+        if (!any || f0 < frame0) frame0 = f0;
+        if (!any || f1 > frame1) frame1 = f1;
+        any = true;
+        f0s[x - x0] = f0;
+        f1s[x - x0] = f1;
+        valid[x - x0] = true;
+    }
+
+    RangeSummarisableTimeValueModel::RangeBlock ranges;
+    if (any && frame1 > frame0) {
+        model->getSummaries(channel, frame0, frame1 - frame0,
+                            ranges, blockSize);
+    }
+
+    for (int x = x0; x < x1; ++x) {
+        
+        if (!valid[x - x0]) {
+            cache.sampleColumn(x, MagnitudeRange(-silent, silent));
+            continue;
+        }
+
+        sv_frame_t i0 = (f0s[x - x0] - frame0) / blockSize;
+        sv_frame_t i1 = (f1s[x - x0] - frame0) / blockSize;
+        if (i1 <= i0) i1 = i0 + 1;
+
+        if (!in_range_for(ranges, i1 - 1)) {
+            // not summarised yet, perhaps still loading: leave unset
+            // so as to try again next time
+            continue;
+        }
+
+        float min = ranges[i0].min(), max = ranges[i0].max();
+        for (sv_frame_t i = i0 + 1; i < i1; ++i) {
+            min = std::min(min, ranges[i].min());
+            max = std::max(max, ranges[i].max());
+        }
+
+        if (min == 0.f && max == 0.f) {
+            cache.sampleColumn(x, MagnitudeRange(-silent, silent));
+        } else {
+            cache.sampleColumn(x, MagnitudeRange(min, max));
+        }
+    }
+}
+
+void
+WaveformLayer::invalidateImageCaches() const
+{
+    for (auto &i: m_imageCaches) {
+        i.second.invalidate();
+    }
+}
+
+void
+WaveformLayer::cacheInvalid(ModelId)
+{
+    invalidateImageCaches();
+    m_oversampledCache.clear();
+    
+    for (auto &i: m_peakCaches) {
+        for (auto &cache: i.second) {
+            cache.invalidate();
+        }
+    }
+}
+
+void
+WaveformLayer::cacheInvalid(ModelId, sv_frame_t from, sv_frame_t to)
+{
+    for (auto &i: m_imageCaches) {
+        i.second.invalidateFrameRange(from, to);
+    }
+    m_oversampledCache.invalidateFrameRange(from, to);
+    
+    for (auto &i: m_peakCaches) {
+        for (auto &cache: i.second) {
+            cache.invalidateFrameRange(from, to);
+        }
+    }
 }
 
 void
@@ -607,68 +792,114 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
     if (!model || !model->isOK()) {
         return;
     }
-  
-    ZoomLevel zoomLevel = v->getZoomLevel();
+
+    if (!m_aggressive) {
+        paintWaveform(v, &viewPainter, rect);
+        return;
+    }
 
 #ifdef DEBUG_WAVEFORM_PAINT
-    Profiler profiler("WaveformLayer::paint", true);
-    SVCERR << "WaveformLayer::paint (" << rect.x() << "," << rect.y()
-              << ") [" << rect.width() << "x" << rect.height() << "]: zoom " << zoomLevel << endl;
+    SVCERR << "WaveformLayer::paint: aggressive is true" << endl;
 #endif
 
-    int channels = 0, minChannel = 0, maxChannel = 0;
-    bool mergingChannels = false, mixingChannels = false;
-
-    channels = getChannelArrangement(minChannel, maxChannel,
-                                     mergingChannels, mixingChannels);
-    if (channels == 0) return;
-
+    if (!model->isReady()) {
+        // Nothing we render now will stay valid
+        invalidateImageCaches();
+        paintWaveform(v, &viewPainter, rect);
+        return;
+    }
+    
+    // Each view has its own cache, which scrolls along with it, so
+    // we only need to render the columns that are not already in it
+    
     int w = v->getPaintWidth();
     int h = v->getPaintHeight();
 
-    QPainter *paint;
-
-    if (m_aggressive) {
+    ScrollableImageCache &cache = m_imageCaches[v->getId()];
+    cache.resize(QSize(w, h));
+    cache.setZoomLevel(v->getZoomLevel());
+
+    // With auto-normalise on, the gain depends on the peak of the
+    // whole visible range and so changes as the view scrolls. Columns
+    // kept from before a scroll would have been drawn with a
+    // different gain from those drawn after it, so don't scroll
+    if (m_autoNormalize && cache.isValid() &&
+        cache.getStartFrame() != v->getStartFrame()) {
+        cache.invalidate();
+    }
+    
+    cache.scrollTo(v, v->getStartFrame());
 
-#ifdef DEBUG_WAVEFORM_PAINT
-        SVCERR << "WaveformLayer::paint: aggressive is true" << endl;
-#endif
+    int left = rect.left();
+    int width = rect.width();
+    
+    if (cache.isValid()) {
+        bool isLeftOfValidArea = false;
+        cache.adjustToTouchValidArea(left, width, isLeftOfValidArea);
+    } else {
+        left = 0;
+        width = w;
+    }
 
-        using namespace std::rel_ops;
-        
-        if (m_cacheValid && (zoomLevel != m_cacheZoomLevel)) {
-            m_cacheValid = false;
-        }
+    if (left < 0) {
+        width += left;
+        left = 0;
+    }
+    if (left + width > w) {
+        width = w - left;
+    }
 
-        if (!m_cache || m_cache->width() != w || m_cache->height() != h) {
 #ifdef DEBUG_WAVEFORM_PAINT
-            if (m_cache) {
-                SVCERR << "WaveformLayer::paint: cache size " << m_cache->width() << "x" << m_cache->height() << " differs from view size " << w << "x" << h << ": regenerating aggressive cache" << endl;
-            }
+    SVCERR << "WaveformLayer::paint: cache valid from " << cache.getValidLeft()
+           << " to " << cache.getValidRight() << ", rendering " << width
+           << " columns from " << left << endl;
 #endif
-            delete m_cache;
-            m_cache = new QPixmap(w, h);
-            m_cacheValid = false;
-        }
 
-        if (m_cacheValid) {
-            viewPainter.drawPixmap(rect, *m_cache, rect);
-            return;
-        }
+    if (width > 0) {
 
-        paint = new QPainter(m_cache);
+        QImage strip(width, h, QImage::Format_ARGB32_Premultiplied);
+        strip.fill(getBackgroundQColor(v));
 
-        paint->setPen(Qt::NoPen);
-        paint->setBrush(getBackgroundQColor(v));
-        paint->drawRect(rect);
+        QPainter paint(&strip);
+        paint.translate(-left, 0);
+        paint.setPen(getForegroundQColor(v));
+        paint.setBrush(Qt::NoBrush);
 
-        paint->setPen(getForegroundQColor(v));
-        paint->setBrush(Qt::NoBrush);
+        paintWaveform(v, &paint, QRect(left, 0, width, h));
 
-    } else {
-        paint = &viewPainter;
+        paint.end();
+
+        cache.drawImage(left, width, strip, 0, width);
     }
 
+    cache.drawTo(viewPainter, rect.x(), rect.y(), rect);
+}
+
+void
+WaveformLayer::paintWaveform(LayerGeometryProvider *v, QPainter *paint,
+                             QRect rect) const
+{
+    auto model = ModelById::getAs<RangeSummarisableTimeValueModel>(m_model);
+    if (!model) return;
+  
+    ZoomLevel zoomLevel = v->getZoomLevel();
+
+#ifdef DEBUG_WAVEFORM_PAINT
+    Profiler profiler("WaveformLayer::paint", true);
+    SVCERR << "WaveformLayer::paint (" << rect.x() << "," << rect.y()
+              << ") [" << rect.width() << "x" << rect.height() << "]: zoom " << zoomLevel << endl;
+#endif
+
+    int channels = 0, minChannel = 0, maxChannel = 0;
+    bool mergingChannels = false, mixingChannels = false;
+
+    channels = getChannelArrangement(minChannel, maxChannel,
+                                     mergingChannels, mixingChannels);
+    if (channels == 0) return;
+
+    int w = v->getPaintWidth();
+    int h = v->getPaintHeight();
+
     paint->setRenderHint(QPainter::Antialiasing, true);
 
     if (m_middleLineHeight != 0.5) {
@@ -721,11 +952,21 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
     SVCERR << "Painting waveform from " << frame0 << " to " << frame1 << " (" << (x1-x0+1) << " pixels at zoom " << zoomLevel << " and model zoom " << blockSize << ")" <<  endl;
 #endif
 
+    // Separate channels at one or more frames per pixel can be
+    // fetched and rendered concurrently, if we are painting spans
+    bool parallel = (zoomLevel.zone == ZoomLevel::FramesPerPixel &&
+                     maxChannel > minChannel &&
+                     !mergingChannels && !mixingChannels &&
+                     canPaintSpans(v, paint));
+    
     m_effectiveGains.clear();
     while ((int)m_effectiveGains.size() <= maxChannel) {
         m_effectiveGains.push_back(m_gain);
     }
     if (m_autoNormalize) {
+        preparePeakCaches(v);
+    }
+    if (m_autoNormalize && !parallel) {
         for (int ch = minChannel; ch <= maxChannel; ++ch) {
             m_effectiveGains[ch] = getNormalizeGain(v, ch);
         }
@@ -733,7 +974,11 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
 
     RangeVec ranges;
 
-    if (v->getZoomLevel().zone == ZoomLevel::FramesPerPixel) {
+    if (parallel) {
+        // leaves ranges empty, so paintChannel is not called below
+        paintChannelsParallel(v, paint, rect, minChannel, maxChannel,
+                              blockSize, frame0, frame1);
+    } else if (v->getZoomLevel().zone == ZoomLevel::FramesPerPixel) {
         getSummaryRanges(minChannel, maxChannel,
                          mixingChannels || mergingChannels,
                          frame0, frame1,
@@ -755,16 +1000,6 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
     if (m_middleLineHeight != 0.5) {
         paint->restore();
     }
-
-    if (m_aggressive) {
-        if (model->isReady() && rect == v->getPaintRect()) {
-            m_cacheValid = true;
-            m_cacheZoomLevel = zoomLevel;
-        }
-        paint->end();
-        delete paint;
-        viewPainter.drawPixmap(rect, *m_cache, rect);
-    }
 }
 
 void
@@ -828,32 +1063,15 @@ WaveformLayer::getOversampledRanges(int minChannel, int maxChannel,
         }
     }
     
-    // These frame values, tail length, etc variables are at the model
-    // sample rate, not the oversampled rate
-
-    sv_frame_t tail = 16;
-    sv_frame_t startFrame = model->getStartFrame();
-    sv_frame_t endFrame = model->getEndFrame();
+    // The frame values are at the model sample rate, not the
+    // oversampled rate. The cache reads whatever filter tail it needs
+    // either side of the range, clamped to the model's extent
 
-    sv_frame_t rf0 = frame0 - tail;
-    if (rf0 < startFrame) {
-        rf0 = 0;
-    }
-
-    sv_frame_t rf1 = frame1 + tail;
-    if (rf1 >= endFrame) {
-        rf1 = endFrame - 1;
-    }
-    if (rf1 <= rf0) {
-        SVCERR << "WARNING: getOversampledRanges: rf1 (" << rf1 << ") <= rf0 ("
-               << rf0 << ")" << endl;
-        return;
-    }
-    
     for (int ch = minChannel; ch <= maxChannel; ++ch) {
-        floatvec_t oversampled = WaveformOversampler::getOversampledData
+        floatvec_t oversampled = m_oversampledCache.getOversampledData
             (*model, ch, frame0, frame1 - frame0, oversampleBy);
         RangeSummarisableTimeValueModel::RangeBlock rr;
+        rr.reserve(oversampled.size());
         for (float v: oversampled) {
             RangeSummarisableTimeValueModel::Range r;
             r.sample(v);
@@ -865,8 +1083,7 @@ WaveformLayer::getOversampledRanges(int minChannel, int maxChannel,
 #ifdef DEBUG_WAVEFORM_PAINT
         SVCERR << "getOversampledRanges: " << frame0 << " -> " << frame1
                << " (" << frame1 - frame0 << "-frame range) at ratio "
-               << oversampleBy << " with tail " << tail
-               << " -> got " << oversampled.size()
+               << oversampleBy << " -> got " << oversampled.size()
                << " oversampled values for channel " << ch
                << ", from which returning " << rr.size() << " ranges" << endl;
 #endif    
@@ -875,25 +1092,10 @@ WaveformLayer::getOversampledRanges(int minChannel, int maxChannel,
     return;
 }
 
-void
-WaveformLayer::paintChannel(LayerGeometryProvider *v,
-                            QPainter *paint,
-                            QRect rect, int ch,
-                            const RangeVec &ranges,
-                            int blockSize,
-                            sv_frame_t frame0,
-                            sv_frame_t frame1)
-    const
+bool
+WaveformLayer::getChannelExtent(const LayerGeometryProvider *v, QRect rect,
+                                int ch, int &m, int &my) const
 {
-    auto model = ModelById::getAs<RangeSummarisableTimeValueModel>(m_model);
-    if (!model) return;
-    
-    int x0 = rect.left();
-    int y0 = rect.top();
-
-    int x1 = rect.right();
-    int y1 = rect.bottom();
-
     int h = v->getPaintHeight();
 
     int channels = 0, minChannel = 0, maxChannel = 0;
@@ -901,29 +1103,16 @@ WaveformLayer::paintChannel(LayerGeometryProvider *v,
 
     channels = getChannelArrangement(minChannel, maxChannel,
                                      mergingChannels, mixingChannels);
-    if (channels == 0) return;
-
-    QColor baseColour = getBaseQColor();
-    QColor midColour = baseColour;
-    
-    if (midColour == Qt::black) {
-        midColour = Qt::gray;
-    } else if (v->hasLightBackground()) {
-        midColour = midColour.lighter(150);
-    } else {
-        midColour = midColour.lighter(50);
-    }
+    if (channels == 0) return false;
 
-    double gain = m_effectiveGains[ch];
-
-    int m = (h / channels) / 2;
-    int my = m + (((ch - minChannel) * h) / channels);
+    m = (h / channels) / 2;
+    my = m + (((ch - minChannel) * h) / channels);
 
 #ifdef DEBUG_WAVEFORM_PAINT        
     SVCERR << "ch = " << ch << ", channels = " << channels << ", m = " << m << ", my = " << my << ", h = " << h << endl;
 #endif
 
-    if (my - m > y1 || my + m < y0) return;
+    if (my - m > rect.bottom() || my + m < rect.top()) return false;
 
     if ((m_scale == dBScale || m_scale == MeterScale) &&
         m_channelMode != MergeChannels) {
@@ -931,25 +1120,282 @@ WaveformLayer::paintChannel(LayerGeometryProvider *v,
         my = m + (((ch - minChannel) * h) / channels);
     }
 
+    return true;
+}
+
+void
+WaveformLayer::getWaveformColours(const LayerGeometryProvider *v,
+                                  QColor &baseColour,
+                                  QColor &midColour) const
+{
+    baseColour = getBaseQColor();
+    midColour = baseColour;
+    
+    if (midColour == Qt::black) {
+        midColour = Qt::gray;
+    } else if (v->hasLightBackground()) {
+        midColour = midColour.lighter(150);
+    } else {
+        midColour = midColour.lighter(50);
+    }
+}
+
+void
+WaveformLayer::paintChannel(LayerGeometryProvider *v,
+                            QPainter *paint,
+                            QRect rect, int ch,
+                            const RangeVec &ranges,
+                            int blockSize,
+                            sv_frame_t frame0,
+                            sv_frame_t frame1)
+    const
+{
+    auto model = ModelById::getAs<RangeSummarisableTimeValueModel>(m_model);
+    if (!model) return;
+    
+    int x0 = rect.left();
+    int x1 = rect.right();
+
+    int m = 0, my = 0;
+    if (!getChannelExtent(v, rect, ch, m, my)) return;
+
+    QColor baseColour, midColour;
+    getWaveformColours(v, baseColour, midColour);
+
     // Horizontal axis along middle
     paint->setPen(QPen(midColour, 0));
     paint->drawLine(QPointF(x0, my + 0.5), QPointF(x1, my + 0.5));
 
     paintChannelScaleGuides(v, paint, rect, ch);
-  
-    int rangeix = ch - minChannel;
 
 #ifdef DEBUG_WAVEFORM_PAINT
-    SVCERR << "paint channel " << ch << ": frame0 = " << frame0 << ", frame1 = " << frame1 << ", blockSize = " << blockSize << ", have " << ranges.size() << " range blocks of which ours is index " << rangeix << " with " << ranges[rangeix].size() << " ranges in it" << endl;
+    SVCERR << "paint channel " << ch << ": frame0 = " << frame0 << ", frame1 = " << frame1 << ", blockSize = " << blockSize << ", have " << ranges.size() << " range blocks" << endl;
 #else
     (void)frame1; // not actually used
 #endif
 
+    vector<ColumnSpan> spans;
+    getChannelSpans(v, rect, ch, ranges, blockSize, frame0, m, my, spans);
+
+    if (canPaintSpans(v, paint)) {
+        QPoint origin;
+        QImage strip = renderChannelSpans
+            (rect, spans,
+             model->isReady() ? baseColour : midColour,
+             ColourDatabase::getInstance()->getContrastingColour(m_colour),
+             midColour, origin);
+        if (!strip.isNull()) {
+            paint->drawImage(origin, strip);
+        }
+        return;
+    }
+
     QPainterPath waveformPath;
     QPainterPath meanPath;
     QPainterPath clipPath;
     vector<QPointF> individualSamplePoints;
 
+    for (const auto &s: spans) {
+
+        double px = s.x + 0.5;
+        
+        if (s.individualSample) {
+            individualSamplePoints.push_back(QPointF(px, s.rangeTop));
+            if (!s.trivial) {
+                // common e.g. in "butterfly" merging mode
+                individualSamplePoints.push_back(QPointF(px, s.rangeBottom));
+            }
+        }
+
+        if (!s.connected) {
+            waveformPath.moveTo(QPointF(px, s.rangeTop));
+            waveformPath.lineTo(QPointF(px, s.rangeBottom));
+            waveformPath.moveTo(QPointF(px, s.rangeMiddle));
+        } else {
+            waveformPath.lineTo(QPointF(px, s.rangeMiddle));
+            if (!s.trivial) {
+                waveformPath.lineTo(QPointF(px, s.rangeTop));
+                waveformPath.lineTo(QPointF(px, s.rangeBottom));
+                waveformPath.lineTo(QPointF(px, s.rangeMiddle));
+            }
+        }
+
+        if (s.drawMean) {
+            meanPath.moveTo(QPointF(px, s.meanBottom));
+            meanPath.lineTo(QPointF(px, s.meanTop));
+        }
+
+        if (s.clipped) {
+            if (s.trivial) {
+                clipPath.moveTo(QPointF(px, s.rangeMiddle));
+                clipPath.lineTo(QPointF(px+1, s.rangeMiddle));
+            } else {
+                clipPath.moveTo(QPointF(px, s.rangeBottom));
+                clipPath.lineTo(QPointF(px, s.rangeTop));
+            }
+        }
+    }
+
+    double penWidth = 1.0;
+    if (v->getZoomLevel().zone == ZoomLevel::FramesPerPixel) {
+        penWidth = 0.0;
+    }
+    
+    if (model->isReady()) {
+        paint->setPen(QPen(baseColour, penWidth));
+    } else {
+        paint->setPen(QPen(midColour, penWidth));
+    }
+
+    if (v->getZoomLevel().zone == ZoomLevel::FramesPerPixel ||
+        m_oversampling) {
+        
+        paint->drawPath(waveformPath);
+
+        if (!clipPath.isEmpty()) {
+            paint->save();
+            paint->setPen(QPen(ColourDatabase::getInstance()->
+                               getContrastingColour(m_colour), penWidth));
+            paint->drawPath(clipPath);
+            paint->restore();
+        }
+
+        if (!meanPath.isEmpty()) {
+            paint->save();
+            paint->setPen(QPen(midColour, penWidth));
+            paint->drawPath(meanPath);
+            paint->restore();
+        }
+    }
+    
+    if (!individualSamplePoints.empty()) {
+        double sz = v->scaleSize(2.0);
+        if (v->getZoomLevel().zone == ZoomLevel::PixelsPerFrame) {
+            if (v->getZoomLevel().level < 10) {
+                sz = v->scaleSize(1.2);
+            }
+        }
+        paint->save();
+        paint->setPen(QPen(baseColour, penWidth));
+        for (QPointF p: individualSamplePoints) {
+            paint->drawRect(QRectF(p.x() - sz/2, p.y() - sz/2, sz, sz));
+        }
+        paint->restore();
+    }
+}
+
+void
+WaveformLayer::paintChannelsParallel(LayerGeometryProvider *v,
+                                     QPainter *paint,
+                                     QRect rect,
+                                     int minChannel, int maxChannel,
+                                     int blockSize,
+                                     sv_frame_t frame0,
+                                     sv_frame_t frame1)
+    const
+{
+    auto model = ModelById::getAs<RangeSummarisableTimeValueModel>(m_model);
+    if (!model) return;
+
+    Profiler profiler("WaveformLayer::paintChannelsParallel");
+
+    // Each task fetches the summaries for one channel, calculates its
+    // normalisation gain if required, and renders its spans into an
+    // image strip. The tasks write only to their own channel's
+    // elements of ranges, strips, origins and m_effectiveGains, all
+    // of which are sized before any task starts. The axes, scale
+    // guides and finished strips are then painted here, in channel
+    // order, as paintChannel would have painted them. The colours
+    // are worked out here too, before any task starts, so that the
+    // tasks never ask the view for them.
+
+    QColor baseColour, midColour;
+    getWaveformColours(v, baseColour, midColour);
+    QColor waveColour = (model->isReady() ? baseColour : midColour);
+    QColor clipColour =
+        ColourDatabase::getInstance()->getContrastingColour(m_colour);
+
+    int n = maxChannel - minChannel + 1;
+    
+    RangeVec ranges(n);
+    vector<QImage> strips(n);
+    vector<QPoint> origins(n);
+    vector<int> axes(n, -1);
+    
+    vector<std::function<void()>> tasks;
+
+    for (int ch = minChannel; ch <= maxChannel; ++ch) {
+
+        int m = 0, my = 0;
+        if (!getChannelExtent(v, rect, ch, m, my)) continue;
+
+        int ix = ch - minChannel;
+        axes[ix] = my;
+
+        tasks.push_back([=, &ranges, &strips, &origins]() {
+
+            if (m_autoNormalize) {
+                m_effectiveGains[ch] = getNormalizeGain(v, ch);
+            }
+
+            // getChannelSpans expects the ranges for channel ch at
+            // index ch - minChannel, which is ix
+            model->getSummaries(ch, frame0, frame1 - frame0,
+                                ranges[ix], blockSize);
+
+            vector<ColumnSpan> spans;
+            getChannelSpans(v, rect, ch, ranges, blockSize, frame0,
+                            m, my, spans);
+
+            strips[ix] = renderChannelSpans(rect, spans,
+                                            waveColour, clipColour, midColour,
+                                            origins[ix]);
+        });
+    }
+
+    RenderThreadPool::runAndWait(tasks);
+
+    for (int ch = minChannel; ch <= maxChannel; ++ch) {
+
+        int ix = ch - minChannel;
+        if (axes[ix] < 0) continue;
+        
+        paint->setPen(QPen(midColour, 0));
+        paint->drawLine(QPointF(rect.left(), axes[ix] + 0.5),
+                        QPointF(rect.right(), axes[ix] + 0.5));
+
+        paintChannelScaleGuides(v, paint, rect, ch);
+
+        if (!strips[ix].isNull()) {
+            paint->drawImage(origins[ix], strips[ix]);
+        }
+    }
+}
+
+void
+WaveformLayer::getChannelSpans(LayerGeometryProvider *v,
+                               QRect rect, int ch,
+                               const RangeVec &ranges,
+                               int blockSize,
+                               sv_frame_t frame0,
+                               int m, int my,
+                               vector<ColumnSpan> &spans)
+    const
+{
+    int x0 = rect.left();
+    int x1 = rect.right();
+
+    int minChannel = 0, maxChannel = 0;
+    bool mergingChannels = false, mixingChannels = false;
+
+    (void)getChannelArrangement(minChannel, maxChannel,
+                                mergingChannels, mixingChannels);
+
+    double gain = m_effectiveGains[ch];
+    
+    int rangeix = ch - minChannel;
+    if (!in_range_for(ranges, rangeix)) return;
+
     bool firstPoint = true;
     double prevRangeBottom = 0, prevRangeTop = 0;
     
@@ -1122,101 +1568,177 @@ WaveformLayer::paintChannel(LayerGeometryProvider *v,
 
         double rangeMiddle = (rangeTop + rangeBottom) / 2.0;
         bool trivialRange = (fabs(rangeTop - rangeBottom) < 1.0);
-        double px = x + 0.5;
-        
-        if (showIndividualSample) {
-            individualSamplePoints.push_back(QPointF(px, rangeTop));
-            if (!trivialRange) {
-                // common e.g. in "butterfly" merging mode
-                individualSamplePoints.push_back(QPointF(px, rangeBottom));
-            }
-        }
 
         bool contiguous = true;
         if (rangeTop > prevRangeBottom + 0.5 ||
             rangeBottom < prevRangeTop - 0.5) {
             contiguous = false;
         }
-        
-        if (firstPoint || (contiguous && !trivialRange)) {
-            waveformPath.moveTo(QPointF(px, rangeTop));
-            waveformPath.lineTo(QPointF(px, rangeBottom));
-            waveformPath.moveTo(QPointF(px, rangeMiddle));
-        } else {
-            waveformPath.lineTo(QPointF(px, rangeMiddle));
-            if (!trivialRange) {
-                waveformPath.lineTo(QPointF(px, rangeTop));
-                waveformPath.lineTo(QPointF(px, rangeBottom));
-                waveformPath.lineTo(QPointF(px, rangeMiddle));
-            }
-        }
+
+        spans.push_back({ x,
+                          std::min(rangeTop, rangeBottom),
+                          std::max(rangeTop, rangeBottom),
+                          rangeMiddle,
+                          meanTop, meanBottom, drawMean, clipped,
+                          trivialRange,
+                          !(firstPoint || (contiguous && !trivialRange)),
+                          showIndividualSample });
 
         firstPoint = false;
         prevRangeTop = rangeTop;
         prevRangeBottom = rangeBottom;
-        
-        if (drawMean) {
-            meanPath.moveTo(QPointF(px, meanBottom));
-            meanPath.lineTo(QPointF(px, meanTop));
-        }
-
-        if (clipped) {
-            if (trivialRange) {
-                clipPath.moveTo(QPointF(px, rangeMiddle));
-                clipPath.lineTo(QPointF(px+1, rangeMiddle));
-            } else {
-                clipPath.moveTo(QPointF(px, rangeBottom));
-                clipPath.lineTo(QPointF(px, rangeTop));
-            }
-        }
     }
+}
 
-    double penWidth = 1.0;
-    if (v->getZoomLevel().zone == ZoomLevel::FramesPerPixel) {
-        penWidth = 0.0;
+bool
+WaveformLayer::canPaintSpans(const LayerGeometryProvider *v,
+                             QPainter *paint) const
+{
+    // Spans are only an exact substitute for the paths when each
+    // column has a single vertical extent, i.e. at one or more frames
+    // per pixel, and are only faster when the target is a raster
+    // image or pixmap. Vector output (SVG, PDF) and any scaled
+    // painter (e.g. for a middle line height other than 0.5) keep
+    // the path renderer.
+    
+    if (v->getZoomLevel().zone != ZoomLevel::FramesPerPixel) {
+        return false;
+    }
+    QPaintEngine *engine = paint->paintEngine();
+    if (!engine || engine->type() != QPaintEngine::Raster) {
+        return false;
     }
+    if (paint->transform().type() > QTransform::TxTranslate) {
+        return false;
+    }
+    return true;
+}
+
+static inline void
+blendSpan(QRgb *column, int stride, int rows,
+          double top, double bottom, int yOrigin, QRgb colour)
+{
+    // Cover the rows from top - 0.5 to bottom + 0.5, as a one-pixel
+    // pen would, with partial coverage for the rows at either end
     
-    if (model->isReady()) {
-        paint->setPen(QPen(baseColour, penWidth));
-    } else {
-        paint->setPen(QPen(midColour, penWidth));
+    double t = top - 0.5 - yOrigin;
+    double b = bottom + 0.5 - yOrigin;
+    if (b < t) std::swap(t, b);
+
+    int r0 = std::max(int(floor(t)), 0);
+    int r1 = std::min(int(ceil(b)), rows);
+
+    QRgb pm = qPremultiply(colour);
+    bool opaque = (qAlpha(pm) == 255);
+
+    for (int r = r0; r < r1; ++r) {
+        double coverage = std::min(b, double(r + 1)) - std::max(t, double(r));
+        if (coverage <= 0.0) continue;
+        QRgb &p = column[r * stride];
+        if (opaque && coverage >= 1.0) {
+            p = pm;
+            continue;
+        }
+        // Source-over, premultiplied
+        int c = int(std::min(coverage, 1.0) * 255.0 + 0.5);
+        int sa = qAlpha(pm) * c / 255;
+        int ia = 255 - sa;
+        p = qRgba(qRed(pm) * c / 255 + qRed(p) * ia / 255,
+                  qGreen(pm) * c / 255 + qGreen(p) * ia / 255,
+                  qBlue(pm) * c / 255 + qBlue(p) * ia / 255,
+                  sa + qAlpha(p) * ia / 255);
     }
+}
 
-    if (v->getZoomLevel().zone == ZoomLevel::FramesPerPixel ||
-        m_oversampling) {
-        
-        paint->drawPath(waveformPath);
+QImage
+WaveformLayer::renderChannelSpans(QRect rect,
+                                  vector<ColumnSpan> &spans,
+                                  QColor waveColour, QColor clipColour,
+                                  QColor meanColour, QPoint &origin) const
+{
+    if (spans.empty()) {
+        return {};
+    }
 
-        if (!clipPath.isEmpty()) {
-            paint->save();
-            paint->setPen(QPen(ColourDatabase::getInstance()->
-                               getContrastingColour(m_colour), penWidth));
-            paint->drawPath(clipPath);
-            paint->restore();
+    // Where the path renderer would draw a line from the middle of
+    // one column to the middle of the next, extend each column's span
+    // to meet the other half way
+
+    for (int i = 1; in_range_for(spans, i); ++i) {
+        ColumnSpan &s = spans[i];
+        ColumnSpan &prev = spans[i-1];
+        if (!s.connected || prev.x != s.x - 1) {
+            continue;
         }
+        double join = (prev.rangeMiddle + s.rangeMiddle) / 2.0;
+        prev.rangeTop = std::min(prev.rangeTop, join);
+        prev.rangeBottom = std::max(prev.rangeBottom, join);
+        s.rangeTop = std::min(s.rangeTop, join);
+        s.rangeBottom = std::max(s.rangeBottom, join);
+    }
 
-        if (!meanPath.isEmpty()) {
-            paint->save();
-            paint->setPen(QPen(midColour, penWidth));
-            paint->drawPath(meanPath);
-            paint->restore();
+    // Render into a transparent strip covering just the rows used,
+    // for the caller to draw in one go
+
+    double minY = spans[0].rangeTop, maxY = spans[0].rangeBottom;
+    for (const auto &s: spans) {
+        minY = std::min(minY, s.rangeTop);
+        maxY = std::max(maxY, s.rangeBottom);
+        if (s.drawMean) {
+            minY = std::min(minY, std::min(s.meanTop, s.meanBottom));
+            maxY = std::max(maxY, std::max(s.meanTop, s.meanBottom));
         }
     }
+
+    int yOrigin = std::max(int(floor(minY - 0.5)), rect.top());
+    int yEnd = std::min(int(ceil(maxY + 0.5)), rect.bottom() + 1);
+    int xOrigin = spans[0].x;
+    int width = spans[spans.size()-1].x - xOrigin + 2;
+    int rows = yEnd - yOrigin;
     
-    if (!individualSamplePoints.empty()) {
-        double sz = v->scaleSize(2.0);
-        if (v->getZoomLevel().zone == ZoomLevel::PixelsPerFrame) {
-            if (v->getZoomLevel().level < 10) {
-                sz = v->scaleSize(1.2);
-            }
-        }
-        paint->save();
-        paint->setPen(QPen(baseColour, penWidth));
-        for (QPointF p: individualSamplePoints) {
-            paint->drawRect(QRectF(p.x() - sz/2, p.y() - sz/2, sz, sz));
+    if (rows <= 0 || width <= 0) {
+        return {};
+    }
+
+    QImage strip(width, rows, QImage::Format_ARGB32_Premultiplied);
+    strip.fill(0);
+
+    QRgb *bits = reinterpret_cast<QRgb *>(strip.bits());
+    int stride = strip.bytesPerLine() / int(sizeof(QRgb));
+
+    QRgb wave = waveColour.rgba();
+    QRgb clip = clipColour.rgba();
+    QRgb mean = meanColour.rgba();
+
+    for (const auto &s: spans) {
+        QRgb *column = bits + (s.x - xOrigin);
+        blendSpan(column, stride, rows, s.rangeTop, s.rangeBottom,
+                  yOrigin, wave);
+    }
+
+    for (const auto &s: spans) {
+        if (!s.clipped) continue;
+        QRgb *column = bits + (s.x - xOrigin);
+        if (s.trivial) {
+            blendSpan(column, stride, rows, s.rangeMiddle, s.rangeMiddle,
+                      yOrigin, clip);
+            blendSpan(column + 1, stride, rows, s.rangeMiddle, s.rangeMiddle,
+                      yOrigin, clip);
+        } else {
+            blendSpan(column, stride, rows, s.rangeTop, s.rangeBottom,
+                      yOrigin, clip);
         }
-        paint->restore();
     }
+
+    for (const auto &s: spans) {
+        if (!s.drawMean) continue;
+        QRgb *column = bits + (s.x - xOrigin);
+        blendSpan(column, stride, rows, s.meanTop, s.meanBottom,
+                  yOrigin, mean);
+    }
+
+    origin = QPoint(xOrigin, yOrigin);
+    return strip;
 }
 
 void
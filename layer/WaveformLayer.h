@@ -17,16 +17,21 @@
 #define SV_WAVEFORM_LAYER_H
 
 #include <QRect>
+#include <QImage>
 
 #include "SingleColourLayer.h"
+#include "ScrollableImageCache.h"
+#include "ScrollableMagRangeCache.h"
+#include "OversampledWaveformCache.h"
 
 #include "base/ZoomLevel.h"
 
 #include "data/model/RangeSummarisableTimeValueModel.h"
 
+#include <map>
+
 class View;
 class QPainter;
-class QPixmap;
 
 class WaveformLayer : public SingleColourLayer
 {
@@ -175,7 +180,11 @@ public:
     void setAggressiveCacheing(bool);
     bool getAggressiveCacheing() const { return m_aggressive; }
 
+    void setLayerDormant(const LayerGeometryProvider *v, bool dormant) override;
+
     bool isLayerScrollable(const LayerGeometryProvider *) const override;
+    bool isLayerThreadSafe() const override { return true; }
+    bool isLayerPaintLocalInTime() const override { return !m_autoNormalize; }
 
     int getCompletion(LayerGeometryProvider *) const override;
 
@@ -201,6 +210,10 @@ public:
 
     bool canExistWithoutModel() const override { return true; }
 
+protected slots:
+    void cacheInvalid(ModelId);
+    void cacheInvalid(ModelId, sv_frame_t startFrame, sv_frame_t endFrame);
+
 protected:
     double dBscale(double sample, int m) const;
     double dBscaleMeter(double sample, int m) const;
@@ -213,14 +226,86 @@ protected:
     int getChannelArrangement(int &min, int &max,
                               bool &merging, bool &mixing) const;
 
+    /**
+     * Paint the waveform for the given area of the view, without
+     * reference to the aggressive cache.
+     */
+    void paintWaveform(LayerGeometryProvider *, QPainter *paint,
+                       QRect rect) const;
+
+    void invalidateImageCaches() const;
+    
     void paintChannel
     (LayerGeometryProvider *, QPainter *paint, QRect rect, int channel,
      const RangeVec &ranges,
      int blockSize, sv_frame_t frame0, sv_frame_t frame1) const;
+
+    /**
+     * Paint all of the channels from minChannel to maxChannel
+     * (separately, without merging or mixing), fetching the summaries
+     * for and rendering each channel in a separate task on the
+     * RenderThreadPool. Only for use when canPaintSpans is true.
+     */
+    void paintChannelsParallel
+    (LayerGeometryProvider *, QPainter *paint, QRect rect,
+     int minChannel, int maxChannel,
+     int blockSize, sv_frame_t frame0, sv_frame_t frame1) const;
     
     void paintChannelScaleGuides(LayerGeometryProvider *, QPainter *paint,
                                  QRect rect, int channel) const;
 
+    /**
+     * Calculate the half-height m and the y coordinate my of the
+     * axis for the given channel. Return false if the channel lies
+     * entirely outside rect.
+     */
+    bool getChannelExtent(const LayerGeometryProvider *, QRect rect,
+                          int channel, int &m, int &my) const;
+
+    void getWaveformColours(const LayerGeometryProvider *,
+                            QColor &baseColour, QColor &midColour) const;
+
+    /**
+     * The vertical extents of the waveform in a single pixel column,
+     * as calculated by getChannelSpans.
+     */
+    struct ColumnSpan {
+        int x;
+        double rangeTop;    // rangeTop <= rangeBottom
+        double rangeBottom;
+        double rangeMiddle;
+        double meanTop;
+        double meanBottom;
+        bool drawMean;
+        bool clipped;
+        bool trivial;
+        bool connected; // joined to the previous column by a line
+        bool individualSample;
+    };
+
+    /**
+     * Calculate the spans for the columns of rect in the given
+     * channel. This reads only the ranges, the view geometry and the
+     * layer's display properties, and may be called from any thread
+     * while the view is not changing.
+     */
+    void getChannelSpans(LayerGeometryProvider *, QRect rect, int channel,
+                         const RangeVec &ranges, int blockSize,
+                         sv_frame_t frame0, int m, int my,
+                         std::vector<ColumnSpan> &spans) const;
+
+    bool canPaintSpans(const LayerGeometryProvider *, QPainter *paint) const;
+
+    /**
+     * Render the spans into a transparent image covering just the
+     * rows they use, returning the image and setting origin to the
+     * point at which it should be drawn. Thread-safe.
+     */
+    QImage renderChannelSpans(QRect rect,
+                              std::vector<ColumnSpan> &spans,
+                              QColor waveColour, QColor clipColour,
+                              QColor meanColour, QPoint &origin) const;
+
     void getSummaryRanges(int minChannel, int maxChannel,
                           bool mixingOrMerging,
                           sv_frame_t f0, sv_frame_t f1,
@@ -240,7 +325,28 @@ protected:
 
     float getNormalizeGain(LayerGeometryProvider *v, int channel) const;
 
-    void flagBaseColourChanged() override { m_cacheValid = false; }
+    /**
+     * Make sure the view has a peak cache for every channel, matched
+     * to its current geometry. Must be called from the painting
+     * thread before getNormalizeGain is called for that view, which
+     * may then happen from other threads provided that no two
+     * threads use the same channel at once.
+     */
+    void preparePeakCaches(const LayerGeometryProvider *v) const;
+
+    /**
+     * Return the range of sample values in the given channel across
+     * the visible columns of the view, calculating it for only those
+     * columns that have not already been seen.
+     */
+    MagnitudeRange getVisiblePeakRange(LayerGeometryProvider *v,
+                                       int channel) const;
+
+    void fillPeakColumns(LayerGeometryProvider *v, int channel,
+                         int blockSize, ScrollableMagRangeCache &cache,
+                         int x0, int x1) const;
+
+    void flagBaseColourChanged() override { invalidateImageCaches(); }
 
     float        m_gain;
     bool         m_autoNormalize;
@@ -257,9 +363,17 @@ protected:
 
     mutable std::vector<float> m_effectiveGains;
 
-    mutable QPixmap *m_cache;
-    mutable bool m_cacheValid;
-    mutable ZoomLevel m_cacheZoomLevel;
+    // Per view id, a cache per model channel of the range of values
+    // in each column of the view, for use in auto-normalising
+    typedef std::vector<ScrollableMagRangeCache> ChannelPeakCaches;
+    mutable std::map<int, ChannelPeakCaches> m_peakCaches;
+
+    // Oversampled data for PixelsPerFrame zoom levels, shared by all
+    // views
+    mutable OversampledWaveformCache m_oversampledCache;
+
+    // Per view id, for aggressive cacheing only
+    mutable std::map<int, ScrollableImageCache> m_imageCaches;
 };
 
 #endif
@@ -38,6 +38,7 @@ public slots:
     virtual void viewBelowZoomLevelChanged(ZoomLevel, bool);
     
     void viewManagerPlaybackFrameChanged(sv_frame_t) override;
+    void viewManagerPlayPointerRefresh() override { } // polled updates suffice
 
     void keyFramesChanged();
 
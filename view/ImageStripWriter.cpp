@@ -0,0 +1,60 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ImageStripWriter.h"
+
+#include "base/Debug.h"
+
+#include <QImageWriter>
+
+ImageStripWriter::ImageStripWriter(QString prefix, QString format) :
+    m_prefix(prefix),
+    m_format(format)
+{
+}
+
+bool
+ImageStripWriter::begin(QSize size)
+{
+    m_size = size;
+    m_fileNames.clear();
+    m_error = "";
+    return true;
+}
+
+bool
+ImageStripWriter::writeChunk(int x, const QImage &chunk)
+{
+    QString fileName = QString("%1-%2.%3")
+        .arg(m_prefix)
+        .arg(int(m_fileNames.size()), 4, 10, QChar('0'))
+        .arg(m_format.toLower());
+
+    QImageWriter writer(fileName, m_format.toLatin1());
+    if (!writer.write(chunk)) {
+        m_error = QString("Failed to write image strip at x = %1 to \"%2\": %3")
+            .arg(x).arg(fileName).arg(writer.errorString());
+        SVCERR << "ImageStripWriter::writeChunk: " << m_error << endl;
+        return false;
+    }
+
+    m_fileNames.push_back(fileName);
+    return true;
+}
+
+bool
+ImageStripWriter::end()
+{
+    return m_error == "";
+}
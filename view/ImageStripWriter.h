@@ -0,0 +1,74 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_IMAGE_STRIP_WRITER_H
+#define SV_IMAGE_STRIP_WRITER_H
+
+#include "View.h"
+
+#include <QString>
+#include <QSize>
+
+#include <vector>
+
+/**
+ * A View::RenderSink that writes each chunk of a streaming render to
+ * an image file of its own as soon as it arrives, so that an export
+ * of any width can be made without holding more than a chunk or two
+ * of it in memory. The strips are named with the given prefix
+ * followed by a four-digit sequence number and the suffix for the
+ * format, e.g. "poster-0000.png", "poster-0001.png", ... and laid
+ * side by side from left to right they make up the whole image.
+ */
+class ImageStripWriter : public View::RenderSink
+{
+public:
+    /**
+     * Create a writer for strips named with the given prefix (which
+     * may include a directory path) in the given format, which may
+     * be any supported by QImageWriter.
+     */
+    ImageStripWriter(QString prefix, QString format = "png");
+
+    bool begin(QSize size) override;
+    bool writeChunk(int x, const QImage &chunk) override;
+    bool end() override;
+
+    /**
+     * Return the size of the whole image, as reported at the start
+     * of the render.
+     */
+    QSize getImageSize() const { return m_size; }
+
+    /**
+     * Return the names of the files written so far, from left to
+     * right.
+     */
+    std::vector<QString> getFileNames() const { return m_fileNames; }
+
+    /**
+     * Return a description of the error that caused writing to fail,
+     * or an empty string if it has not failed.
+     */
+    QString getError() const { return m_error; }
+
+private:
+    QString m_prefix;
+    QString m_format;
+    QSize m_size;
+    std::vector<QString> m_fileNames;
+    QString m_error;
+};
+
+#endif
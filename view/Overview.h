@@ -48,6 +48,7 @@ public slots:
     void viewCentreFrameChanged(View *, sv_frame_t) override;
     void viewZoomLevelChanged(View *, ZoomLevel, bool) override;
     void viewManagerPlaybackFrameChanged(sv_frame_t) override;
+    void viewManagerPlayPointerRefresh() override { } // polled updates suffice
 
     virtual void setBoxColour(QColor);
     
@@ -1200,10 +1200,9 @@ Pane::render(QPainter &paint, int xorigin, sv_frame_t f0, sv_frame_t f1)
 QImage *
 Pane::renderPartToNewImage(sv_frame_t f0, sv_frame_t f1)
 {
-    int x0 = int(round(getZoomLevel().framesToPixels(double(f0))));
-    int x1 = int(round(getZoomLevel().framesToPixels(double(f1))));
+    int w = getRenderedPartWidth(f0, f1);
 
-    QImage *image = new QImage(x1 - x0 + m_scaleWidth,
+    QImage *image = new QImage(w + m_scaleWidth,
                                height(), QImage::Format_RGB32);
 
     int formerScaleWidth = m_scaleWidth;
@@ -1221,7 +1220,7 @@ Pane::renderPartToNewImage(sv_frame_t f0, sv_frame_t f1)
 
     if (m_scaleWidth != formerScaleWidth) {
         delete image;
-        image = new QImage(x1 - x0 + m_scaleWidth,
+        image = new QImage(w + m_scaleWidth,
                            height(), QImage::Format_RGB32);
     }        
 
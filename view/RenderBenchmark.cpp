@@ -0,0 +1,502 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "RenderBenchmark.h"
+
+#include "View.h"
+#include "ViewProxy.h"
+
+#include "layer/Layer.h"
+#include "layer/LayerFactory.h"
+#include "layer/Colour3DPlotLayer.h"
+#include "layer/SpectrogramLayer.h"
+#include "layer/Colour3DPlotRenderer.h"
+#include "layer/ColourScale.h"
+
+#include "data/model/SparseOneDimensionalModel.h"
+#include "data/model/SparseTimeValueModel.h"
+#include "data/model/NoteModel.h"
+#include "data/model/RegionModel.h"
+#include "data/model/BoxModel.h"
+#include "data/model/TextModel.h"
+#include "data/model/EditableDenseThreeDimensionalModel.h"
+#include "data/model/WritableWaveFileModel.h"
+#include "data/model/FFTModel.h"
+
+#include "base/Debug.h"
+
+#include <QImage>
+#include <QPainter>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include <random>
+#include <cmath>
+
+using namespace std;
+
+//#define DEBUG_RENDER_BENCHMARK 1
+
+static QString
+getZoneName(ZoomLevel zoom)
+{
+    return (zoom.zone == ZoomLevel::FramesPerPixel ?
+            "framesPerPixel" : "pixelsPerFrame");
+}
+
+static QString
+getRenderTypeName(Colour3DPlotRenderer::RenderType type)
+{
+    switch (type) {
+    case Colour3DPlotRenderer::DrawBufferPixelResolution:
+        return "DrawBufferPixelResolution";
+    case Colour3DPlotRenderer::DrawBufferBinResolution:
+        return "DrawBufferBinResolution";
+    case Colour3DPlotRenderer::DirectTranslucent:
+        return "DirectTranslucent";
+    }
+    return "";
+}
+
+RenderBenchmark::RenderBenchmark(View *view) :
+    m_view(view)
+{
+}
+
+RenderBenchmark::Configuration
+RenderBenchmark::getDefaultConfiguration()
+{
+    Configuration c;
+    for (int level : { 1, 4, 32, 256, 2048 }) {
+        c.zoomLevels.push_back({ ZoomLevel::FramesPerPixel, level });
+    }
+    c.zoomLevels.push_back({ ZoomLevel::PixelsPerFrame, 4 });
+    c.paneSizes = { QSize(800, 200), QSize(1920, 400), QSize(3840, 800) };
+    c.pixelRatios = { 1, 2 };
+    c.threadCounts = { 1 };
+    if (QThread::idealThreadCount() > 1) {
+        c.threadCounts.push_back(QThread::idealThreadCount());
+    }
+    return c;
+}
+
+void
+RenderBenchmark::run(const Configuration &configuration)
+{
+    QSize originalSize = m_view->size();
+    ZoomLevel originalZoom = m_view->getZoomLevel();
+    sv_frame_t originalCentre = m_view->getCentreFrame();
+
+    vector<Layer *> layers;
+    for (int i = 0; i < m_view->getLayerCount(); ++i) {
+        Layer *layer = m_view->getLayer(i);
+        if (layer && !layer->isLayerDormant(m_view)) {
+            layers.push_back(layer);
+        }
+    }
+
+    for (auto layer : layers) {
+        layer->setSynchronousPainting(true);
+    }
+
+    for (int pixelRatio : configuration.pixelRatios) {
+        for (QSize size : configuration.paneSizes) {
+            m_view->resize(size);
+            for (ZoomLevel zoom : configuration.zoomLevels) {
+                m_view->setZoomLevel(zoom);
+                m_view->setCentreFrame(originalCentre);
+                for (auto layer : layers) {
+                    runLayer(layer, pixelRatio, configuration.repetitions);
+                    runRenderers(layer, pixelRatio, configuration);
+                }
+            }
+        }
+    }
+
+    for (auto layer : layers) {
+        layer->setSynchronousPainting(false);
+    }
+
+    m_view->resize(originalSize);
+    m_view->setZoomLevel(originalZoom);
+    m_view->setCentreFrame(originalCentre);
+}
+
+void
+RenderBenchmark::runLayer(Layer *layer, int pixelRatio, int repetitions)
+{
+    ViewProxy proxy(m_view, pixelRatio);
+    QRect rect = proxy.getPaintRect();
+
+    QImage image(rect.size(), QImage::Format_ARGB32_Premultiplied);
+
+    auto paintOnce = [&]() {
+        image.fill(m_view->getBackground());
+        QPainter paint(&image);
+        QElapsedTimer timer;
+        timer.start();
+        layer->paint(&proxy, paint, rect);
+        double msec = double(timer.nsecsElapsed()) / 1000000.0;
+        paint.end();
+        return msec;
+    };
+
+    Result result;
+    result.layerType = LayerFactory::getInstance()->getLayerTypeName
+        (LayerFactory::getInstance()->getLayerType(layer));
+    result.zoomLevel = m_view->getZoomLevel();
+    result.paneSize = m_view->size();
+    result.pixelRatio = pixelRatio;
+    result.threads = 0;
+
+    // Making the layer dormant in this view causes it to discard
+    // whatever it has cached for it
+    layer->setLayerDormant(&proxy, true);
+    layer->setLayerDormant(&proxy, false);
+    measure(result, repetitions, paintOnce);
+
+#ifdef DEBUG_RENDER_BENCHMARK
+    SVDEBUG << "RenderBenchmark: " << result.layerType << " at "
+            << result.zoomLevel << ", " << rect.width() << "x"
+            << rect.height() << ": cold " << result.coldMsec << "ms, warm "
+            << result.warmMsec << "ms, scroll " << result.scrollMsec
+            << "ms" << endl;
+#endif
+
+    m_results.push_back(result);
+}
+
+void
+RenderBenchmark::runRenderers(Layer *layer, int pixelRatio,
+                              const Configuration &configuration)
+{
+    Colour3DPlotRenderer::Sources sources;
+    vector<ModelId> fftModels;
+
+    if (auto c3d = dynamic_cast<Colour3DPlotLayer *>(layer)) {
+        sources.verticalBinLayer = c3d;
+        sources.source = c3d->getModel();
+    } else if (auto sl = dynamic_cast<SpectrogramLayer *>(layer)) {
+        // Set up FFTModels as the spectrogram does for its own
+        // renderers, including one for each worker, so that the
+        // thread counts can be compared on the columns that cost the
+        // most to read
+        auto makeFFTModel = [&]() {
+            auto fft = make_shared<FFTModel>(sl->getModel(),
+                                             sl->getChannel(),
+                                             sl->getWindowType(),
+                                             sl->getWindowSize(),
+                                             sl->getWindowIncrement(),
+                                             sl->getFFTSize());
+            ModelId id = ModelById::add(fft);
+            fftModels.push_back(id);
+            return id;
+        };
+        int workers = 1;
+        for (int threads : configuration.threadCounts) {
+            workers = std::max(workers, threads);
+        }
+        sources.verticalBinLayer = sl;
+        sources.fft = makeFFTModel();
+        sources.source = sources.fft;
+        sources.sourceLock = make_shared<QMutex>();
+        if (workers > 1) {
+            for (int i = 0; i < workers; ++i) {
+                sources.workerSources.push_back
+                    ({ makeFFTModel(), make_shared<QMutex>() });
+            }
+        }
+    } else {
+        return;
+    }
+
+    ViewProxy proxy(m_view, pixelRatio);
+    QRect rect = proxy.getPaintRect();
+
+    QImage image(rect.size(), QImage::Format_ARGB32_Premultiplied);
+
+    // Render types are chosen from the parameters together with the
+    // geometry, so between them these variants and the zoom levels
+    // of the configuration are intended to reach all of them
+
+    struct Variant {
+        QString name;
+        bool alwaysOpaque;
+        bool interpolate;
+    };
+    vector<Variant> variants {
+        { "opaque", true, false },
+        { "translucent", false, false },
+        { "interpolated", false, true }
+    };
+
+    for (const auto &variant : variants) {
+        for (int threads : configuration.threadCounts) {
+
+            Colour3DPlotRenderer::Parameters params;
+            params.colourScale = ColourScale(ColourScale::Parameters());
+            params.alwaysOpaque = variant.alwaysOpaque;
+            params.interpolate = variant.interpolate;
+            params.threadCount = threads;
+
+            Colour3DPlotRenderer renderer(sources, params);
+
+            auto renderOnce = [&]() {
+                image.fill(m_view->getBackground());
+                QPainter paint(&image);
+                QElapsedTimer timer;
+                timer.start();
+                renderer.render(&proxy, paint, rect);
+                double msec = double(timer.nsecsElapsed()) / 1000000.0;
+                paint.end();
+                return msec;
+            };
+
+            Result result;
+            result.layerType = LayerFactory::getInstance()->getLayerTypeName
+                (LayerFactory::getInstance()->getLayerType(layer));
+            result.renderer = variant.name;
+            result.renderType =
+                getRenderTypeName(renderer.getRenderType(&proxy));
+            result.threads = threads;
+            result.zoomLevel = m_view->getZoomLevel();
+            result.paneSize = m_view->size();
+            result.pixelRatio = pixelRatio;
+
+            try {
+                measure(result, configuration.repetitions, renderOnce);
+            } catch (const std::logic_error &e) {
+                SVCERR << "RenderBenchmark::runRenderers: Failed to render "
+                       << variant.name << " variant with " << threads
+                       << " threads: " << e.what() << endl;
+                continue;
+            }
+
+            m_results.push_back(result);
+        }
+    }
+
+    for (auto id : fftModels) {
+        ModelById::release(id);
+    }
+}
+
+void
+RenderBenchmark::measure(Result &result, int repetitions,
+                         const std::function<double()> &paintOnce)
+{
+    result.coldMsec = paintOnce();
+
+    double total = 0.0;
+    for (int i = 0; i < repetitions; ++i) {
+        total += paintOnce();
+    }
+    result.warmMsec = (repetitions > 0 ? total / repetitions : 0.0);
+
+    sv_frame_t centre = m_view->getCentreFrame();
+    sv_frame_t step = sv_frame_t
+        (round(result.zoomLevel.pixelsToFrames(m_view->width() / 10.0)));
+    if (step < 1) step = 1;
+
+    total = 0.0;
+    try {
+        for (int i = 0; i < repetitions; ++i) {
+            m_view->setCentreFrame(centre + (i + 1) * step);
+            total += paintOnce();
+        }
+    } catch (...) {
+        m_view->setCentreFrame(centre);
+        throw;
+    }
+    result.scrollMsec = (repetitions > 0 ? total / repetitions : 0.0);
+    m_view->setCentreFrame(centre);
+}
+
+void
+RenderBenchmark::writeCSV(QTextStream &out) const
+{
+    out << "layer,renderer,renderType,threads,zoomZone,zoomLevel,"
+        << "width,height,pixelRatio,coldMsec,warmMsec,scrollMsec\n";
+
+    for (const auto &r : m_results) {
+        out << r.layerType << ","
+            << r.renderer << ","
+            << r.renderType << ","
+            << r.threads << ","
+            << getZoneName(r.zoomLevel) << ","
+            << r.zoomLevel.level << ","
+            << r.paneSize.width() << ","
+            << r.paneSize.height() << ","
+            << r.pixelRatio << ","
+            << r.coldMsec << ","
+            << r.warmMsec << ","
+            << r.scrollMsec << "\n";
+    }
+}
+
+void
+RenderBenchmark::writeJSON(QTextStream &out) const
+{
+    QJsonArray array;
+
+    for (const auto &r : m_results) {
+        QJsonObject obj;
+        obj["layer"] = r.layerType;
+        if (r.renderer != "") {
+            obj["renderer"] = r.renderer;
+            obj["renderType"] = r.renderType;
+            obj["threads"] = r.threads;
+        }
+        obj["zoomZone"] = getZoneName(r.zoomLevel);
+        obj["zoomLevel"] = r.zoomLevel.level;
+        obj["width"] = r.paneSize.width();
+        obj["height"] = r.paneSize.height();
+        obj["pixelRatio"] = r.pixelRatio;
+        obj["coldMsec"] = r.coldMsec;
+        obj["warmMsec"] = r.warmMsec;
+        obj["scrollMsec"] = r.scrollMsec;
+        array.append(obj);
+    }
+
+    out << QString::fromUtf8(QJsonDocument(array).toJson());
+}
+
+vector<Layer *>
+RenderBenchmark::createSyntheticLayers(sv_samplerate_t sampleRate,
+                                       sv_frame_t duration,
+                                       vector<ModelId> &models)
+{
+    // Fixed seed, so that every run draws the same thing
+    minstd_rand rng(1);
+    uniform_real_distribution<float> unit(0.f, 1.f);
+
+    LayerFactory *factory = LayerFactory::getInstance();
+    vector<Layer *> layers;
+
+    auto addLayer = [&](shared_ptr<Model> model,
+                        LayerFactory::LayerType type) {
+        ModelId id = ModelById::add(model);
+        models.push_back(id);
+        Layer *layer = factory->createLayer(type);
+        factory->setModel(layer, id);
+        layers.push_back(layer);
+    };
+
+    // A sweep from 50Hz to 5kHz with a little noise, for the waveform
+    // and a spectrogram of it
+    auto wave = make_shared<WritableWaveFileModel>(sampleRate, 1);
+    const sv_frame_t block = 16384;
+    vector<float> samples(block);
+    double phase = 0.0;
+    for (sv_frame_t f = 0; f < duration; f += block) {
+        sv_frame_t n = min(block, duration - f);
+        for (sv_frame_t i = 0; i < n; ++i) {
+            double t = double(f + i) / double(duration);
+            double hz = 50.0 * pow(100.0, t);
+            phase += 2.0 * M_PI * hz / sampleRate;
+            samples[i] = float(0.5 * sin(phase) +
+                               0.05 * (unit(rng) - 0.5f));
+        }
+        float *channels[] = { samples.data() };
+        wave->addSamples(channels, n);
+    }
+    wave->writeComplete();
+    if (!wave->isOK()) {
+        SVCERR << "RenderBenchmark::createSyntheticLayers: Failed to "
+               << "write synthetic audio, omitting waveform and "
+               << "spectrogram layers" << endl;
+    } else {
+        ModelId id = ModelById::add(wave);
+        models.push_back(id);
+        for (auto type : { LayerFactory::Waveform,
+                           LayerFactory::Spectrogram }) {
+            Layer *layer = factory->createLayer(type);
+            factory->setModel(layer, id);
+            layers.push_back(layer);
+        }
+    }
+
+    sv_frame_t tenth = sv_frame_t(sampleRate / 10);
+
+    auto instants = make_shared<SparseOneDimensionalModel>
+        (sampleRate, 1, false);
+    for (sv_frame_t f = 0; f < duration; f += tenth) {
+        instants->add(Event(f + sv_frame_t(unit(rng) * tenth)));
+    }
+    addLayer(instants, LayerFactory::TimeInstants);
+
+    auto values = make_shared<SparseTimeValueModel>(sampleRate, 1, false);
+    float value = 0.f;
+    for (sv_frame_t f = 0; f < duration; f += 512) {
+        value += unit(rng) - 0.5f;
+        values->add(Event(f, value, QString()));
+    }
+    addLayer(values, LayerFactory::TimeValues);
+
+    auto notes = make_shared<NoteModel>(sampleRate, 1, false);
+    for (sv_frame_t f = 0; f < duration; f += tenth * 2) {
+        float pitch = 40.f + floorf(unit(rng) * 50.f);
+        notes->add(Event(f, pitch, tenth * 2 - tenth / 4, 1.f, QString()));
+    }
+    addLayer(notes, LayerFactory::Notes);
+
+    auto regions = make_shared<RegionModel>(sampleRate, 1, false);
+    for (sv_frame_t f = 0; f < duration; f += tenth * 10) {
+        sv_frame_t length = tenth * (5 + sv_frame_t(unit(rng) * 25));
+        regions->add(Event(f, unit(rng) * 10.f, length, QString()));
+    }
+    addLayer(regions, LayerFactory::Regions);
+
+    // Boxes span a time range and a frequency range, from the value
+    // up to the level
+    auto boxes = make_shared<BoxModel>(sampleRate, 1, false);
+    for (sv_frame_t f = 0; f < duration; f += tenth * 5) {
+        sv_frame_t length = tenth * (2 + sv_frame_t(unit(rng) * 8));
+        float low = 100.f + unit(rng) * 2000.f;
+        float high = low + 200.f + unit(rng) * 2000.f;
+        boxes->add(Event(f, low, length, high, QString()));
+    }
+    addLayer(boxes, LayerFactory::Boxes);
+
+    // Text values are heights as a proportion of the view
+    auto texts = make_shared<TextModel>(sampleRate, 1, false);
+    for (sv_frame_t f = 0; f < duration; f += tenth * 5) {
+        texts->add(Event(f, unit(rng), QString("Label %1").arg(f / tenth)));
+    }
+    addLayer(texts, LayerFactory::Text);
+
+    int resolution = 512;
+    int height = 256;
+    auto dense = make_shared<EditableDenseThreeDimensionalModel>
+        (sampleRate, resolution, height, false);
+    int columns = int(duration / resolution);
+    for (int x = 0; x < columns; ++x) {
+        DenseThreeDimensionalModel::Column column(height);
+        double ridge = height * (0.5 + 0.4 * sin(x / 50.0));
+        for (int y = 0; y < height; ++y) {
+            double d = (y - ridge) / 8.0;
+            column[y] = float(exp(-d * d) * 0.8 + unit(rng) * 0.2);
+        }
+        dense->setColumn(x, column);
+    }
+    dense->setMinimumLevel(0.f);
+    dense->setMaximumLevel(1.f);
+    addLayer(dense, LayerFactory::Colour3DPlot);
+
+    return layers;
+}
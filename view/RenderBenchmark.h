@@ -0,0 +1,137 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_RENDER_BENCHMARK_H
+#define SV_RENDER_BENCHMARK_H
+
+#include "base/BaseTypes.h"
+#include "base/ZoomLevel.h"
+#include "data/model/Model.h"
+
+#include <QString>
+#include <QSize>
+#include <QTextStream>
+
+#include <vector>
+#include <functional>
+
+class View;
+class Layer;
+
+/**
+ * Times the painting of layers offscreen, without a visible view or
+ * an event loop, so that the cost of rendering can be measured and
+ * compared from one build to the next.
+ *
+ * The benchmark drives an existing View, which must have a
+ * ViewManager but need not be shown, containing the layers to be
+ * timed. For each combination of device pixel ratio, pane size and
+ * zoom level in the Configuration, each layer is painted
+ * synchronously into a QImage through a ViewProxy: once from cold
+ * (after making the layer dormant, so that it discards its caches),
+ * then repeatedly with the same geometry, then repeatedly while
+ * scrolling by a tenth of the view width at a time. Each layer that
+ * draws a dense three-dimensional model, or a spectrogram, is also
+ * rendered directly by a fresh Colour3DPlotRenderer with a range of
+ * parameters and with each of the configured thread counts,
+ * recording which render type was chosen for each case. Comparing
+ * the thread counts shows how well the parallel rendering scales.
+ *
+ * The models shown by the layers must be ready before run() is
+ * called. createSyntheticLayers() supplies a set of layers with
+ * generated models, including a generated audio signal, that are
+ * ready immediately.
+ *
+ * Results can be written as CSV or JSON.
+ */
+class RenderBenchmark
+{
+public:
+    struct Configuration {
+        Configuration() : repetitions(5) { }
+
+        std::vector<ZoomLevel> zoomLevels;
+        std::vector<QSize> paneSizes;
+        std::vector<int> pixelRatios;
+        std::vector<int> threadCounts; // for renderers only
+        int repetitions;
+    };
+
+    struct Result {
+        QString layerType;    // from LayerFactory
+        QString renderer;     // empty for layer paints
+        QString renderType;   // empty for layer paints
+        int threads;          // 0 for layer paints
+        ZoomLevel zoomLevel;  // as attained by the view
+        QSize paneSize;       // in view (unscaled) pixels
+        int pixelRatio;
+        double coldMsec;      // first paint after caches discarded
+        double warmMsec;      // mean repaint with the same geometry
+        double scrollMsec;    // mean repaint after scrolling
+    };
+
+    /**
+     * Create a benchmark for the layers in the given view. The view
+     * is resized, zoomed and scrolled during run(), and left at its
+     * original geometry afterwards.
+     */
+    RenderBenchmark(View *view);
+
+    /**
+     * Return a configuration covering a spread of zoom levels, pane
+     * sizes up to 4K, pixel ratios 1 and 2, and rendering with one
+     * thread and with QThread::idealThreadCount() threads.
+     */
+    static Configuration getDefaultConfiguration();
+
+    void run(const Configuration &configuration);
+
+    const std::vector<Result> &getResults() const {
+        return m_results;
+    }
+
+    void writeCSV(QTextStream &out) const;
+    void writeJSON(QTextStream &out) const;
+
+    /**
+     * Create a set of layers for sparse and dense synthetic models of
+     * the given duration: a waveform and spectrogram of a generated
+     * sine sweep, time instants, time values, notes, regions,
+     * boxes, text labels, and a dense 3D plot. The models are registered with ModelById
+     * and their ids returned in the models argument; the caller owns
+     * the layers and should release the models when done.
+     */
+    static std::vector<Layer *> createSyntheticLayers
+    (sv_samplerate_t sampleRate, sv_frame_t duration,
+     std::vector<ModelId> &models);
+
+private:
+    View *m_view;
+    std::vector<Result> m_results;
+
+    void runLayer(Layer *layer, int pixelRatio, int repetitions);
+    void runRenderers(Layer *layer, int pixelRatio,
+                      const Configuration &configuration);
+
+    /**
+     * Fill in the cold, warm and scroll times of the result, calling
+     * paintOnce (which returns the time taken in msec) once from
+     * cold, then repeatedly in place and repeatedly while scrolling
+     * the view. The view's centre frame is restored afterwards.
+     */
+    void measure(Result &result, int repetitions,
+                 const std::function<double()> &paintOnce);
+};
+
+#endif
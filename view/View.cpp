@@ -22,10 +22,13 @@
 #include "base/Preferences.h"
 #include "base/HitCount.h"
 #include "ViewProxy.h"
+#include "ViewChunkProxy.h"
 
 #include "layer/TimeRulerLayer.h"
 #include "layer/SingleColourLayer.h"
 #include "layer/PaintAssistant.h"
+#include "layer/PaintTelemetry.h"
+#include "layer/RenderThreadPool.h"
 
 #include "data/model/RelativelyFineZoomConstraint.h"
 #include "data/model/RangeSummarisableTimeValueModel.h"
@@ -43,10 +46,19 @@
 #include <QPushButton>
 #include <QSettings>
 #include <QSvgGenerator>
+#include <QEventLoop>
+#include <QTimer>
+#include <QSemaphore>
+#include <QImage>
 
 #include <iostream>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <atomic>
 
 //#define DEBUG_VIEW 1
 //#define DEBUG_VIEW_WIDGET_PAINT 1
@@ -56,6 +68,7 @@
 View::View(QWidget *w, bool showProgress) :
     QFrame(w),
     m_id(getNextId()),
+    m_renderId(getNextId()),
     m_centreFrame(0),
     m_zoomLevel(ZoomLevel::FramesPerPixel, 1024),
     m_followPan(true),
@@ -64,9 +77,17 @@ View::View(QWidget *w, bool showProgress) :
     m_followPlayIsDetached(false),
     m_playPointerFrame(0),
     m_showProgress(showProgress),
+    m_showPaintTime(false),
+    m_parallelLayerPainting(false),
+    m_layersCompletion(-1),
     m_cache(nullptr),
     m_buffer(nullptr),
+    m_bufferValid(false),
+    m_bufferCentreFrame(0),
+    m_bufferZoomLevel(ZoomLevel::FramesPerPixel, 1024),
+    m_layerUpdatePending(false),
     m_cacheValid(false),
+    m_cacheOrigin(0),
     m_cacheCentreFrame(0),
     m_cacheZoomLevel(ZoomLevel::FramesPerPixel, 1024),
     m_selectionCached(false),
@@ -403,7 +424,7 @@ View::propertyContainerSelected(View *client, PropertyContainer *pc)
         return;
     }
 
-    m_cacheValid = false;
+    invalidateCache();
 
     Layer *selectedLayer = nullptr;
 
@@ -435,7 +456,7 @@ View::toolModeChanged()
 void
 View::overlayModeChanged()
 {
-    m_cacheValid = false;
+    invalidateCache();
     update();
 }
 
@@ -768,6 +789,119 @@ View::effectiveDevicePixelRatio() const
 #endif
 }
 
+std::vector<View::CacheSegment>
+View::getCacheSegments(QRect area) const
+{
+    std::vector<CacheSegment> segments;
+    if (!m_cache) {
+        return segments;
+    }
+    
+    int w = m_cache->width();
+    int h = m_cache->height();
+
+    // View columns up to the seam are found from m_cacheOrigin
+    // onwards in the pixmap, those from the seam onwards at the start
+    // of it
+    int seam = w - m_cacheOrigin;
+
+    QRect before(0, 0, seam, h);
+    QRect after(seam, 0, w - seam, h);
+
+    if (area.intersects(before)) {
+        segments.push_back({ area & before, before, m_cacheOrigin });
+    }
+    if (area.intersects(after)) {
+        segments.push_back({ area & after, after, -seam });
+    }
+    return segments;
+}
+
+int64_t
+View::getTileColumnOrigin(int dpratio) const
+{
+    // As when scrolling the cache, column positions are taken from
+    // unscaled x coordinates, so that they agree with the scrolling
+    return -int64_t(getXForFrame(0)) * dpratio;
+}
+
+QRect
+View::fillCacheFromTiles(QRect area, int dpratio)
+{
+    if (!m_cache || area.isEmpty()) {
+        return area;
+    }
+
+    int64_t origin = getTileColumnOrigin(dpratio);
+    int h = m_cache->height();
+    
+    std::vector<bool> covered(area.width(), false);
+    int drawn = 0;
+    
+    QPainter paint(m_cache);
+    for (const CacheSegment &segment : getCacheSegments(area)) {
+        std::vector<bool> segmentCovered;
+        drawn += m_tileCache.draw(m_zoomLevel, dpratio, h,
+                                  origin + segment.area.left(),
+                                  segment.area.width(),
+                                  paint,
+                                  segment.area.left() + segment.offset,
+                                  segmentCovered);
+        int offset = segment.area.left() - area.left();
+        for (int i = 0; in_range_for(segmentCovered, i); ++i) {
+            covered[offset + i] = segmentCovered[i];
+        }
+    }
+    paint.end();
+
+    if (drawn == 0) {
+        return area;
+    }
+
+    int a = 0, b = area.width();
+    while (a < b && covered[a]) ++a;
+    while (b > a && covered[b-1]) --b;
+
+#ifdef DEBUG_VIEW_WIDGET_PAINT
+    SVCERR << "View[" << getId() << "]::fillCacheFromTiles: found " << drawn
+           << " of " << area.width() << " columns, leaving " << b - a
+           << " to paint" << endl;
+#endif
+    
+    if (a == b) {
+        return QRect();
+    }
+    return QRect(area.left() + a, area.top(), b - a, area.height());
+}
+
+void
+View::storeCacheToTiles(QRect area, int dpratio)
+{
+    if (!m_cache || area.isEmpty()) {
+        return;
+    }
+
+    int64_t origin = getTileColumnOrigin(dpratio);
+    int h = m_cache->height();
+    
+    for (const CacheSegment &segment : getCacheSegments(area)) {
+        QRect a = segment.area;
+        sv_frame_t f0 = getFrameForX(a.left() / dpratio);
+        sv_frame_t f1 = getFrameForX(a.right() / dpratio + 1);
+        m_tileCache.store(m_zoomLevel, dpratio, origin + a.left(), *m_cache,
+                          QRect(a.left() + segment.offset, 0, a.width(), h),
+                          f0, f1);
+    }
+}
+
+void
+View::invalidateCache()
+{
+    m_cacheValid = false;
+    m_tileCache.clear();
+    m_layerUpdatePending = true;
+}
+
 void
 View::setZoomLevel(ZoomLevel z)
 {
@@ -849,7 +983,7 @@ View::getForeground() const
 void
 View::addLayer(Layer *layer)
 {
-    m_cacheValid = false;
+    invalidateCache();
 
     SingleColourLayer *scl = dynamic_cast<SingleColourLayer *>(layer);
     if (scl) scl->setDefaultColourFor(this);
@@ -911,6 +1045,8 @@ View::addLayer(Layer *layer)
     update();
 
     emit propertyContainerAdded(layer);
+
+    checkLayersCompletion();
 }
 
 void
@@ -920,7 +1056,7 @@ View::removeLayer(Layer *layer)
         return;
     }
 
-    m_cacheValid = false;
+    invalidateCache();
 
     for (LayerList::iterator i = m_fixedOrderLayers.begin();
          i != m_fixedOrderLayers.end();
@@ -966,6 +1102,8 @@ View::removeLayer(Layer *layer)
     update();
 
     emit propertyContainerRemoved(layer);
+
+    checkLayersCompletion();
 }
 
 Layer *
@@ -1017,6 +1155,7 @@ View::setViewManager(ViewManager *manager)
         m_manager->disconnect(this, SLOT(globalCentreFrameChanged(sv_frame_t)));
         m_manager->disconnect(this, SLOT(viewCentreFrameChanged(View *, sv_frame_t)));
         m_manager->disconnect(this, SLOT(viewManagerPlaybackFrameChanged(sv_frame_t)));
+        m_manager->disconnect(this, SLOT(viewManagerPlayPointerRefresh()));
         m_manager->disconnect(this, SLOT(viewZoomLevelChanged(View *, ZoomLevel, bool)));
         m_manager->disconnect(this, SLOT(toolModeChanged()));
         m_manager->disconnect(this, SLOT(selectionChanged()));
@@ -1034,6 +1173,8 @@ View::setViewManager(ViewManager *manager)
             this, SLOT(viewCentreFrameChanged(View *, sv_frame_t)));
     connect(m_manager, SIGNAL(playbackFrameChanged(sv_frame_t)),
             this, SLOT(viewManagerPlaybackFrameChanged(sv_frame_t)));
+    connect(m_manager, SIGNAL(playPointerRefresh()),
+            this, SLOT(viewManagerPlayPointerRefresh()));
 
     connect(m_manager, SIGNAL(viewZoomLevelChanged(View *, ZoomLevel, bool)),
             this, SLOT(viewZoomLevelChanged(View *, ZoomLevel, bool)));
@@ -1135,13 +1276,14 @@ View::modelChanged(ModelId modelId)
     }
 
     if (recreate) {
-        m_cacheValid = false;
+        invalidateCache();
     }
 
     emit layerModelChanged();
 
     checkProgress(modelId);
 
+    m_layerUpdatePending = true;
     update();
 }
 
@@ -1156,31 +1298,50 @@ View::modelChangedWithin(ModelId modelId,
     SVCERR << "View[" << getId() << "]::modelChangedWithin(" << startFrame << "," << endFrame << ") [me " << myStartFrame << "," << myEndFrame << "]" << endl;
 #endif
 
-    if (myStartFrame > 0 && endFrame < myStartFrame) {
-        checkProgress(modelId);
-        return;
-    }
-    if (startFrame > myEndFrame) {
-        checkProgress(modelId);
-        return;
-    }
-
     // If the model that has changed is not used by any of the cached
     // layers, we won't need to recreate the cache
     
     bool recreate = false;
 
+    // Unless all of the cached layers using the model paint it
+    // locally in time, the change may show anywhere and we must
+    // discard the whole cache, tiles and all
+    
+    bool local = true;
+
     bool discard;
     LayerList scrollables = getScrollableBackLayers(false, discard);
     for (LayerList::const_iterator i = scrollables.begin();
          i != scrollables.end(); ++i) {
         if ((*i)->getModel() == modelId) {
             recreate = true;
-            break;
+            if (!(*i)->isLayerPaintLocalInTime()) {
+                local = false;
+            }
         }
     }
 
     if (recreate) {
+        if (local) {
+            // Stored tiles may show the changed range even if we don't
+            m_tileCache.invalidateFrameRange(startFrame, endFrame);
+        } else {
+            invalidateCache();
+        }
+    }
+    
+    if (myStartFrame > 0 && endFrame < myStartFrame) {
+        checkProgress(modelId);
+        return;
+    }
+    if (startFrame > myEndFrame) {
+        checkProgress(modelId);
+        return;
+    }
+
+    if (recreate && local) {
+        // The tile cache still has everything outside the changed
+        // range, so only that will be repainted
         m_cacheValid = false;
     }
 
@@ -1189,6 +1350,7 @@ View::modelChangedWithin(ModelId modelId,
 
     checkProgress(modelId);
 
+    m_layerUpdatePending = true;
     update();
 }    
 
@@ -1199,6 +1361,7 @@ View::modelCompletionChanged(ModelId modelId)
     SVCERR << "View[" << getId() << "]::modelCompletionChanged(" << modelId << ")" << endl;
 #endif
     checkProgress(modelId);
+    checkLayersCompletion();
 }
 
 void
@@ -1216,7 +1379,7 @@ View::modelReplaced()
 #ifdef DEBUG_VIEW_WIDGET_PAINT
     SVCERR << "View[" << getId() << "]::modelReplaced()" << endl;
 #endif
-    m_cacheValid = false;
+    invalidateCache();
     update();
 }
 
@@ -1229,7 +1392,20 @@ View::layerParametersChanged()
     SVDEBUG << "View::layerParametersChanged()" << endl;
 #endif
 
-    m_cacheValid = false;
+    // Only the cached layers matter to the cache. If a change to
+    // another layer makes it scrollable, or changes which layers
+    // are, paintEvent will notice and invalidate the cache then
+    bool cached = true;
+    if (layer) {
+        bool discard;
+        LayerList scrollables = getScrollableBackLayers(false, discard);
+        cached = (std::find(scrollables.begin(), scrollables.end(), layer)
+                  != scrollables.end());
+    }
+    if (cached) {
+        invalidateCache();
+    }
+    m_layerUpdatePending = true;
     update();
 
     if (layer) {
@@ -1288,6 +1464,17 @@ View::viewManagerPlaybackFrameChanged(sv_frame_t f)
     SVCERR << "View[" << getId() << "]::viewManagerPlaybackFrameChanged(" << f << ")" << endl;
 #endif
 
+    // During playback the pointer is moved at the display refresh
+    // rate by viewManagerPlayPointerRefresh instead, except when
+    // scrolling continuously, where the pointer is not drawn and
+    // every move means repainting the whole view anyway
+    if (m_manager &&
+        m_manager->isPlaying() &&
+        !m_manager->isRecording() &&
+        m_followPlay != PlaybackScrollContinuous) {
+        return;
+    }
+
     f = getAlignedPlaybackFrame();
 
 #ifdef DEBUG_VIEW
@@ -1297,6 +1484,23 @@ View::viewManagerPlaybackFrameChanged(sv_frame_t f)
     movePlayPointer(f);
 }
 
+void
+View::viewManagerPlayPointerRefresh()
+{
+    if (!m_manager || sender() != m_manager) return;
+    if (m_followPlay == PlaybackScrollContinuous) return;
+
+    movePlayPointer(alignFromReference
+                    (m_manager->getInterpolatedPlaybackFrame()));
+}
+
+void
+View::updatePlayPointerArea(QRect r)
+{
+    m_playPointerRegion += r;
+    update(r);
+}
+
 void
 View::movePlayPointer(sv_frame_t newFrame)
 {
@@ -1360,8 +1564,8 @@ View::movePlayPointer(sv_frame_t newFrame)
             // Previously we had lagWidth effectively hardcoded as 4.
             // 
             int lagWidth = 60;
-            update(xold < lagWidth ? 0 : xold - lagWidth, 0,
-                   lagWidth + 5, height());
+            updatePlayPointerArea(QRect(xold < lagWidth ? 0 : xold - lagWidth,
+                                        0, lagWidth + 5, height()));
 
             sv_frame_t w = getEndFrame() - getStartFrame();
             w -= w/5;
@@ -1419,14 +1623,18 @@ View::movePlayPointer(sv_frame_t newFrame)
                 }
             }
 
-            update(xnew - 4, 0, 9, height());
+            updatePlayPointerArea(QRect(xnew - 4, 0, 9, height()));
         }
         break;
 
     case PlaybackIgnore:
-        if (m_playPointerFrame >= getStartFrame() &&
-            m_playPointerFrame < getEndFrame()) {
-            update();
+        if (pointerInVisibleArea) {
+            int lagWidth = 60;
+            int xold = getXForFrame(oldPlayPointerFrame);
+            int xnew = getXForFrame(m_playPointerFrame);
+            updatePlayPointerArea(QRect(xold < lagWidth ? 0 : xold - lagWidth,
+                                        0, lagWidth + 5, height()));
+            updatePlayPointerArea(QRect(xnew - 4, 0, 9, height()));
         }
         break;
     }
@@ -1447,7 +1655,7 @@ void
 View::selectionChanged()
 {
     if (m_selectionCached) {
-        m_cacheValid = false;
+        invalidateCache();
         m_selectionCached = false;
     }
     update();
@@ -2222,6 +2430,12 @@ View::setPaintFont(QPainter &paint)
         }
     }
 
+    setScaledPaintFont(paint, scaleFactor);
+}
+
+void
+View::setScaledPaintFont(QPainter &paint, int scaleFactor)
+{
     QFont font(paint.font());
     int pointSize = Preferences::getInstance()->getViewFontSize() * scaleFactor;
     font.setPointSize(pointSize);
@@ -2245,6 +2459,112 @@ View::getPaintRect() const
     return rect();
 }
 
+bool
+View::shouldUseAligningProxy(const Layer *layer,
+                             ModelId alignmentReferenceId) const
+{
+    if (!m_useAligningProxy) {
+        return false;
+    }
+    return (layer->getModel() == alignmentReferenceId ||
+            layer->getSourceModel() == alignmentReferenceId);
+}
+
+class View::ParallelLayerPaint
+{
+public:
+    struct Part {
+        QRect area;       // to be painted
+        QRect imageRect;  // the area plus any margin it may paint into
+    };
+
+    ParallelLayerPaint() { }
+
+    ~ParallelLayerPaint() {
+        // The tasks paint into our entries, so must not outlive them
+        for (auto &e : m_entries) {
+            wait(*e.second);
+        }
+    }
+
+    /**
+     * Start painting the given parts of a layer, each into a
+     * transparent image of its own covering its imageRect. The parts
+     * are painted one after another by a single task, as a layer may
+     * be painted concurrently with other layers but never with
+     * itself. Start each layer at most once.
+     *
+     * The proxy's colours are fixed here, as the view can only work
+     * them out on the GUI thread, and the font and foreground are
+     * taken from the caller's painter for the same reason.
+     */
+    void start(Layer *layer, ViewProxy *v,
+               std::vector<Part> parts, QFont font, QColor foreground) {
+
+        v->fixColours();
+
+        std::unique_ptr<Entry> &entry = m_entries[layer];
+        if (entry) {
+            throw std::logic_error("ParallelLayerPaint::start: layer already started");
+        }
+        entry.reset(new Entry);
+        entry->parts = parts;
+        entry->images.resize(parts.size());
+        Entry *e = entry.get();
+
+        RenderThreadPool::start([=]() {
+                for (int i = 0; i < int(e->parts.size()); ++i) {
+                    const Part &part = e->parts[i];
+                    QImage &image = e->images[i];
+                    image = QImage(part.imageRect.size(),
+                                   QImage::Format_ARGB32_Premultiplied);
+                    image.fill(Qt::transparent);
+                    QPainter paint(&image);
+                    paint.translate(-part.imageRect.topLeft());
+                    paint.setFont(font);
+                    paint.setPen(foreground);
+                    paint.setBrush(Qt::NoBrush);
+                    paint.setRenderHint(QPainter::Antialiasing, false);
+                    layer->paint(v, paint, part.area);
+                }
+            }, &e->done);
+    }
+
+    bool has(Layer *layer) const {
+        return m_entries.find(layer) != m_entries.end();
+    }
+
+    /**
+     * Wait for the given layer's images to be complete, and draw the
+     * image of the given part with the given painter, in view
+     * coordinates.
+     */
+    void drawTo(Layer *layer, int part, QPainter &paint) {
+        Entry &e = *m_entries.at(layer);
+        wait(e);
+        paint.drawImage(e.parts.at(part).imageRect.topLeft(),
+                        e.images.at(part));
+    }
+
+private:
+    struct Entry {
+        Entry() : waited(false) { }
+        std::vector<Part> parts;
+        std::vector<QImage> images;
+        QSemaphore done;
+        bool waited;
+    };
+
+    std::map<Layer *, std::unique_ptr<Entry>> m_entries;
+
+    static void wait(Entry &e) {
+        if (!e.waited) {
+            e.done.acquire();
+            e.waited = true;
+        }
+    }
+};
+
 void
 View::paintEvent(QPaintEvent *e)
 {
@@ -2263,16 +2583,65 @@ View::paintEvent(QPaintEvent *e)
         return;
     }
 
+    PaintTelemetry::PaintRecorder recorder(getId());
+
+    std::chrono::steady_clock::time_point paintStart;
+    if (m_showPaintTime) {
+        paintStart = std::chrono::steady_clock::now();
+    }
+
     // ensure our constraints are met
     m_zoomLevel = getZoomConstraintLevel
         (m_zoomLevel, ZoomConstraint::RoundNearest);
 
+    // If all we have been asked to repaint is where the play pointer
+    // has been and gone, and the buffer is still current, then the
+    // buffer has everything that belongs beneath the pointer: copy
+    // it back and draw the overlays on top, without painting layers.
+    // But a layer update that Qt has merged into the same region
+    // would be lost that way, so not if one of those is pending too
+
+    QRegion playPointerRegion = m_playPointerRegion;
+    m_playPointerRegion = QRegion();
+
+    bool layerUpdatePending = m_layerUpdatePending;
+    m_layerUpdatePending = false;
+
+    if (e &&
+        !layerUpdatePending &&
+        m_bufferValid &&
+        m_buffer &&
+        m_buffer->size() == scaledSize(size(), effectiveDevicePixelRatio()) &&
+        m_bufferCentreFrame == m_centreFrame &&
+        m_bufferZoomLevel == m_zoomLevel &&
+        (e->region() - playPointerRegion).isEmpty()) {
+
+#ifdef DEBUG_VIEW_WIDGET_PAINT
+        SVCERR << "View[" << getId() << "]::paintEvent: play pointer only" << endl;
+#endif
+
+        if (recorder.isActive()) {
+            recorder.setCacheOutcome(PaintTelemetry::CacheOutcome::Hit);
+            int dpratio = effectiveDevicePixelRatio();
+            recorder.addPixels(0, int64_t(e->rect().width()) * dpratio *
+                               e->rect().height() * dpratio);
+        }
+
+        paintBufferToWidget(e, paintStart);
+        return;
+    }
+
     // We have a cache, which retains the state of scrollable (back)
     // layers from one paint to the next, and a buffer, which we paint
     // onto before copying directly to the widget. Both are at scaled
     // resolution (e.g. 2x on a pixel-doubled display), whereas the
     // paint event always comes in at formal (1x) resolution.
 
+    // Columns painted into the cache are also kept in a tile cache,
+    // which survives zooming, resizing and scrolling away, and from
+    // which any area of the cache that needs to be repainted is
+    // filled first where possible.
+
     // If we touch the cache, we always leave it in a valid state
     // across its whole extent. When another method invalidates the
     // cache, it does so by setting m_cacheValid false, so if that
@@ -2287,10 +2656,12 @@ View::paintEvent(QPaintEvent *e)
     //    step 5.  Otherwise:
     // 
     // 2. Check the cache, scroll as necessary, identify any area that
-    //    needs to be refreshed (this might be the whole cache).
+    //    needs to be refreshed (this might be the whole cache), and
+    //    fill what we can of that from the tile cache.
     //
-    // 3. Paint to cache the area that needs to be refreshed, from the
-    //    stack of scrollable layers.
+    // 3. Paint to cache the area that still needs to be refreshed,
+    //    from the stack of scrollable layers, and store it in the
+    //    tile cache.
     //
     // 4. Paint to buffer from cache: if there are no non-cached areas
     //    or selections and the cache has not scrolled, then paint the
@@ -2328,7 +2699,7 @@ View::paintEvent(QPaintEvent *e)
 #endif
 
     if (layersChanged || scrollables.empty()) {
-        m_cacheValid = false;
+        invalidateCache();
     }
 
     QRect wholeArea(scaledRect(rect(), dpratio));
@@ -2337,6 +2708,7 @@ View::paintEvent(QPaintEvent *e)
     if (!m_buffer || wholeSize != m_buffer->size()) {
         delete m_buffer;
         m_buffer = new QPixmap(wholeSize);
+        m_bufferValid = false;
     }
 
     bool shouldUseCache = false;
@@ -2381,6 +2753,7 @@ View::paintEvent(QPaintEvent *e)
                     delete m_cache;
                     m_cache = new QPixmap(wholeSize);
                 }
+                m_cacheOrigin = 0;
 
 #ifdef DEBUG_VIEW_WIDGET_PAINT
                 SVCERR << "View[" << getId() << "]::paintEvent: cache is invalid, will repaint whole" << endl;
@@ -2388,6 +2761,7 @@ View::paintEvent(QPaintEvent *e)
             }
 
             count.miss();
+            recorder.setCacheOutcome(PaintTelemetry::CacheOutcome::Miss);
             
         } else if (m_cacheCentreFrame != m_centreFrame) {
 
@@ -2398,9 +2772,14 @@ View::paintEvent(QPaintEvent *e)
             int dx = dpratio * (getXForFrame(m_cacheCentreFrame) -
                                 getXForFrame(m_centreFrame));
 
-            if (dx > -m_cache->width() && dx < m_cache->width()) {
+            int w = m_cache->width();
+            
+            if (dx > -w && dx < w) {
 
-                m_cache->scroll(dx, 0, m_cache->rect(), nullptr);
+                // View column x now shows what was in column x - dx:
+                // move the origin to match rather than moving pixels
+                m_cacheOrigin = (m_cacheOrigin - dx) % w;
+                if (m_cacheOrigin < 0) m_cacheOrigin += w;
 
                 if (dx < 0) {
                     cacheAreaToRepaint = 
@@ -2411,12 +2790,16 @@ View::paintEvent(QPaintEvent *e)
                 }
 
                 count.partial();
+                recorder.setCacheOutcome
+                    (PaintTelemetry::CacheOutcome::Partial);
 
 #ifdef DEBUG_VIEW_WIDGET_PAINT
                 SVCERR << "View[" << getId() << "]::paintEvent: scrolled cache by " << dx << endl;
 #endif
             } else {
+                m_cacheOrigin = 0;
                 count.miss();
+                recorder.setCacheOutcome(PaintTelemetry::CacheOutcome::Miss);
 #ifdef DEBUG_VIEW_WIDGET_PAINT
                 SVCERR << "View[" << getId() << "]::paintEvent: scrolling too far" << endl;
 #endif
@@ -2427,7 +2810,23 @@ View::paintEvent(QPaintEvent *e)
             SVCERR << "View[" << getId() << "]::paintEvent: cache is good" << endl;
 #endif
             count.hit();
+            recorder.setCacheOutcome(PaintTelemetry::CacheOutcome::Hit);
+            shouldRepaintCache = false;
+        }
+    }
+
+    if (shouldRepaintCache) {
+
+        // Whatever the tile cache has of the area we were going to
+        // repaint need not be painted again
+
+        cacheAreaToRepaint = fillCacheFromTiles(cacheAreaToRepaint, dpratio);
+
+        if (cacheAreaToRepaint.isEmpty()) {
             shouldRepaintCache = false;
+            m_cacheValid = true;
+            m_cacheCentreFrame = m_centreFrame;
+            m_cacheZoomLevel = m_zoomLevel;
         }
     }
 
@@ -2443,6 +2842,23 @@ View::paintEvent(QPaintEvent *e)
         throw std::logic_error("ERROR: shouldRepaintCache is true, but shouldUseCache is false: this can't lead to the correct result");
     }
 
+    if (recorder.isActive()) {
+        auto pixels = [](QRect r) { return int64_t(r.width()) * r.height(); };
+        if (shouldRepaintCache) {
+            recorder.addPixels
+                (pixels(cacheAreaToRepaint),
+                 pixels(requestedPaintArea) -
+                 pixels(requestedPaintArea & cacheAreaToRepaint));
+        } else if (shouldUseCache) {
+            recorder.addPixels(0, pixels(requestedPaintArea));
+        } else {
+            recorder.addPixels(pixels(requestedPaintArea), 0);
+        }
+        if (!nonScrollables.empty()) {
+            recorder.addPixels(pixels(requestedPaintArea), 0);
+        }
+    }
+
     // Create the ViewProxy for geometry provision, using the
     // device-pixel ratio for pixel-doubled hi-dpi rendering as
     // appropriate.
@@ -2472,58 +2888,129 @@ View::paintEvent(QPaintEvent *e)
     ViewProxy aligningProxy(this, dpratio, alignmentModelId);
     
     // Scrollable (cacheable) items first. If we are repainting the
-    // cache, then we paint these to the cache; otherwise straight to
-    // the buffer.
-    QRect areaToPaint;
+    // cache, then we paint these to the cache, once for each part of
+    // the area that is contiguous in it; otherwise straight to the
+    // buffer.
+    std::vector<CacheSegment> segments;
     QPainter paint;
 
     if (shouldRepaintCache) {
         paint.begin(m_cache);
-        areaToPaint = cacheAreaToRepaint;
+        segments = getCacheSegments(cacheAreaToRepaint);
     } else {
         paint.begin(m_buffer);
-        areaToPaint = requestedPaintArea;
+        segments.push_back({ requestedPaintArea, wholeArea, 0 });
     }
 
     setPaintFont(paint);
 
-    // This clipping is not a good idea I think - layers often
-    // intentionally paint outside the lines a little because they
-    // don't have a very precise idea about e.g. parts of text labels
-    // which overlay an area. We pass areaToPaint to the paint
-    // function anyway, so if clipping matters to it, it should enable
-    // it itself
-//    paint.setClipRect(areaToPaint);
+    // If painting in parallel, start all of the thread-safe layers,
+    // scrollable and not, painting into images of their own now. We
+    // carry on painting the rest in order as usual, and composite
+    // each image as we reach its place in the stack, so the time
+    // spent waiting is only that by which the slowest layer outruns
+    // everything else. Each image covers its area plus a margin
+    // either side within the contiguous run, as layers may paint a
+    // little outside the area they are asked for (see below).
+    
+    ParallelLayerPaint parallel;
 
-    paint.setPen(getBackground());
-    paint.setBrush(getBackground());
-    paint.drawRect(areaToPaint);
+    if (m_parallelLayerPainting &&
+        scrollables.size() + nonScrollables.size() > 1) {
 
-    paint.setPen(getForeground());
-    paint.setBrush(Qt::NoBrush);
+        int margin = 100 * dpratio;
+        QFont font = paint.font();
+        QColor foreground = getForeground();
         
-    for (LayerList::iterator i = scrollables.begin();
-         i != scrollables.end(); ++i) {
+        // A scrollable layer may have several segments to paint, all
+        // of which go to the same task so that it is never painted
+        // concurrently with itself
+        std::vector<ParallelLayerPaint::Part> parts;
+        for (const CacheSegment &segment : segments) {
+            parts.push_back({ segment.area,
+                              segment.area.adjusted(-margin, 0, margin, 0) &
+                              segment.extent });
+        }
+        
+        for (Layer *layer : scrollables) {
+            if (!layer->isLayerThreadSafe()) continue;
+            parallel.start
+                (layer,
+                 shouldUseAligningProxy(layer, alignmentReferenceId) ?
+                 &aligningProxy : &proxy,
+                 parts, font, foreground);
+        }
+
+        // The non-scrollable layers are clipped to the requested area
+        for (Layer *layer : nonScrollables) {
+            if (!layer->isLayerThreadSafe()) continue;
+            parallel.start
+                (layer,
+                 shouldUseAligningProxy(layer, alignmentReferenceId) ?
+                 &aligningProxy : &proxy,
+                 { { requestedPaintArea, requestedPaintArea } },
+                 font, foreground);
+        }
+    }
+
+    for (int pass = 0; pass < int(segments.size()); ++pass) {
+
+        const CacheSegment &segment = segments[pass];
+
+        QRect areaToPaint = segment.area;
 
-        paint.setRenderHint(QPainter::Antialiasing, false);
         paint.save();
+        if (segment.offset != 0) {
+            // Layers paint in view coordinates. Clip to the contiguous
+            // run, so that anything painted outside the area does not
+            // wrap around onto the far side of the cache
+            paint.translate(segment.offset, 0);
+            paint.setClipRect(segment.extent);
+        }
+
+        // This clipping is not a good idea I think - layers often
+        // intentionally paint outside the lines a little because they
+        // don't have a very precise idea about e.g. parts of text labels
+        // which overlay an area. We pass areaToPaint to the paint
+        // function anyway, so if clipping matters to it, it should enable
+        // it itself
+//    paint.setClipRect(areaToPaint);
 
-        Layer *layer = *i;
+        paint.setPen(getBackground());
+        paint.setBrush(getBackground());
+        paint.drawRect(areaToPaint);
+
+        paint.setPen(getForeground());
+        paint.setBrush(Qt::NoBrush);
         
-        bool useAligningProxy = false;
-        if (m_useAligningProxy) {
-            if (layer->getModel() == alignmentReferenceId ||
-                layer->getSourceModel() == alignmentReferenceId) {
-                useAligningProxy = true;
-            }
-        }
+        for (LayerList::iterator i = scrollables.begin();
+             i != scrollables.end(); ++i) {
+
+            paint.setRenderHint(QPainter::Antialiasing, false);
+            paint.save();
+
+            Layer *layer = *i;
+        
+            bool useAligningProxy =
+                shouldUseAligningProxy(layer, alignmentReferenceId);
 
 #ifdef DEBUG_VIEW_WIDGET_PAINT
-        SVCERR << "Painting scrollable layer " << layer << " (model " << layer->getModel() << ", source model " << layer->getSourceModel() << ") with shouldRepaintCache = " << shouldRepaintCache << ", useAligningProxy = " << useAligningProxy << ", dpratio = " << dpratio << ", areaToPaint = " << areaToPaint.x() << "," << areaToPaint.y() << " " << areaToPaint.width() << "x" << areaToPaint.height() << endl;
+            SVCERR << "Painting scrollable layer " << layer << " (model " << layer->getModel() << ", source model " << layer->getSourceModel() << ") with shouldRepaintCache = " << shouldRepaintCache << ", useAligningProxy = " << useAligningProxy << ", dpratio = " << dpratio << ", areaToPaint = " << areaToPaint.x() << "," << areaToPaint.y() << " " << areaToPaint.width() << "x" << areaToPaint.height() << endl;
 #endif
-        
-        layer->paint(useAligningProxy ? &aligningProxy : &proxy,
-                     paint, areaToPaint);
+
+            // For a layer painted in parallel, this times only our
+            // wait for it to finish plus the compositing
+            recorder.startLayer(layer);
+            if (parallel.has(layer)) {
+                parallel.drawTo(layer, pass, paint);
+            } else {
+                layer->paint(useAligningProxy ? &aligningProxy : &proxy,
+                             paint, areaToPaint);
+            }
+            recorder.endLayer();
+
+            paint.restore();
+        }
 
         paint.restore();
     }
@@ -2532,6 +3019,7 @@ View::paintEvent(QPaintEvent *e)
 
     if (shouldRepaintCache) {
         // and now we have
+        storeCacheToTiles(cacheAreaToRepaint, dpratio);
         m_cacheValid = true;
         m_cacheCentreFrame = m_centreFrame;
         m_cacheZoomLevel = m_zoomLevel;
@@ -2539,7 +3027,11 @@ View::paintEvent(QPaintEvent *e)
 
     if (shouldUseCache) {
         paint.begin(m_buffer);
-        paint.drawPixmap(requestedPaintArea, *m_cache, requestedPaintArea);
+        for (const CacheSegment &segment :
+                 getCacheSegments(requestedPaintArea)) {
+            paint.drawPixmap(segment.area, *m_cache,
+                             segment.area.translated(segment.offset, 0));
+        }
         paint.end();
     }
 
@@ -2562,27 +3054,51 @@ View::paintEvent(QPaintEvent *e)
         
         Layer *layer = *i;
         
-        bool useAligningProxy = false;
-        if (m_useAligningProxy) {
-            if (layer->getModel() == alignmentReferenceId ||
-                layer->getSourceModel() == alignmentReferenceId) {
-                useAligningProxy = true;
-            }
-        }
+        bool useAligningProxy =
+            shouldUseAligningProxy(layer, alignmentReferenceId);
 
 #ifdef DEBUG_VIEW_WIDGET_PAINT
         SVCERR << "Painting non-scrollable layer " << layer << " (model " << layer->getModel() << ", source model " << layer->getSourceModel() << ") with shouldRepaintCache = " << shouldRepaintCache << ", useAligningProxy = " << useAligningProxy << ", dpratio = " << dpratio << ", requestedPaintArea = " << requestedPaintArea.x() << "," << requestedPaintArea.y() << " " << requestedPaintArea.width() << "x" << requestedPaintArea.height() << endl;
 #endif
 
-        layer->paint(useAligningProxy ? &aligningProxy : &proxy,
-                     paint, requestedPaintArea);
+        recorder.startLayer(layer);
+        if (parallel.has(layer)) {
+            parallel.drawTo(layer, 0, paint);
+        } else {
+            layer->paint(useAligningProxy ? &aligningProxy : &proxy,
+                         paint, requestedPaintArea);
+        }
+        recorder.endLayer();
     }
         
     paint.end();
 
-    // Now paint to widget from buffer: target rects from here on,
-    // unlike all the preceding, are at formal (1x) resolution
+    // The buffer is now current everywhere if we painted all of it,
+    // or if we painted part of it and nothing has moved since it was
+    // last current
 
+    if (requestedPaintArea == wholeArea) {
+        m_bufferValid = true;
+        m_bufferCentreFrame = m_centreFrame;
+        m_bufferZoomLevel = m_zoomLevel;
+    } else if (m_bufferCentreFrame != m_centreFrame ||
+               m_bufferZoomLevel != m_zoomLevel) {
+        m_bufferValid = false;
+    }
+
+    paintBufferToWidget(e, paintStart);
+}
+
+void
+View::paintBufferToWidget(QPaintEvent *e,
+                          std::chrono::steady_clock::time_point paintStart)
+{
+    // Target rects from here on, unlike all the preceding, are at
+    // formal (1x) resolution
+
+    int dpratio = effectiveDevicePixelRatio();
+    
+    QPainter paint;
     paint.begin(this);
     setPaintFont(paint);
     if (e) paint.setClipRect(e->rect());
@@ -2594,9 +3110,42 @@ View::paintEvent(QPaintEvent *e)
     drawSelections(paint);
     drawPlayPointer(paint);
 
+    if (m_showPaintTime) {
+        double msec = std::chrono::duration<double, std::milli>
+            (std::chrono::steady_clock::now() - paintStart).count();
+        drawPaintTime(paint, msec);
+    }
+
     paint.end();
 }
 
+void
+View::setShowPaintTime(bool show)
+{
+    if (m_showPaintTime == show) return;
+    m_showPaintTime = show;
+    update();
+}
+
+void
+View::setParallelLayerPainting(bool parallel)
+{
+    // Either way produces the same picture, so there's nothing to
+    // invalidate
+    m_parallelLayerPainting = parallel;
+}
+
+void
+View::drawPaintTime(QPainter &paint, double msec)
+{
+    QString text = QString("%1 ms").arg(msec, 0, 'f', 1);
+    QFontMetrics metrics(paint.font());
+    int x = width() - metrics.boundingRect(text).width() - 5;
+    int y = metrics.ascent() + 5;
+    PaintAssistant::drawVisibleText(this, paint, x, y, text,
+                                    PaintAssistant::OutlinedText);
+}
+
 void
 View::drawSelections(QPainter &paint)
 {
@@ -3032,149 +3581,313 @@ View::drawMeasurementRect(QPainter &paint, const Layer *topLayer, QRect r,
     paint.restore();
 }
 
-bool
-View::waitForLayersToBeReady()
+int
+View::getLayersCompletion() const
 {
-    bool someLayersIncomplete = false;
+    int completion = 100;
 
-#ifdef DEBUG_VIEW
-    SVDEBUG << "View::waitForLayersToBeReady: checking completion" << endl;
-#endif
-    
-    for (LayerList::iterator i = m_layerStack.begin();
-         i != m_layerStack.end(); ++i) {
-
-        int c = (*i)->getCompletion(this);
+    for (const Layer *layer : m_layerStack) {
+        int c = layer->getCompletion(const_cast<View *>(this));
 
 #ifdef DEBUG_VIEW
-        SVDEBUG << "layer " << (*i)->getLayerPresentationName() << " says "
+        SVDEBUG << "layer " << layer->getLayerPresentationName() << " says "
                 << c << endl;
 #endif
-        
-        if (c < 100) {
-            someLayersIncomplete = true;
-            break;
+
+        if (c < completion) {
+            completion = c;
         }
     }
 
-    if (someLayersIncomplete) {
+    return completion;
+}
 
-        QProgressDialog progress(tr("Waiting for layers to be ready..."),
-                                 tr("Cancel"), 0, 100, this);
-        
-        int layerCompletion = 0;
+void
+View::checkLayersCompletion()
+{
+    int completion = getLayersCompletion();
+    if (completion == m_layersCompletion) {
+        return;
+    }
 
-        while (layerCompletion < 100) {
+    bool wasReady = (m_layersCompletion >= 100);
+    m_layersCompletion = completion;
 
-#ifdef DEBUG_VIEW
-            SVDEBUG << "View::render: checking completion (again)" << endl;
-#endif
+    emit layersCompletionChanged(completion);
+
+    if (completion >= 100 && !wasReady) {
+        emit layersReady();
+    }
+}
+
+bool
+View::waitForLayersReady(int timeoutMsec)
+{
+    return waitForLayers(timeoutMsec, nullptr);
+}
+
+bool
+View::waitForLayersToBeReady()
+{
+    if (getLayersCompletion() >= 100) {
+        return true;
+    }
     
-            for (LayerList::iterator i = m_layerStack.begin();
-                 i != m_layerStack.end(); ++i) {
+    QProgressDialog progress(tr("Waiting for layers to be ready..."),
+                             tr("Cancel"), 0, 100, this);
 
-                int c = (*i)->getCompletion(this);
-                if (i == m_layerStack.begin() || c < layerCompletion) {
-                    layerCompletion = c;
-                }
+    if (!waitForLayers(-1, &progress)) {
+        update();
+        return false;
+    }
+
+    return true;
+}
 
+bool
+View::waitForLayers(int timeoutMsec, QProgressDialog *progress)
+{
 #ifdef DEBUG_VIEW
-                SVDEBUG << "layer " << (*i)->getLayerPresentationName() << " says "
-                        << c << ", layerCompletion now " << layerCompletion << endl;
+    SVDEBUG << "View::waitForLayers: checking completion" << endl;
 #endif
-            }
+    
+    m_layersCompletion = getLayersCompletion();
+    if (m_layersCompletion >= 100) {
+        return true;
+    }
 
-            if (layerCompletion >= 100) break;
+    // Sleep in an event loop until the layers tell us they are
+    // ready, the timeout expires, or the user cancels
 
-            progress.setValue(layerCompletion);
-            qApp->processEvents();
-            if (progress.wasCanceled()) {
-                update();
-                return false;
-            }
+    QEventLoop loop;
+    connect(this, SIGNAL(layersReady()), &loop, SLOT(quit()));
 
-            usleep(50000);
-        }
+    QTimer timeout;
+    if (timeoutMsec >= 0) {
+        timeout.setSingleShot(true);
+        connect(&timeout, SIGNAL(timeout()), &loop, SLOT(quit()));
+        timeout.start(timeoutMsec);
+    }
+
+    // Not every layer's completion depends only on its model, so we
+    // may not hear about every change. Check again once in a while
+    // as a backstop - this is not what normally wakes us
+    QTimer recheck;
+    connect(&recheck, SIGNAL(timeout()), this, SLOT(checkLayersCompletion()));
+    recheck.start(500);
+
+    if (progress) {
+        progress->setValue(m_layersCompletion);
+        connect(this, SIGNAL(layersCompletionChanged(int)),
+                progress, SLOT(setValue(int)));
+        connect(progress, SIGNAL(canceled()), &loop, SLOT(quit()));
     }
 
+    loop.exec();
+
+    bool ready = (getLayersCompletion() >= 100);
+
 #ifdef DEBUG_VIEW
-    SVDEBUG << "View::waitForLayersToBeReady: ok, we're ready" << endl;
+    if (ready) {
+        SVDEBUG << "View::waitForLayers: ok, we're ready" << endl;
+    } else {
+        SVDEBUG << "View::waitForLayers: timed out or cancelled" << endl;
+    }
 #endif
 
-    return true;
+    return ready;
 }
 
 bool
 View::render(QPainter &paint, int xorigin, sv_frame_t f0, sv_frame_t f1)
 {
-    int x0 = int(round(m_zoomLevel.framesToPixels(double(f0))));
-    int x1 = int(round(m_zoomLevel.framesToPixels(double(f1))));
+    if (!waitForLayersToBeReady()) {
+        return false;
+    }
 
-    int w = x1 - x0;
+    // Each chunk is painted through a proxy with its own geometry,
+    // so that we don't have to move the view itself
+    ViewChunkProxy origin(this, 1, m_renderId, 0, 0);
+    int64_t leftPixel = origin.getPixelForFrame(f0);
+    int64_t w = origin.getPixelForFrame(f1) - leftPixel;
+    int h = origin.getPaintHeight();
 
 #ifdef DEBUG_VIEW
     SVDEBUG << "View::render: Render request is for frames " << f0
-            << " to " << f1 << " (pixels " << x0 << " to " << x1
-            << ", width " << w << ")" << endl;
+            << " to " << f1 << " (pixels " << leftPixel << " to "
+            << leftPixel + w << ")" << endl;
 #endif
 
-    if (!waitForLayersToBeReady()) {
+    LayerList layers;
+    for (Layer *layer : m_layerStack) {
+        if (!layer->isLayerDormant(this)) {
+            layers.push_back(layer);
+            layer->setSynchronousPainting(true);
+        }
+    }
+
+    // Layers painted in parallel arrive as images, which is fine for
+    // a raster target but not for e.g. an SVG generator
+    bool parallel = (paint.device() &&
+                     paint.device()->devType() == QInternal::Image);
+    
+    for (int64_t x = 0; x < w; x += renderChunkWidth) {
+
+        int chunkWidth = int(std::min(int64_t(renderChunkWidth), w - x));
+        ViewChunkProxy proxy(this, 1, m_renderId, leftPixel + x, chunkWidth);
+
+        paint.save();
+        paint.translate(xorigin + int(x), 0);
+        paint.setClipRect(QRect(0, 0, chunkWidth, h), Qt::IntersectClip);
+        paintChunk(paint, layers, &proxy, parallel);
+        paint.restore();
+    }
+
+    releaseRenderCaches(layers, &origin);
+    return true;
+}
+
+bool
+View::renderPartToSink(RenderSink &sink, sv_frame_t f0, sv_frame_t f1,
+                       int scaleFactor, int readyTimeoutMsec)
+{
+    if (scaleFactor < 1) {
+        scaleFactor = 1;
+    }
+
+    ViewChunkProxy origin(this, scaleFactor, m_renderId, 0, 0);
+    int64_t leftPixel = origin.getPixelForFrame(f0);
+    int64_t w = origin.getPixelForFrame(f1) - leftPixel;
+    int h = origin.getPaintHeight();
+
+    if (w <= 0 || w > INT_MAX || h <= 0) {
+        SVCERR << "View::renderPartToSink: Can't render image of size "
+               << w << "x" << h << " for frames " << f0 << " to " << f1
+               << endl;
         return false;
     }
 
-    sv_frame_t origCentreFrame = m_centreFrame;
+#ifdef DEBUG_VIEW
+    SVDEBUG << "View::renderPartToSink: Render request is for frames " << f0
+            << " to " << f1 << " (pixels " << leftPixel << " to "
+            << leftPixel + w << ") at scale factor " << scaleFactor << endl;
+#endif
     
-    QProgressDialog progress(tr("Rendering image..."),
-                             tr("Cancel"), 0, w / width(), this);
+    if (!waitForLayersReady(readyTimeoutMsec)) {
+        SVCERR << "View::renderPartToSink: Timed out waiting for layers "
+               << "to be ready" << endl;
+        return false;
+    }
 
-    for (int x = 0; x < w; x += width()) {
+    if (!sink.begin(QSize(int(w), h))) {
+        return false;
+    }
 
-        progress.setValue(x / width());
-        qApp->processEvents();
-        if (progress.wasCanceled()) {
-            m_centreFrame = origCentreFrame;
-            update();
-            return false;
+    LayerList layers;
+    for (Layer *layer : m_layerStack) {
+        if (!layer->isLayerDormant(this)) {
+            layers.push_back(layer);
+            layer->setSynchronousPainting(true);
         }
+    }
 
-        m_centreFrame = f0 + sv_frame_t(round(m_zoomLevel.pixelsToFrames
-                                              (x + width()/2)));
-        
-        QRect chunk(0, 0, width(), height());
+    // One chunk is written on the render thread pool while we render
+    // the next. The semaphore is available while no write is pending
+    QSemaphore writable(1);
+    std::atomic<bool> written(true);
 
-        paint.setPen(getBackground());
-        paint.setBrush(getBackground());
+    for (int64_t x = 0; x < w; x += renderChunkWidth) {
 
-        paint.drawRect(QRect(xorigin + x, 0, width(), height()));
+        int chunkWidth = int(std::min(int64_t(renderChunkWidth), w - x));
+        QImage chunk = renderChunk(layers, leftPixel + x, chunkWidth,
+                                   scaleFactor);
 
-        paint.setPen(getForeground());
-        paint.setBrush(Qt::NoBrush);
+        writable.acquire();
+        if (!written) {
+            writable.release();
+            break;
+        }
+        
+        RenderThreadPool::start([&sink, &written, x, chunk]() {
+                if (!sink.writeChunk(int(x), chunk)) {
+                    written = false;
+                }
+            }, &writable);
+    }
+
+    writable.acquire();
 
-        for (LayerList::iterator i = m_layerStack.begin();
-             i != m_layerStack.end(); ++i) {
-            if (!((*i)->isLayerDormant(this))){
+    releaseRenderCaches(layers, &origin);
+    
+    if (!written) {
+        return false;
+    }
+    return sink.end();
+}
+
+QImage
+View::renderChunk(const LayerList &layers, int64_t leftPixel, int width,
+                  int scaleFactor)
+{
+    ViewChunkProxy proxy(this, scaleFactor, m_renderId, leftPixel, width);
 
-                paint.setRenderHint(QPainter::Antialiasing, false);
+    QImage image(width, proxy.getPaintHeight(), QImage::Format_RGB32);
 
-                paint.save();
-                paint.translate(xorigin + x, 0);
+    QPainter paint(&image);
+    setScaledPaintFont(paint, scaleFactor);
+    paintChunk(paint, layers, &proxy, true);
+    paint.end();
+    
+    return image;
+}
 
-                SVCERR << "Centre frame now: " << m_centreFrame << " drawing to " << chunk.x() + x + xorigin << ", " << chunk.width() << endl;
+void
+View::paintChunk(QPainter &paint, const LayerList &layers,
+                 ViewChunkProxy *proxy, bool parallel)
+{
+    QRect chunk(0, 0, proxy->getPaintWidth(), proxy->getPaintHeight());
 
-                (*i)->setSynchronousPainting(true);
+    paint.setPen(getBackground());
+    paint.setBrush(getBackground());
+    paint.drawRect(chunk);
 
-                (*i)->paint(this, paint, chunk);
+    paint.setPen(getForeground());
+    paint.setBrush(Qt::NoBrush);
 
-                (*i)->setSynchronousPainting(false);
+    ParallelLayerPaint parallelPaint;
 
-                paint.restore();
+    if (parallel && layers.size() > 1) {
+        for (Layer *layer : layers) {
+            if (layer->isLayerThreadSafe()) {
+                parallelPaint.start(layer, proxy, { { chunk, chunk } },
+                                    paint.font(), getForeground());
             }
         }
     }
 
-    m_centreFrame = origCentreFrame;
-    update();
-    return true;
+    for (Layer *layer : layers) {
+        if (parallelPaint.has(layer)) {
+            parallelPaint.drawTo(layer, 0, paint);
+            continue;
+        }
+        paint.setRenderHint(QPainter::Antialiasing, false);
+        paint.save();
+        layer->paint(proxy, paint, chunk);
+        paint.restore();
+    }
+}
+
+void
+View::releaseRenderCaches(const LayerList &layers,
+                          LayerGeometryProvider *origin)
+{
+    // Making the layers dormant for the render id causes them to
+    // discard whatever they have cached for it
+    for (Layer *layer : layers) {
+        layer->setSynchronousPainting(false);
+        layer->setLayerDormant(origin, true);
+        layer->setLayerDormant(origin, false);
+    }
 }
 
 QImage *
@@ -3190,23 +3903,54 @@ View::renderToNewImage()
     return renderPartToNewImage(f0, f1);
 }
 
+namespace {
+
+/**
+ * A View::RenderSink that assembles the chunks into a single image.
+ */
+class WholeImageSink : public View::RenderSink
+{
+public:
+    bool begin(QSize size) override {
+        m_image = QImage(size, QImage::Format_RGB32);
+        return !m_image.isNull();
+    }
+
+    bool writeChunk(int x, const QImage &chunk) override {
+        int bytes = chunk.width() * 4;
+        for (int y = 0; y < chunk.height(); ++y) {
+            memcpy(m_image.scanLine(y) + x * 4, chunk.constScanLine(y), bytes);
+        }
+        return true;
+    }
+
+    bool end() override {
+        return true;
+    }
+
+    QImage getImage() const { return m_image; }
+
+private:
+    QImage m_image;
+};
+
+}
+
 QImage *
 View::renderPartToNewImage(sv_frame_t f0, sv_frame_t f1)
 {
-    int x0 = int(round(getZoomLevel().framesToPixels(double(f0))));
-    int x1 = int(round(getZoomLevel().framesToPixels(double(f1))));
-    
-    QImage *image = new QImage(x1 - x0, height(), QImage::Format_RGB32);
+    if (!waitForLayersToBeReady()) {
+        return nullptr;
+    }
 
-    QPainter *paint = new QPainter(image);
-    if (!render(*paint, 0, f0, f1)) {
-        delete paint;
-        delete image;
+    // The result has to be whole, but it is the only full-width
+    // image: each chunk is copied into it as it is rendered
+    WholeImageSink sink;
+    if (!renderPartToSink(sink, f0, f1)) {
         return nullptr;
-    } else {
-        delete paint;
-        return image;
     }
+
+    return new QImage(sink.getImage());
 }
 
 QSize
@@ -3218,13 +3962,17 @@ View::getRenderedImageSize()
     return getRenderedPartImageSize(f0, f1);
 }
     
+int
+View::getRenderedPartWidth(sv_frame_t f0, sv_frame_t f1)
+{
+    ViewChunkProxy origin(this, 1, m_renderId, 0, 0);
+    return int(origin.getPixelForFrame(f1) - origin.getPixelForFrame(f0));
+}
+
 QSize
 View::getRenderedPartImageSize(sv_frame_t f0, sv_frame_t f1)
 {
-    int x0 = int(round(getZoomLevel().framesToPixels(double(f0))));
-    int x1 = int(round(getZoomLevel().framesToPixels(double(f1))));
-
-    return QSize(x1 - x0, height());
+    return QSize(getRenderedPartWidth(f0, f1), height());
 }
 
 bool
@@ -3239,13 +3987,12 @@ View::renderToSvgFile(QString filename)
 bool
 View::renderPartToSvgFile(QString filename, sv_frame_t f0, sv_frame_t f1)
 {
-    int x0 = int(round(getZoomLevel().framesToPixels(double(f0))));
-    int x1 = int(round(getZoomLevel().framesToPixels(double(f1))));
+    int w = getRenderedPartWidth(f0, f1);
 
     QSvgGenerator generator;
     generator.setFileName(filename);
-    generator.setSize(QSize(x1 - x0, height()));
-    generator.setViewBox(QRect(0, 0, x1 - x0, height()));
+    generator.setSize(QSize(w, height()));
+    generator.setViewBox(QRect(0, 0, w, height()));
     generator.setTitle(tr("Exported image from %1")
                        .arg(QApplication::applicationName()));
     
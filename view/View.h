@@ -24,6 +24,7 @@
 #include "base/ZoomConstraint.h"
 #include "base/PropertyContainer.h"
 #include "ViewManager.h"
+#include "ViewTileCache.h"
 #include "base/XmlExportable.h"
 #include "base/BaseTypes.h"
 
@@ -33,11 +34,15 @@
 
 class Layer;
 class ViewPropertyContainer;
+class ViewChunkProxy;
 
 class QPushButton;
+class QProgressDialog;
 
 #include <map>
 #include <set>
+#include <vector>
+#include <chrono>
 
 /**
  * View is the base class of widgets that display one or more
@@ -288,6 +293,25 @@ public:
         return false;
     }
 
+    /**
+     * Show or hide an overlay in the top-right corner giving the time
+     * taken by each paint of this view. See also PaintTelemetry for
+     * a more detailed record that can be queried by the application.
+     */
+    virtual void setShowPaintTime(bool show);
+    virtual bool getShowPaintTime() const { return m_showPaintTime; }
+
+    /**
+     * Paint those layers that report themselves thread-safe (see
+     * Layer::isLayerThreadSafe) concurrently on the render thread
+     * pool, each into an image of its own, compositing the results
+     * in stacking order. Off by default.
+     */
+    virtual void setParallelLayerPainting(bool parallel);
+    virtual bool getParallelLayerPainting() const {
+        return m_parallelLayerPainting;
+    }
+
     virtual void setPlaybackFollow(PlaybackFollowMode m);
     virtual PlaybackFollowMode getPlaybackFollow() const { return m_followPlay; }
 
@@ -353,6 +377,72 @@ public:
     virtual bool renderPartToSvgFile(QString filename,
                                      sv_frame_t f0, sv_frame_t f1);
 
+    /**
+     * Return the lowest completion percentage reported by any of the
+     * layers in the view, or 100 if all are complete.
+     */
+    int getLayersCompletion() const;
+
+    /**
+     * Wait until every layer reports itself complete, or until the
+     * given timeout in milliseconds has elapsed (if it is not
+     * negative). This runs a local event loop, woken by the layers'
+     * completion notifications, and shows no GUI, so it may be used
+     * by scripted or batch rendering. Return true if the layers are
+     * ready. See also the layersReady signal.
+     */
+    bool waitForLayersReady(int timeoutMsec = -1);
+
+    /**
+     * Receiver for the output of renderPartToSink(). 
+     */
+    class RenderSink
+    {
+    public:
+        virtual ~RenderSink() { }
+
+        /**
+         * Called once before any chunks, with the size of the whole
+         * image. Return false to abandon the render.
+         */
+        virtual bool begin(QSize size) = 0;
+
+        /**
+         * Called with each chunk of the image in turn from left to
+         * right, x being the chunk's left edge within the whole
+         * image. This may be called from a thread other than the one
+         * rendering, though never for two chunks at once. Return
+         * false to abandon the render.
+         */
+        virtual bool writeChunk(int x, const QImage &chunk) = 0;
+
+        /**
+         * Called once after the last chunk has been written, if
+         * nothing failed. Return false to report failure.
+         */
+        virtual bool end() = 0;
+    };
+
+    /**
+     * Render the view contents between the given frame extents,
+     * scaled up by the given factor, and pass them to the sink in
+     * chunks of renderChunkWidth pixels, writing each chunk while
+     * rendering the next. This first waits up to readyTimeoutMsec
+     * (or indefinitely if negative) for the layers to be ready, as
+     * waitForLayersReady, and fails if they are not. It does not
+     * move the view, show a progress dialog or process events while
+     * rendering, and uses memory for only a couple of
+     * chunks at a time however wide the result, so it is suitable
+     * for very large exports made in batch. Layers that are
+     * thread-safe are rendered in parallel with one another.
+     */
+    virtual bool renderPartToSink(RenderSink &sink,
+                                  sv_frame_t f0, sv_frame_t f1,
+                                  int scaleFactor = 1,
+                                  int readyTimeoutMsec = -1);
+
+    static const int renderChunkWidth = 2048;
+
     /**
      * Return the visible vertical extents for the given unit, if any.
      * Overridden from LayerGeometryProvider (see docs there).
@@ -414,7 +504,10 @@ public:
     sv_frame_t alignToReference(sv_frame_t) const;
     sv_frame_t getAlignedPlaybackFrame() const;
 
-    void updatePaintRect(QRect r) override { update(r); }
+    void updatePaintRect(QRect r) override {
+        m_layerUpdatePending = true;
+        update(r);
+    }
 
     int getScaleFactor() const override { return 1; } // See ViewProxy
     
@@ -442,6 +535,17 @@ signals:
 
     void contextHelpChanged(const QString &);
 
+    /**
+     * Emitted when the lowest completion percentage reported by any
+     * layer (see getLayersCompletion) changes.
+     */
+    void layersCompletionChanged(int completion);
+
+    /**
+     * Emitted when every layer has become complete.
+     */
+    void layersReady();
+
 public slots:
     virtual void modelChanged(ModelId);
     virtual void modelChangedWithin(ModelId, sv_frame_t startFrame, sv_frame_t endFrame);
@@ -456,6 +560,7 @@ public slots:
     virtual void globalCentreFrameChanged(sv_frame_t);
     virtual void viewCentreFrameChanged(View *, sv_frame_t);
     virtual void viewManagerPlaybackFrameChanged(sv_frame_t);
+    virtual void viewManagerPlayPointerRefresh();
     virtual void viewZoomLevelChanged(View *, ZoomLevel, bool);
 
     /**
@@ -479,17 +584,34 @@ public slots:
 
     virtual void progressCheckStalledTimerElapsed();
 
+    /**
+     * Recalculate the overall completion of the layers, and emit
+     * layersCompletionChanged and layersReady as appropriate.
+     */
+    void checkLayersCompletion();
+
 protected:
     View(QWidget *, bool showProgress);
 
     int m_id;
+    int m_renderId; // reported by ViewChunkProxy when rendering us
     
     void paintEvent(QPaintEvent *e) override;
     virtual void drawSelections(QPainter &);
     virtual bool shouldLabelSelections() const { return true; }
     virtual void drawPlayPointer(QPainter &);
+    virtual void drawPaintTime(QPainter &, double msec);
+
+    /**
+     * Copy the exposed area from the buffer to the widget, and draw
+     * the selections, play pointer and paint time over it.
+     */
+    void paintBufferToWidget(QPaintEvent *e,
+                             std::chrono::steady_clock::time_point paintStart);
+
     virtual bool render(QPainter &paint, int x0, sv_frame_t f0, sv_frame_t f1);
     virtual void setPaintFont(QPainter &paint);
+    void setScaledPaintFont(QPainter &paint, int scaleFactor);
 
     QSize scaledSize(const QSize &s, int factor) {
         return QSize(s.width() * factor, s.height() * factor);
@@ -506,6 +628,36 @@ protected:
     LayerList getScrollableBackLayers(bool testChanged, bool &changed) const;
     LayerList getNonScrollableFrontLayers(bool testChanged, bool &changed) const;
 
+    /**
+     * Render one chunk of an export through a ViewChunkProxy with
+     * the given left pixel and width, painting the given layers.
+     */
+    QImage renderChunk(const LayerList &layers, int64_t leftPixel,
+                       int width, int scaleFactor);
+
+    /**
+     * Paint the background and the given layers through the given
+     * chunk proxy, in its own coordinates. Thread-safe layers are
+     * painted in parallel if parallel is true.
+     */
+    void paintChunk(QPainter &paint, const LayerList &layers,
+                    ViewChunkProxy *proxy, bool parallel);
+
+    /**
+     * Return the width in pixels of a render of the view contents
+     * between the given frame extents. This is measured on the same
+     * pixel grid that render() and renderPartToSink() paint through,
+     * so that images sized with it match what is drawn into them.
+     */
+    int getRenderedPartWidth(sv_frame_t f0, sv_frame_t f1);
+
+    /**
+     * End synchronous painting for the given layers after an export,
+     * and have them discard whatever they cached for its proxies.
+     */
+    void releaseRenderCaches(const LayerList &layers,
+                             LayerGeometryProvider *origin);
+
     Layer *getScaleProvidingLayerForUnit(QString unit) const;
     
     ZoomLevel getZoomConstraintLevel(ZoomLevel level,
@@ -532,15 +684,79 @@ protected:
 
     void movePlayPointer(sv_frame_t f);
 
+    /**
+     * Schedule a repaint of an area that has changed only because
+     * the play pointer has moved into or out of it. If nothing else
+     * needs repainting there by the time the paint happens, it is
+     * done by copying from the buffer, without painting any layer.
+     */
+    void updatePlayPointerArea(QRect r);
+
     void checkProgress(ModelId);
     void checkAlignmentProgress(ModelId);
 
     bool waitForLayersToBeReady(); // returns false if user cancelled waiting
+    bool waitForLayers(int timeoutMsec, QProgressDialog *progress);
     
     int getProgressBarWidth() const; // if visible
 
     int effectiveDevicePixelRatio() const;
 
+    /**
+     * The cache of scrollable layers is used as a ring buffer, with
+     * view column 0 found at pixmap column m_cacheOrigin, so that
+     * scrolling only has to render the newly exposed strip. A
+     * CacheSegment is the part of a rect (in scaled view coordinates)
+     * that lies in one contiguous run of the pixmap, together with
+     * the whole of that run and the offset from view to pixmap x.
+     */
+    struct CacheSegment {
+        QRect area;
+        QRect extent;
+        int offset;
+    };
+    std::vector<CacheSegment> getCacheSegments(QRect area) const;
+
+    /**
+     * Return the absolute column number (counted from the column
+     * showing frame zero, at scaled resolution) of view column 0,
+     * for use with m_tileCache.
+     */
+    int64_t getTileColumnOrigin(int dpratio) const;
+
+    /**
+     * Fill as much as possible of the given area of the cache (in
+     * scaled view coordinates) from m_tileCache, and return the part
+     * of the area that still needs to be painted. This is the span
+     * from the first to the last column not found in the tile cache,
+     * or an empty rect if all were found.
+     */
+    QRect fillCacheFromTiles(QRect area, int dpratio);
+
+    /**
+     * Copy the given area of the cache (in scaled view coordinates),
+     * which has just been painted, into m_tileCache.
+     */
+    void storeCacheToTiles(QRect area, int dpratio);
+
+    /**
+     * Invalidate the cache and discard everything in the tile cache.
+     */
+    void invalidateCache();
+
+    /**
+     * Return true if the given layer should be painted through an
+     * aligning proxy, given the reference model of the alignment.
+     */
+    bool shouldUseAligningProxy(const Layer *layer,
+                                ModelId alignmentReferenceId) const;
+
+    /**
+     * The layers of one paint that are being painted concurrently;
+     * see setParallelLayerPainting.
+     */
+    class ParallelLayerPaint;
+
     sv_frame_t          m_centreFrame;
     ZoomLevel           m_zoomLevel;
     bool                m_followPan;
@@ -550,12 +766,22 @@ protected:
     sv_frame_t          m_playPointerFrame;
     bool                m_lightBackground;
     bool                m_showProgress;
+    bool                m_showPaintTime;
+    bool                m_parallelLayerPainting;
+    int                 m_layersCompletion; // as last notified, or -1
 
     QPixmap            *m_cache;  // I own this
     QPixmap            *m_buffer; // I own this
+    bool                m_bufferValid;
+    sv_frame_t          m_bufferCentreFrame;
+    ZoomLevel           m_bufferZoomLevel;
+    QRegion             m_playPointerRegion;
+    bool                m_layerUpdatePending; // since last paint
     bool                m_cacheValid;
+    int                 m_cacheOrigin;
     sv_frame_t          m_cacheCentreFrame;
     ZoomLevel           m_cacheZoomLevel;
+    ViewTileCache       m_tileCache;
     bool                m_selectionCached;
 
     bool                m_deleting;
@@ -0,0 +1,107 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef VIEW_CHUNK_PROXY_H
+#define VIEW_CHUNK_PROXY_H
+
+#include "ViewProxy.h"
+
+/**
+ * A ViewProxy presenting one chunk of a rendering of a view that may
+ * be much wider than the view itself, for exporting without moving
+ * the view on screen. The chunk has the view's height and zoom level
+ * (both scaled by the scale factor) but a width of its own, and its
+ * left edge at a given pixel of the absolute grid for that zoom
+ * level, in which pixel zero starts at frame zero.
+ *
+ * The chunk proxy reports the id it is given rather than that of the
+ * view, so that layers keep separate per-view caches for it instead
+ * of disturbing those of the view on screen. It never illuminates
+ * features, and ignores requests to repaint.
+ */
+class ViewChunkProxy : public ViewProxy
+{
+public:
+    ViewChunkProxy(View *view, int scaleFactor, int id,
+                   int64_t leftPixel, int width) :
+        ViewProxy(view, scaleFactor),
+        m_id(id),
+        m_left(leftPixel),
+        m_width(width) { }
+
+    /**
+     * Return the pixel of the absolute grid that covers the given
+     * frame.
+     */
+    int64_t getPixelForFrame(sv_frame_t frame) const {
+        ZoomLevel z = getZoomLevel();
+        if (z.zone == ZoomLevel::FramesPerPixel) {
+            return floorDiv(frame, z.level);
+        } else {
+            return frame * z.level;
+        }
+    }
+
+    /**
+     * Return the first frame covered by the given pixel of the
+     * absolute grid.
+     */
+    sv_frame_t getFrameForPixel(int64_t pixel) const {
+        ZoomLevel z = getZoomLevel();
+        if (z.zone == ZoomLevel::FramesPerPixel) {
+            return pixel * z.level;
+        } else {
+            return floorDiv(pixel, z.level);
+        }
+    }
+
+    int getId() const override {
+        return m_id;
+    }
+    sv_frame_t getStartFrame() const override {
+        return getFrameForX(0);
+    }
+    sv_frame_t getCentreFrame() const override {
+        return getFrameForX(m_width / 2);
+    }
+    sv_frame_t getEndFrame() const override {
+        return getFrameForX(m_width) - 1;
+    }
+    int getXForFrame(sv_frame_t frame) const override {
+        return int(getPixelForFrame(frame) - m_left);
+    }
+    sv_frame_t getFrameForX(int x) const override {
+        return getFrameForPixel(m_left + x);
+    }
+    QRect getPaintRect() const override {
+        return QRect(0, 0, m_width, ViewProxy::getPaintRect().height());
+    }
+    bool shouldIlluminateLocalFeatures(const Layer *, QPoint &) const override {
+        return false;
+    }
+    void updatePaintRect(QRect) override { }
+
+private:
+    int m_id;
+    int64_t m_left;
+    int m_width;
+
+    static int64_t floorDiv(int64_t a, int64_t b) {
+        int64_t q = a / b;
+        if ((a % b != 0) && ((a < 0) != (b < 0))) --q;
+        return q;
+    }
+};
+
+#endif
@@ -27,8 +27,10 @@
 #include <QSettings>
 #include <QApplication>
 #include <QStyleFactory>
+#include <QScreen>
 
 #include <iostream>
+#include <cmath>
 
 //#define DEBUG_VIEW_MANAGER 1
 
@@ -41,6 +43,11 @@ ViewManager::ViewManager() :
     m_mainModelSampleRate(0),
     m_lastLeft(0), 
     m_lastRight(0),
+    m_playPointerTimer(new QTimer(this)),
+    m_havePlaybackPoll(false),
+    m_lastPolledFrame(0),
+    m_polledFrameRate(0.0),
+    m_lastInterpolatedFrame(0),
     m_inProgressExclusive(true),
     m_toolMode(NavigateMode),
     m_playLoopMode(false),
@@ -74,6 +81,10 @@ ViewManager::ViewManager() :
         settings.value("show-centre-line", m_showCentreLine).toBool();
     settings.endGroup();
 
+    m_playPointerTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_playPointerTimer, SIGNAL(timeout()),
+            this, SLOT(playPointerTimerTimedOut()));
+
     if (getGlobalDarkBackground()) {
         // i.e. widgets are already dark; create a light palette in
         // case we are asked to switch to it, but don't create a dark
@@ -199,8 +210,107 @@ ViewManager::setPlaybackFrame(sv_frame_t f)
         emit playbackFrameChanged(f);
         if (isPlaying()) {
             m_playSource->play(f);
+            resetPlaybackInterpolation(f);
+        }
+    }
+}
+
+sv_frame_t
+ViewManager::getInterpolatedPlaybackFrame() const
+{
+    if (isRecording() || !isPlaying() || !m_havePlaybackPoll) {
+        return getPlaybackFrame();
+    }
+
+    // Don't run on for more than a few polls' worth without hearing
+    // from the play source, in case it has stalled
+    double maxElapsed = 0.1;
+    
+    double elapsed = std::chrono::duration<double>
+        (std::chrono::steady_clock::now() - m_lastPollTime).count();
+    if (elapsed > maxElapsed) elapsed = maxElapsed;
+
+    sv_frame_t f = m_lastPolledFrame +
+        sv_frame_t(round(elapsed * m_polledFrameRate));
+
+    // If we overshot and the latest poll has pulled us back a little,
+    // hold the pointer still rather than letting it jitter backwards
+    sv_frame_t jitter = sv_frame_t(round(maxElapsed * m_polledFrameRate));
+    if (f < m_lastInterpolatedFrame && f >= m_lastInterpolatedFrame - jitter) {
+        f = m_lastInterpolatedFrame;
+    }
+
+    m_lastInterpolatedFrame = f;
+    return f;
+}
+
+void
+ViewManager::notePlaybackPolled(sv_frame_t frame)
+{
+    auto now = std::chrono::steady_clock::now();
+    double nominalRate = getPlaybackSampleRate();
+
+    if (!m_havePlaybackPoll) {
+        resetPlaybackInterpolation(frame);
+        return;
+    }
+    
+    double dt = std::chrono::duration<double>(now - m_lastPollTime).count();
+    sv_frame_t df = frame - m_lastPolledFrame;
+
+    if (dt <= 0.0 || df < 0 ||
+        (nominalRate > 0.0 && df > nominalRate * (dt * 4.0 + 0.1))) {
+        // A seek or a loop back to the start: go again from here
+        resetPlaybackInterpolation(frame);
+        return;
+    }
+
+    // Smooth the observed rate, which is lumpy because the play
+    // source advances a processing block at a time
+    double observedRate = double(df) / dt;
+    m_polledFrameRate = m_polledFrameRate * 0.8 + observedRate * 0.2;
+
+    m_lastPolledFrame = frame;
+    m_lastPollTime = now;
+}
+
+void
+ViewManager::resetPlaybackInterpolation(sv_frame_t frame)
+{
+    m_havePlaybackPoll = true;
+    m_lastPolledFrame = frame;
+    m_lastPollTime = std::chrono::steady_clock::now();
+    m_polledFrameRate = getPlaybackSampleRate();
+    m_lastInterpolatedFrame = frame;
+}
+
+void
+ViewManager::startPlayPointerTimer()
+{
+    if (m_playPointerTimer->isActive()) {
+        return;
+    }
+
+    // Widgets have no access to the display's vertical sync, so the
+    // nearest we can get is a precise timer at its refresh rate
+    double refreshRate = 60.0;
+    if (QScreen *screen = QGuiApplication::primaryScreen()) {
+        if (screen->refreshRate() > 0.0) {
+            refreshRate = screen->refreshRate();
         }
     }
+
+    m_playPointerTimer->start(std::max(1, int(round(1000.0 / refreshRate))));
+}
+
+void
+ViewManager::playPointerTimerTimedOut()
+{
+    if (!isPlaying() || isRecording()) {
+        m_playPointerTimer->stop();
+        return;
+    }
+    emit playPointerRefresh();
 }
 
 ModelId
@@ -583,6 +693,7 @@ ViewManager::checkPlayStatus()
         }
 
         m_playbackFrame = m_recordTarget->getRecordDuration();
+        m_playPointerTimer->stop();
 
 #ifdef DEBUG_VIEW_MANAGER
         cerr << "ViewManager::checkPlayStatus: Recording, frame " << m_playbackFrame << ", levels " << m_lastLeft << "," << m_lastRight << endl;
@@ -604,17 +715,22 @@ ViewManager::checkPlayStatus()
         }
 
         m_playbackFrame = m_playSource->getCurrentPlayingFrame();
+        notePlaybackPolled(m_playbackFrame);
 
 #ifdef DEBUG_VIEW_MANAGER
         cerr << "ViewManager::checkPlayStatus: Playing, frame " << m_playbackFrame << ", levels " << m_lastLeft << "," << m_lastRight << endl;
 #endif
 
         emit playbackFrameChanged(m_playbackFrame);
+        startPlayPointerTimer();
 
         QTimer::singleShot(20, this, SLOT(checkPlayStatus()));
 
     } else {
 
+        m_playPointerTimer->stop();
+        m_havePlaybackPoll = false;
+
         if (m_lastLeft != 0.0 || m_lastRight != 0.0) {
             emit monitoringLevelsChanged(0.0, 0.0);
             m_lastLeft = 0.0;
@@ -691,6 +807,7 @@ ViewManager::seek(sv_frame_t f)
         if (diff > 20000) {
             m_playbackFrame = f;
             m_playSource->play(f);
+            resetPlaybackInterpolation(f);
 #ifdef DEBUG_VIEW_MANAGER 
             cerr << "ViewManager::seek: reseeking from " << playFrame << " to " << f << endl;
 #endif
@@ -21,6 +21,7 @@
 #include <QPalette>
 
 #include <map>
+#include <chrono>
 
 #include "base/ViewManagerBase.h"
 #include "base/Selection.h"
@@ -94,6 +95,16 @@ public:
 
     sv_frame_t getPlaybackFrame() const; // the set method is a slot
 
+    /**
+     * Return the playback frame estimated for the present moment.
+     * During playback this extrapolates from the most recent poll of
+     * the play source, using a high-resolution clock and the rate at
+     * which playback has recently been observed to advance, so that
+     * it moves smoothly between polls. At other times it is the same
+     * as getPlaybackFrame().
+     */
+    sv_frame_t getInterpolatedPlaybackFrame() const;
+
     // Only meaningful in solo mode, and used for optional alignment feature
     ModelId getPlaybackModel() const;
     void setPlaybackModel(ModelId);
@@ -281,6 +292,11 @@ signals:
     /** Emitted when the playback frame changes. */
     void playbackFrameChanged(sv_frame_t frame);
 
+    /** Emitted at the display refresh rate during playback, for
+     * views to move their play pointers to the frame returned by
+     * getInterpolatedPlaybackFrame(). */
+    void playPointerRefresh();
+
     /** Emitted when the output or record levels change. Values in range 0.0 -> 1.0. */
     void monitoringLevelsChanged(float left, float right);
 
@@ -339,6 +355,7 @@ public slots:
 
 protected slots:
     void checkPlayStatus();
+    void playPointerTimerTimedOut();
     void seek(sv_frame_t);
 //!!!    void considerZoomChange(void *, int, bool);
 
@@ -355,6 +372,17 @@ protected:
     float m_lastLeft;
     float m_lastRight;
 
+    QTimer *m_playPointerTimer;
+    bool m_havePlaybackPoll;
+    sv_frame_t m_lastPolledFrame;
+    std::chrono::steady_clock::time_point m_lastPollTime;
+    double m_polledFrameRate;
+    mutable sv_frame_t m_lastInterpolatedFrame;
+
+    void notePlaybackPolled(sv_frame_t frame);
+    void resetPlaybackInterpolation(sv_frame_t frame);
+    void startPlayPointerTimer();
+
     MultiSelection m_selections;
     Selection m_inProgressSelection;
     bool m_inProgressExclusive;
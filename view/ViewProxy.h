@@ -28,7 +28,8 @@ public:
      * pixel-doubled "retina" Mac displays and is usually 1 elsewhere.
      */
     ViewProxy(View *view, int scaleFactor) :
-        m_view(view), m_scaleFactor(scaleFactor) { }
+        m_view(view), m_scaleFactor(scaleFactor), m_coloursFixed(false),
+        m_lightBackground(false) { }
 
     /**
      * Create a re-aligning ViewProxy for the given view, mapping
@@ -47,7 +48,8 @@ public:
      * the rest of the containing view.
      */
     ViewProxy(View *view, int scaleFactor, ModelId alignment) :
-        m_view(view), m_scaleFactor(scaleFactor), m_alignment(alignment) { }
+        m_view(view), m_scaleFactor(scaleFactor), m_alignment(alignment),
+        m_coloursFixed(false), m_lightBackground(false) { }
 
     int getId() const override {
         return m_view->getId();
@@ -134,14 +136,32 @@ public:
         return getPaintRect().height();
     }
     bool hasLightBackground() const override {
+        if (m_coloursFixed) return m_lightBackground;
         return m_view->hasLightBackground();
     }
     QColor getForeground() const override {
+        if (m_coloursFixed) return m_foreground;
         return m_view->getForeground();
     }
     QColor getBackground() const override {
+        if (m_coloursFixed) return m_background;
         return m_view->getBackground();
     }
+
+    /**
+     * Take the background and foreground from the view now, and
+     * return those from then on instead of asking the view each
+     * time. The view works them out from its layers and its widget
+     * palette, which may only be used on the GUI thread, so this
+     * must be called there before the proxy is given to a layer
+     * painting on any other thread.
+     */
+    void fixColours() {
+        m_lightBackground = m_view->hasLightBackground();
+        m_foreground = m_view->getForeground();
+        m_background = m_view->getBackground();
+        m_coloursFixed = true;
+    }
     ViewManager *getViewManager() const override {
         return m_view->getViewManager();
     }
@@ -164,10 +184,10 @@ public:
     }
 
     void updatePaintRect(QRect r) override {
-        m_view->update(r.x() / m_scaleFactor,
-                       r.y() / m_scaleFactor,
-                       r.width() / m_scaleFactor,
-                       r.height() / m_scaleFactor);
+        m_view->updatePaintRect(QRect(r.x() / m_scaleFactor,
+                                      r.y() / m_scaleFactor,
+                                      r.width() / m_scaleFactor,
+                                      r.height() / m_scaleFactor));
     }
 
     /**
@@ -215,6 +235,10 @@ private:
     View *m_view;
     int m_scaleFactor;
     ModelId m_alignment;
+    bool m_coloursFixed;
+    bool m_lightBackground;
+    QColor m_foreground;
+    QColor m_background;
 
     sv_frame_t alignToReference(sv_frame_t frame) const {
         if (auto am = ModelById::getAs<AlignmentModel>(m_alignment)) {
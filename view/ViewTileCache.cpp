@@ -0,0 +1,247 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ViewTileCache.h"
+
+#include "base/HitCount.h"
+#include "base/Debug.h"
+
+#include <QPainter>
+
+#include <algorithm>
+
+using namespace std;
+
+//#define DEBUG_VIEW_TILE_CACHE 1
+
+static int64_t
+floorDiv(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0))) --q;
+    return q;
+}
+
+void
+ViewTileCache::setMemoryBudget(size_t bytes)
+{
+    m_budget = bytes;
+    evict();
+}
+
+void
+ViewTileCache::clear()
+{
+    m_tiles.clear();
+    m_used = 0;
+}
+
+size_t
+ViewTileCache::getBytes(const Tile &tile)
+{
+    return size_t(tile.pixmap.width()) * size_t(tile.pixmap.height()) *
+        size_t(std::max(tile.pixmap.depth(), 8) / 8);
+}
+
+void
+ViewTileCache::invalidateFrameRange(sv_frame_t from, sv_frame_t to)
+{
+    auto i = m_tiles.begin();
+    while (i != m_tiles.end()) {
+        // a column's margin either side, as for the scrollable caches
+        sv_frame_t margin = 0;
+        if (i->first.zoom.zone == ZoomLevel::FramesPerPixel) {
+            margin = i->first.zoom.level;
+        } else {
+            margin = 1;
+        }
+        if (i->second.startFrame < to + margin &&
+            i->second.endFrame > from - margin) {
+            m_used -= getBytes(i->second);
+            i = m_tiles.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void
+ViewTileCache::store(ZoomLevel zoom, int ratio, int64_t column,
+                     const QPixmap &source, QRect sourceArea,
+                     sv_frame_t frame0, sv_frame_t frame1)
+{
+    if (m_budget == 0 || sourceArea.width() <= 0) {
+        return;
+    }
+    if (sourceArea.top() != 0 || sourceArea.height() != source.height()) {
+        SVCERR << "ViewTileCache::store: ERROR: Source area must have the "
+               << "full height of the source pixmap" << endl;
+        throw std::logic_error("Source area not of full height in ViewTileCache::store");
+    }
+
+    int height = source.height();
+    int x = 0;
+    int width = sourceArea.width();
+
+    while (x < width) {
+
+        int64_t index = floorDiv(column + x, tileWidth);
+        int a = int(column + x - index * tileWidth);
+        int b = std::min(tileWidth, a + (width - x));
+        int n = b - a;
+
+        // Frames shown by the columns stored in this tile, by linear
+        // interpolation across the whole source area
+        sv_frame_t f0 = frame0 + ((frame1 - frame0) * x) / width;
+        sv_frame_t f1 = frame0 + ((frame1 - frame0) * (x + n)) / width;
+        
+        Key key { zoom, ratio, height, index };
+        auto ti = m_tiles.find(key);
+
+        if (ti == m_tiles.end()) {
+            Tile tile;
+            tile.pixmap = QPixmap(tileWidth, height);
+            tile.validLeft = a;
+            tile.validRight = a;
+            tile.startFrame = f0;
+            tile.endFrame = f1;
+            tile.lastUsed = 0;
+            ti = m_tiles.insert({ key, tile }).first;
+            m_used += getBytes(ti->second);
+        }
+
+        Tile &tile = ti->second;
+        tile.lastUsed = ++m_clock;
+
+        if (tile.validRight >= a && tile.validLeft <= b &&
+            tile.validRight > tile.validLeft) {
+            // overlapping or touching what we have
+            tile.validLeft = std::min(tile.validLeft, a);
+            tile.validRight = std::max(tile.validRight, b);
+            tile.startFrame = std::min(tile.startFrame, f0);
+            tile.endFrame = std::max(tile.endFrame, f1);
+        } else if (n >= tile.validRight - tile.validLeft) {
+            // the valid area must be contiguous: keep the larger part
+            tile.validLeft = a;
+            tile.validRight = b;
+            tile.startFrame = f0;
+            tile.endFrame = f1;
+        } else {
+            x += n;
+            continue;
+        }
+
+        QPainter paint(&tile.pixmap);
+        paint.setCompositionMode(QPainter::CompositionMode_Source);
+        paint.drawPixmap(QRect(a, 0, n, height), source,
+                         QRect(sourceArea.left() + x, 0, n, height));
+        paint.end();
+
+#ifdef DEBUG_VIEW_TILE_CACHE
+        SVDEBUG << "ViewTileCache::store: stored " << n << " columns in tile "
+                << index << " at zoom " << zoom << ", tile now valid from "
+                << tile.validLeft << " to " << tile.validRight
+                << ", using " << m_used << " of " << m_budget << " bytes"
+                << endl;
+#endif
+
+        x += n;
+    }
+
+    evict();
+}
+
+int
+ViewTileCache::draw(ZoomLevel zoom, int ratio, int height,
+                    int64_t column, int width,
+                    QPainter &paint, int x,
+                    vector<bool> &covered)
+{
+    static HitCount count("ViewTileCache: columns");
+    
+    covered = vector<bool>(std::max(width, 0), false);
+    if (width <= 0 || m_tiles.empty()) {
+        return 0;
+    }
+
+    int drawn = 0;
+    
+    int64_t i0 = floorDiv(column, tileWidth);
+    int64_t i1 = floorDiv(column + width - 1, tileWidth);
+
+    for (int64_t index = i0; index <= i1; ++index) {
+
+        auto ti = m_tiles.find({ zoom, ratio, height, index });
+        if (ti == m_tiles.end()) {
+            continue;
+        }
+
+        Tile &tile = ti->second;
+
+        // Requested columns within this tile, intersected with the
+        // valid ones
+        int64_t tileColumn = index * tileWidth;
+        int a = int(std::max(column, tileColumn + tile.validLeft) -
+                    tileColumn);
+        int b = int(std::min(column + width, tileColumn + tile.validRight) -
+                    tileColumn);
+        if (b <= a) {
+            continue;
+        }
+
+        tile.lastUsed = ++m_clock;
+
+        int offset = int(tileColumn + a - column);
+        paint.drawPixmap(QRect(x + offset, 0, b - a, height), tile.pixmap,
+                         QRect(a, 0, b - a, height));
+
+        for (int c = 0; c < b - a; ++c) {
+            covered[offset + c] = true;
+        }
+        drawn += b - a;
+    }
+
+    if (drawn == width) {
+        count.hit();
+    } else if (drawn > 0) {
+        count.partial();
+    } else {
+        count.miss();
+    }
+    
+    return drawn;
+}
+
+void
+ViewTileCache::evict()
+{
+    while (m_used > m_budget && !m_tiles.empty()) {
+
+        auto oldest = m_tiles.begin();
+        for (auto i = m_tiles.begin(); i != m_tiles.end(); ++i) {
+            if (i->second.lastUsed < oldest->second.lastUsed) {
+                oldest = i;
+            }
+        }
+
+#ifdef DEBUG_VIEW_TILE_CACHE
+        SVDEBUG << "ViewTileCache::evict: discarding tile "
+                << oldest->first.index << " at zoom " << oldest->first.zoom
+                << endl;
+#endif
+
+        m_used -= getBytes(oldest->second);
+        m_tiles.erase(oldest);
+    }
+}
@@ -0,0 +1,139 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_VIEW_TILE_CACHE_H
+#define SV_VIEW_TILE_CACHE_H
+
+#include "base/BaseTypes.h"
+#include "base/ZoomLevel.h"
+
+#include <QPixmap>
+#include <QRect>
+
+#include <map>
+#include <vector>
+#include <cstdint>
+
+class QPainter;
+
+/**
+ * A store of previously painted columns of a View's scrollable back
+ * layers, kept across zoom levels and scroll positions within a fixed
+ * memory budget.
+ *
+ * The View's own cache holds only what is currently visible. Columns
+ * painted into it are also stored here, in tiles of tileWidth columns
+ * at full view height, aligned to a fixed grid of absolute columns
+ * (i.e. counted from the column showing frame zero) at each zoom
+ * level. When the View's cache has to be repainted, because the view
+ * has been resized or zoomed, or has jumped to a region it showed
+ * before, whatever this store still holds is copied back first, and
+ * only the columns it lacks are painted afresh.
+ *
+ * Each tile has its own valid range of columns, which is contiguous,
+ * and its own approximate frame extent so that a change to part of a
+ * model need only discard the tiles that show it. When the budget is
+ * exceeded, the least recently used tiles are discarded first.
+ */
+class ViewTileCache
+{
+public:
+    static const int tileWidth = 256;
+
+    ViewTileCache() :
+        m_budget(32 * 1024 * 1024),
+        m_used(0),
+        m_clock(0)
+    {}
+
+    /**
+     * Set the memory budget in bytes, discarding tiles if necessary.
+     * A budget of zero disables the store.
+     */
+    void setMemoryBudget(size_t bytes);
+
+    size_t getMemoryBudget() const {
+        return m_budget;
+    }
+
+    size_t getMemoryUsed() const {
+        return m_used;
+    }
+
+    void clear();
+
+    /**
+     * Discard any tiles showing any part of the given range of
+     * frames, together with a column either side.
+     */
+    void invalidateFrameRange(sv_frame_t from, sv_frame_t to);
+
+    /**
+     * Store the given area of the source pixmap, whose left column
+     * is absolute column number column at the given zoom level and
+     * device pixel ratio, and which shows the frames from frame0 to
+     * frame1. The area must have the full height of the source.
+     */
+    void store(ZoomLevel zoom, int ratio, int64_t column,
+               const QPixmap &source, QRect sourceArea,
+               sv_frame_t frame0, sv_frame_t frame1);
+
+    /**
+     * Draw whatever is stored of the width columns from absolute
+     * column number column, at the given zoom level, device pixel
+     * ratio and height, with the left of the first column at x and
+     * the top at zero. On return, covered holds width elements, true
+     * for each column that was drawn. Return the number of columns
+     * drawn.
+     */
+    int draw(ZoomLevel zoom, int ratio, int height,
+             int64_t column, int width,
+             QPainter &paint, int x,
+             std::vector<bool> &covered);
+
+private:
+    struct Key {
+        ZoomLevel zoom;
+        int ratio;
+        int height;
+        int64_t index;
+
+        bool operator<(const Key &k) const {
+            if (zoom.zone != k.zoom.zone) return zoom.zone < k.zoom.zone;
+            if (zoom.level != k.zoom.level) return zoom.level < k.zoom.level;
+            if (ratio != k.ratio) return ratio < k.ratio;
+            if (height != k.height) return height < k.height;
+            return index < k.index;
+        }
+    };
+
+    struct Tile {
+        QPixmap pixmap;
+        int validLeft;  // columns within tile
+        int validRight;
+        sv_frame_t startFrame;
+        sv_frame_t endFrame;
+        uint64_t lastUsed;
+    };
+
+    std::map<Key, Tile> m_tiles;
+    size_t m_budget;
+    size_t m_used;
+    uint64_t m_clock;
+
+    static size_t getBytes(const Tile &tile);
+    void evict();
+};
+
+#endif